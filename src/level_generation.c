@@ -0,0 +1,596 @@
+/******************************************************************************
+   Filename: level_generation.c
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: Function definitions for PebbleQuest's level generator, which is
+             built into both the app and its background worker (so it uses
+             only what <pebble_worker.h> provides).
+******************************************************************************/
+
+#include <pebble_worker.h>
+#include "level_generation.h"
+
+/******************************************************************************
+   Function: get_cell_farther_away
+
+Description: Given a set of cell coordinates, returns new cell coordinates a
+             given distance farther away in a given direction. (These may lie
+             out-of-bounds.)
+
+     Inputs: reference_point - Reference cell coordinates.
+             direction       - Direction of interest.
+             distance        - How far back we want to go.
+
+    Outputs: Cell coordinates a given distance farther away from those passed
+             in. (These may lie out-of-bounds.)
+******************************************************************************/
+GPoint get_cell_farther_away(const GPoint reference_point,
+                             const int8_t direction,
+                             const int8_t distance) {
+  switch (direction) {
+    case NORTH:
+      return GPoint(reference_point.x, reference_point.y - distance);
+    case SOUTH:
+      return GPoint(reference_point.x, reference_point.y + distance);
+    case EAST:
+      return GPoint(reference_point.x + distance, reference_point.y);
+    default:  // case WEST:
+      return GPoint(reference_point.x - distance, reference_point.y);
+  }
+}
+
+/******************************************************************************
+   Function: get_opposite_direction
+
+Description: Returns the opposite of a given direction value (i.e., given the
+             argument "NORTH", "SOUTH" will be returned).
+
+     Inputs: direction - The direction whose opposite is desired.
+
+    Outputs: Integer representing the opposite of the given direction.
+******************************************************************************/
+int8_t get_opposite_direction(const int8_t direction) {
+  if (direction == NORTH) {
+    return SOUTH;
+  } else if (direction == SOUTH) {
+    return NORTH;
+  } else if (direction == EAST) {
+    return WEST;
+  } else {  // if (direction == WEST)
+    return EAST;
+  }
+}
+
+/******************************************************************************
+   Function: set_chunk_cell_type
+
+Description: Sets a given cell within a given map chunk to a given type,
+             updating the chunk's solidity bitset and special cell table. (If
+             the table is full, new loot, doors, etc. are simply lost.)
+
+     Inputs: chunk - Pointer to the chunk containing the cell.
+             cell  - Coordinates of the cell of interest.
+             type  - The cell type to be assigned at those coordinates.
+
+    Outputs: None.
+******************************************************************************/
+void set_chunk_cell_type(map_chunk_t *const chunk,
+                         const GPoint cell,
+                         const int8_t type) {
+  const uint8_t cell_index = CHUNK_CELL_INDEX(cell),
+                i = find_special_cell(chunk, cell_index);
+  special_cell_t *const special_cell = &chunk->special_cells[i];
+  const bool is_special = i < chunk->num_special_cells &&
+                          special_cell->cell == cell_index;
+
+  // Update the solidity bitset:
+  if (type == SOLID) {
+    chunk->solid_rows[CHUNK_OFFSET(cell.y)] |= 1 << CHUNK_OFFSET(cell.x);
+  } else {
+    chunk->solid_rows[CHUNK_OFFSET(cell.y)] &= ~(1 << CHUNK_OFFSET(cell.x));
+  }
+
+  // Add, update, or remove the cell's entry in the special cell table:
+  if (type != SOLID && type != EMPTY) {
+    if (is_special) {
+      special_cell->type = type;
+    } else if (chunk->num_special_cells < MAX_SPECIAL_CELLS) {
+      memmove(special_cell + 1,
+              special_cell,
+              (chunk->num_special_cells - i) * sizeof(special_cell_t));
+      special_cell->cell = cell_index;
+      special_cell->type = type;
+      chunk->num_special_cells++;
+    }
+  } else if (is_special) {
+    chunk->num_special_cells--;
+    memmove(special_cell,
+            special_cell + 1,
+            (chunk->num_special_cells - i) * sizeof(special_cell_t));
+  }
+}
+
+/******************************************************************************
+   Function: find_special_cell
+
+Description: Binary-searches a map chunk's (sorted) special cell table for a
+             given cell index.
+
+     Inputs: chunk      - Pointer to the chunk of interest.
+             cell_index - Index of the cell of interest ("CHUNK_CELL_INDEX").
+
+    Outputs: Position of the cell's entry in the table, or of the first entry
+             past it if it has none.
+******************************************************************************/
+uint8_t find_special_cell(const map_chunk_t *const chunk,
+                          const uint8_t cell_index) {
+  uint8_t low = 0, high = chunk->num_special_cells, middle;
+
+  while (low < high) {
+    middle = (low + high) / 2;
+    if (chunk->special_cells[middle].cell < cell_index) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+/******************************************************************************
+   Function: clear_map_chunk
+
+Description: Makes every cell of a given map chunk solid.
+
+     Inputs: chunk - Pointer to the chunk to be cleared.
+
+    Outputs: None.
+******************************************************************************/
+void clear_map_chunk(map_chunk_t *const chunk) {
+  int8_t i;
+
+  for (i = 0; i < CHUNK_SIZE; ++i) {
+    chunk->solid_rows[i] = SOLID_MAP_ROW;
+  }
+  chunk->num_special_cells = 0;
+}
+
+/******************************************************************************
+   Function: init_level_generator
+
+Description: Prepares to generate the location with a given seed and depth,
+             choosing its color schemes and scattering its rooms, keeping clear
+             of the map's edges (the first room, with the entrance, lies on the
+             opposite side of the map from the last one, with the exit). Nothing
+             is carved until "run_level_generator" is called.
+
+     Inputs: generator - Pointer to the generator to be initialized.
+             seed      - The location's seed (see "get_level_seed").
+             depth     - The location's depth.
+             chunks    - The resident chunks to be carved (only those marked
+                         "generating" are changed).
+
+    Outputs: None.
+******************************************************************************/
+void init_level_generator(level_generator_t *const generator,
+                          const uint32_t seed,
+                          const int8_t depth,
+                          resident_chunk_t (*const chunks)
+                            [RESIDENT_CHUNKS_WIDE]) {
+  int8_t i, radius;
+
+  generator->resume_line = 0;
+  generator->seed = generator->state = seed;
+  generator->depth = depth;
+  generator->chunks = chunks;
+  generator->open_rows = NULL;
+  generator->floor_color_scheme = get_seeded_random(&generator->state) %
+                                    NUM_BACKGROUND_COLOR_SCHEMES;
+  generator->wall_color_scheme = get_seeded_random(&generator->state) %
+                                   NUM_BACKGROUND_COLOR_SCHEMES;
+  generator->direction = get_seeded_random(&generator->state) %
+                           NUM_DIRECTIONS;
+  for (i = 0; i < NUM_LEVEL_ROOMS; ++i) {
+    radius = generator->room_radii[i] =
+      MIN_LEVEL_ROOM_RADIUS + get_seeded_random(&generator->state) %
+                                (MAX_LEVEL_ROOM_RADIUS -
+                                   MIN_LEVEL_ROOM_RADIUS + 1);
+    generator->room_centers[i].x =
+      1 + radius + get_seeded_random(&generator->state) %
+                     (MAP_WIDTH - 2 - 2 * radius);
+    generator->room_centers[i].y =
+      1 + radius + get_seeded_random(&generator->state) %
+                     (MAP_HEIGHT - 2 - 2 * radius);
+    if (i == 0 || i == NUM_LEVEL_ROOMS - 1) {
+      switch (i == 0 ? get_opposite_direction(generator->direction) :
+                       generator->direction) {
+        case NORTH:
+          generator->room_centers[i].y = 1 + radius;
+          break;
+        case SOUTH:
+          generator->room_centers[i].y = MAP_HEIGHT - 2 - radius;
+          break;
+        case EAST:
+          generator->room_centers[i].x = MAP_WIDTH - 2 - radius;
+          break;
+        default:  // case WEST:
+          generator->room_centers[i].x = 1 + radius;
+          break;
+      }
+    }
+  }
+  generator->entrance = generator->room_centers[0];
+  generator->exit = generator->room_centers[NUM_LEVEL_ROOMS - 1];
+}
+
+/******************************************************************************
+   Function: run_level_generator
+
+Description: Carves the next part of a level laid out by
+             "init_level_generator", resuming where the previous call left off
+             (see "TASK_BEGIN"). Rooms are carved, each is joined to the one
+             before it so all are reachable, then a few extra corridors form
+             loops and a few dead ends lead out of random rooms. Loot goes at
+             the dead ends first, then in random rooms, with more of it deeper
+             down. The first dead end is closed off by a locked gate (its key
+             lies beside the entrance), and the others may have doors and
+             pressure traps. (Each call does a bounded amount of work: one
+             room or corridor, or all the loot, doors, etc.)
+
+     Inputs: generator - Pointer to the generator.
+
+    Outputs: "True" once the level is complete (and "false" if more calls are
+             needed).
+******************************************************************************/
+bool run_level_generator(level_generator_t *const generator) {
+  int8_t j, direction;
+  GPoint cell, doorway;
+
+  TASK_BEGIN(generator->resume_line);
+  for (generator->i = 0; generator->i < NUM_LEVEL_ROOMS; ++generator->i) {
+    carve_level_room(generator,
+                     generator->room_centers[generator->i],
+                     generator->room_radii[generator->i]);
+    TASK_YIELD(generator->resume_line);
+  }
+
+  // Join each room to the one before it, then add a few loops:
+  for (generator->i = 1; generator->i < NUM_LEVEL_ROOMS; ++generator->i) {
+    carve_level_corridor(generator,
+                         generator->room_centers[generator->i - 1],
+                         generator->room_centers[generator->i],
+                         get_seeded_random(&generator->state) % 2);
+    TASK_YIELD(generator->resume_line);
+  }
+  for (generator->i = 0; generator->i < NUM_LEVEL_LOOPS; ++generator->i) {
+    j = get_seeded_random(&generator->state) % NUM_LEVEL_ROOMS;
+    carve_level_corridor(generator,
+                         generator->room_centers[j],
+                         generator->room_centers[
+                           get_seeded_random(&generator->state) %
+                             NUM_LEVEL_ROOMS],
+                         get_seeded_random(&generator->state) % 2);
+    TASK_YIELD(generator->resume_line);
+  }
+
+  // Add dead ends, each leading straight out of a random room:
+  for (generator->i = 0; generator->i < NUM_LEVEL_DEAD_ENDS; ++generator->i) {
+    j = get_seeded_random(&generator->state) % NUM_LEVEL_ROOMS;
+    direction = get_seeded_random(&generator->state) % NUM_DIRECTIONS;
+    cell = get_cell_farther_away(generator->room_centers[j],
+                                 direction,
+                                 generator->room_radii[j] +
+                                   MIN_DEAD_END_LENGTH +
+                                   get_seeded_random(&generator->state) %
+                                     (MAX_DEAD_END_LENGTH -
+                                        MIN_DEAD_END_LENGTH + 1));
+    cell.x = cell.x < 1 ? 1 : cell.x > MAP_WIDTH - 2 ? MAP_WIDTH - 2 : cell.x;
+    cell.y = cell.y < 1 ? 1 :
+               cell.y > MAP_HEIGHT - 2 ? MAP_HEIGHT - 2 : cell.y;
+    carve_level_corridor(generator, generator->room_centers[j], cell, false);
+    generator->dead_ends[generator->i] = cell;
+    doorway = get_cell_farther_away(generator->room_centers[j],
+                                    direction,
+                                    generator->room_radii[j] + 1);
+    generator->doorways[generator->i] =
+      abs(cell.x - generator->room_centers[j].x) +
+        abs(cell.y - generator->room_centers[j].y) >
+          generator->room_radii[j] + 1 ? doorway : cell;
+    TASK_YIELD(generator->resume_line);
+  }
+
+  // Add loot (never at the entrance or exit):
+  generator->num_loot = MIN_LEVEL_LOOT +
+                        generator->depth / LEVEL_LOOT_DEPTH_INTERVAL;
+  if (generator->num_loot > MAX_LEVEL_LOOT) {
+    generator->num_loot = MAX_LEVEL_LOOT;
+  }
+  for (generator->i = 0;
+       generator->i < generator->num_loot;
+       ++generator->i) {
+    if (generator->i < NUM_LEVEL_DEAD_ENDS) {
+      cell = generator->dead_ends[generator->i];
+    } else {
+      j = get_seeded_random(&generator->state) % NUM_LEVEL_ROOMS;
+      cell.x = generator->room_centers[j].x - generator->room_radii[j] +
+               get_seeded_random(&generator->state) %
+                 (2 * generator->room_radii[j] + 1);
+      cell.y = generator->room_centers[j].y - generator->room_radii[j] +
+               get_seeded_random(&generator->state) %
+                 (2 * generator->room_radii[j] + 1);
+    }
+    if (!POINTS_EQUAL(cell, generator->entrance) &&
+        !POINTS_EQUAL(cell, generator->exit)) {
+      carve_level_cell(generator,
+                       cell,
+                       FIRST_HEAVY_ITEM +
+                         get_seeded_random(&generator->state) %
+                           NUM_HEAVY_ITEM_TYPES);
+    }
+  }
+
+  // Close off the first dead end with a locked gate and maybe put a door
+  // and/or a pressure trap in each of the others (the trap just inside, so
+  // it's never at the dead end's loot):
+  for (generator->i = 0; generator->i < NUM_LEVEL_DEAD_ENDS; ++generator->i) {
+    doorway = generator->doorways[generator->i];
+    cell = generator->dead_ends[generator->i];
+    if (POINTS_EQUAL(doorway, cell) ||
+        POINTS_EQUAL(doorway, generator->entrance) ||
+        POINTS_EQUAL(doorway, generator->exit)) {
+      continue;
+    }
+    if (generator->i == 0) {
+      carve_level_cell(generator, doorway, LOCKED_GATE);
+      continue;
+    }
+    if (get_seeded_random(&generator->state) % DEAD_END_DOOR_ODDS == 0) {
+      carve_level_cell(generator, doorway, DOOR);
+    }
+    doorway.x += cell.x > doorway.x ? 1 : cell.x < doorway.x ? -1 : 0;
+    doorway.y += cell.y > doorway.y ? 1 : cell.y < doorway.y ? -1 : 0;
+    if (get_seeded_random(&generator->state) % DEAD_END_TRAP_ODDS == 0 &&
+        !POINTS_EQUAL(doorway, cell) &&
+        !POINTS_EQUAL(doorway, generator->entrance) &&
+        !POINTS_EQUAL(doorway, generator->exit)) {
+      carve_level_cell(generator, doorway, TRAP);
+    }
+  }
+
+  // The gate's key goes beside the entrance (rooms are at least 3x3, so it's
+  // always within the first room):
+  carve_level_cell(generator,
+                   get_cell_farther_away(generator->entrance,
+                                         get_seeded_random(&generator->state) %
+                                           NUM_DIRECTIONS,
+                                         1),
+                   KEY);
+
+  // There's no exit at maximum depth:
+  carve_level_cell(generator,
+                   generator->exit,
+                   generator->depth < MAX_DEPTH ? EXIT : EMPTY);
+  TASK_END(generator->resume_line);
+}
+
+/******************************************************************************
+   Function: claim_level_chunks
+
+Description: Prepares a level generator's chunks to receive the window of
+             chunks around the level's entrance (the window the player sees on
+             arrival; see "recenter_map_window"). Chunks beyond the map's edges
+             are left solid.
+
+     Inputs: generator - Pointer to the level generator.
+
+    Outputs: None.
+******************************************************************************/
+void claim_level_chunks(level_generator_t *const generator) {
+  int8_t i;
+  GPoint chunk_position;
+  resident_chunk_t *resident_chunk;
+
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE * RESIDENT_CHUNKS_WIDE; ++i) {
+    chunk_position =
+      GPoint(CHUNK_COORDINATE(generator->entrance.x) - 1 +
+               i % RESIDENT_CHUNKS_WIDE,
+             CHUNK_COORDINATE(generator->entrance.y) - 1 +
+               i / RESIDENT_CHUNKS_WIDE);
+    resident_chunk =
+      &generator->chunks[RESIDENT_CHUNK_SLOT(chunk_position.y)]
+                        [RESIDENT_CHUNK_SLOT(chunk_position.x)];
+    clear_map_chunk(&resident_chunk->chunk);
+    resident_chunk->position = chunk_position;
+    resident_chunk->generating =
+      (uint16_t) chunk_position.x < MAP_CHUNKS_WIDE &&
+      (uint16_t) chunk_position.y < MAP_CHUNKS_WIDE;
+  }
+}
+
+/******************************************************************************
+   Function: carve_level_room
+
+Description: Carves a square room of EMPTY cells (see "carve_level_cell").
+
+     Inputs: generator - Pointer to the level generator.
+             center    - Coordinates of the room's central cell.
+             radius    - Number of cells between the center and each wall.
+
+    Outputs: None.
+******************************************************************************/
+void carve_level_room(level_generator_t *const generator,
+                      const GPoint center,
+                      const int8_t radius) {
+  int8_t i, j;
+
+  for (i = -radius; i <= radius; ++i) {
+    for (j = -radius; j <= radius; ++j) {
+      carve_level_cell(generator, GPoint(center.x + i, center.y + j), EMPTY);
+    }
+  }
+}
+
+/******************************************************************************
+   Function: carve_level_corridor
+
+Description: Carves an L-shaped corridor of EMPTY cells between two cells (see
+             "carve_level_cell").
+
+     Inputs: generator      - Pointer to the level generator.
+             from           - Coordinates of the first cell.
+             to             - Coordinates of the second cell.
+             vertical_first - If "true", the corridor runs north/south before
+                              turning east/west.
+
+    Outputs: None.
+******************************************************************************/
+void carve_level_corridor(level_generator_t *const generator,
+                          GPoint from,
+                          const GPoint to,
+                          const bool vertical_first) {
+  carve_level_cell(generator, from, EMPTY);
+  while (!POINTS_EQUAL(from, to)) {
+    if (from.x == to.x || (vertical_first && from.y != to.y)) {
+      from.y += from.y < to.y ? 1 : -1;
+    } else {
+      from.x += from.x < to.x ? 1 : -1;
+    }
+    carve_level_cell(generator, from, EMPTY);
+  }
+}
+
+/******************************************************************************
+   Function: carve_level_cell
+
+Description: Sets a given cell to a given type if its chunk is one of the
+             generator's and is waiting to be carved (and otherwise does
+             nothing), noting the cell in the generator's "open_rows" if any.
+
+     Inputs: generator - Pointer to the level generator.
+             cell      - Coordinates of the cell of interest.
+             type      - The cell type to be assigned at those coordinates.
+
+    Outputs: None.
+******************************************************************************/
+void carve_level_cell(level_generator_t *const generator,
+                      const GPoint cell,
+                      const int8_t type) {
+  const GPoint chunk_position = GPoint(CHUNK_COORDINATE(cell.x),
+                                       CHUNK_COORDINATE(cell.y));
+  resident_chunk_t *const resident_chunk =
+    &generator->chunks[RESIDENT_CHUNK_SLOT(chunk_position.y)]
+                      [RESIDENT_CHUNK_SLOT(chunk_position.x)];
+
+  if (generator->open_rows) {
+    generator->open_rows[cell.y] |= (uint64_t) 1 << cell.x;
+  }
+  if (resident_chunk->generating &&
+      POINTS_EQUAL(resident_chunk->position, chunk_position)) {
+    set_chunk_cell_type(&resident_chunk->chunk, cell, type);
+  }
+}
+
+/******************************************************************************
+   Function: get_level_seed
+
+Description: Returns the seed of the location at a given depth, derived from
+             a given run seed. (A level a player reports can be regenerated
+             from just these two numbers.)
+
+     Inputs: run_seed - The player's run seed.
+             depth    - Depth of the location of interest.
+
+    Outputs: The location's 32-bit seed.
+******************************************************************************/
+uint32_t get_level_seed(const uint32_t run_seed, const int8_t depth) {
+  return get_hash(run_seed + depth * 0x9E3779B9);
+}
+
+/******************************************************************************
+   Function: get_hash
+
+Description: Scrambles a given 32-bit value, using Murmur3's finalizer (which
+             mixes every input bit into every output bit).
+
+     Inputs: hash - The value to be scrambled.
+
+    Outputs: A pseudorandom 32-bit value.
+******************************************************************************/
+uint32_t get_hash(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6B;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+/******************************************************************************
+   Function: get_seeded_random
+
+Description: Advances a given xorshift random number generator state. (Map
+             generation can't use "rand", since a location must come out the
+             same way however often its chunks are regenerated.)
+
+     Inputs: state - Pointer to the generator's state.
+
+    Outputs: The next pseudorandom 32-bit value.
+******************************************************************************/
+uint32_t get_seeded_random(uint32_t *const state) {
+  if (*state == 0) {
+    *state = 1;
+  }
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+
+  return *state;
+}
+
+/******************************************************************************
+   Function: get_checksum
+
+Description: Adds a given block of data to a running FNV-1a checksum (which
+             starts at CHECKSUM_BASIS).
+
+     Inputs: data     - Pointer to the data.
+             size     - Size of the data, in bytes.
+             checksum - The checksum so far.
+
+    Outputs: The updated checksum.
+******************************************************************************/
+uint32_t get_checksum(const void *const data,
+                      const uint16_t size,
+                      uint32_t checksum) {
+  uint16_t i;
+
+  for (i = 0; i < size; ++i) {
+    checksum = (checksum ^ ((const uint8_t *) data)[i]) * 16777619u;
+  }
+
+  return checksum;
+}
+
+/******************************************************************************
+   Function: level_is_pregenerated
+
+Description: Determines whether the level at a given depth of a given run is
+             already in persistent storage.
+
+     Inputs: run_seed - The player's run seed.
+             depth    - Depth of the level of interest.
+
+    Outputs: "True" if the level has been pregenerated.
+******************************************************************************/
+bool level_is_pregenerated(const uint32_t run_seed, const int8_t depth) {
+  pregenerated_level_t level;
+
+  return persist_read_data(PREGENERATED_LEVEL_KEY(depth),
+                           &level,
+                           sizeof(level)) == sizeof(level) &&
+         level.depth == depth &&
+         level.seed == get_level_seed(run_seed, depth);
+}
@@ -0,0 +1,222 @@
+/******************************************************************************
+   Filename: level_generation.h
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: Header file for PebbleQuest's level generator, which is shared by
+             the app and its background worker (see "pebble_quest_worker.c").
+             The includer must include <pebble.h> or <pebble_worker.h> first.
+******************************************************************************/
+
+#ifndef LEVEL_GENERATION_H_
+#define LEVEL_GENERATION_H_
+
+/******************************************************************************
+  Enumerations
+******************************************************************************/
+
+// Item types:
+enum {
+  NONE = -1,
+  PEBBLE_OF_THUNDER,
+  PEBBLE_OF_FIRE,
+  PEBBLE_OF_ICE,
+  PEBBLE_OF_LIFE,
+  PEBBLE_OF_LIGHT,
+  PEBBLE_OF_SHADOW,
+  PEBBLE_OF_DEATH,
+  DAGGER,
+  STAFF,
+  SWORD,
+  MACE,
+  AXE,
+  FLAIL,
+  SHIELD,
+  ROBE,
+  LIGHT_ARMOR,
+  HEAVY_ARMOR,
+  NUM_ITEM_TYPES
+};
+
+// Cell types (for loot, an item type value is used; see also
+// "g_cell_attributes"):
+enum {
+  KEY = -8,
+  LOCKED_GATE,
+  DOOR,
+  OPEN_DOOR,
+  TRAP,
+  SOLID,
+  EMPTY,
+  EXIT
+};
+
+// Directions:
+enum {
+  NORTH,
+  SOUTH,
+  EAST,
+  WEST,
+  NUM_DIRECTIONS
+};
+
+// Messages between the app and its worker:
+enum {
+  PREGENERATE_LEVELS_MESSAGE,  // Run seed (low, high 16 bits) and depth.
+  WORKER_STARTED_MESSAGE,
+  LEVELS_PREGENERATED_MESSAGE  // Echoes the request once it's done.
+};
+
+/******************************************************************************
+  Other Constants
+******************************************************************************/
+
+#define CHUNK_SIZE                       16  // Cells per map chunk side (a power of two).
+#ifndef MAP_CHUNKS_WIDE
+#define MAP_CHUNKS_WIDE                  4  // At most 16 (see "MAP_CELL_INDEX").
+#endif
+#define NUM_MAP_CHUNKS                   (MAP_CHUNKS_WIDE * MAP_CHUNKS_WIDE)
+#define MAP_WIDTH                        (MAP_CHUNKS_WIDE * CHUNK_SIZE)
+#define MAP_HEIGHT                       MAP_WIDTH
+#define NUM_LEVEL_ROOMS                  (MAP_CHUNKS_WIDE * 3)
+#define MIN_LEVEL_ROOM_RADIUS            1  // Rooms are at least 3x3 (so corridors can pass an exit).
+#define MAX_LEVEL_ROOM_RADIUS            4
+#define NUM_LEVEL_LOOPS                  (NUM_LEVEL_ROOMS / 3)  // Extra corridors between random rooms.
+#define NUM_LEVEL_DEAD_ENDS              (NUM_LEVEL_ROOMS / 2)
+#define MIN_DEAD_END_LENGTH              2
+#define MAX_DEAD_END_LENGTH              8
+#define DEAD_END_DOOR_ODDS               2  // One in N dead ends (other than the locked one) has a door...
+#define DEAD_END_TRAP_ODDS               3  // ...and one in N has a pressure trap just inside.
+#define MIN_LEVEL_LOOT                   6  // Loot items per location...
+#define LEVEL_LOOT_DEPTH_INTERVAL        8  // ...plus one more every N levels of depth...
+#define MAX_LEVEL_LOOT                   (NUM_LEVEL_DEAD_ENDS * 3)  // ...up to this many.
+#define NUM_BACKGROUND_COLOR_SCHEMES     8
+#define TASK_BEGIN(line)                 switch (line) { case 0:  // Starts a resumable, protothread-style function.
+#define TASK_YIELD(line)                 do { (line) = __LINE__; return false; case __LINE__:; } while (0)  // Resumes here (locals are lost; not within a "switch").
+#define TASK_END(line)                   } (line) = 0; return true  // Finishes (the next call starts over).
+#define CHUNK_OFFSET(n)                  ((n) & (CHUNK_SIZE - 1))  // Cell coordinate within its chunk.
+#define CHUNK_COORDINATE(n)              (((n) - CHUNK_OFFSET(n)) / CHUNK_SIZE)  // Rounds down.
+#define CHUNK_CELL_INDEX(cell)           (CHUNK_OFFSET((cell).y) * CHUNK_SIZE + CHUNK_OFFSET((cell).x))
+#define SOLID_MAP_ROW                    ((map_row_t) ~0)
+#define MAX_SPECIAL_CELLS                24  // Exits, doors, loot, etc. per chunk.
+#define FIRST_CELL_TYPE                  KEY
+#define POINTS_EQUAL(a, b)               ((a).x == (b).x && (a).y == (b).y)  // (Workers lack "gpoint_equal".)
+#define UNLOADED_CHUNK                   GPoint(INT16_MIN, INT16_MIN)
+#define RESIDENT_CHUNKS_WIDE             3  // The player's chunk and its neighbors stay in memory.
+#define RESIDENT_CHUNK_SLOT(n)           (((n) % RESIDENT_CHUNKS_WIDE + RESIDENT_CHUNKS_WIDE) % RESIDENT_CHUNKS_WIDE)
+#define NUM_PEBBLE_TYPES                 (PEBBLE_OF_DEATH + 1)
+#define NUM_HEAVY_ITEM_TYPES             (NUM_ITEM_TYPES - NUM_PEBBLE_TYPES)
+#define FIRST_HEAVY_ITEM                 DAGGER
+#define MAX_DEPTH                        100
+#define NUM_PREGENERATED_LEVELS          1  // Levels the worker keeps ready (each takes PREGENERATED_LEVEL_KEYS keys).
+#define PREGENERATED_LEVEL_KEYS          (1 + RESIDENT_CHUNKS_WIDE)  // A header, then a row of chunks per key.
+#define PREGENERATED_LEVEL_STORAGE_KEY   870
+#define PREGENERATED_LEVEL_KEY(depth)    (PREGENERATED_LEVEL_STORAGE_KEY + (depth) % NUM_PREGENERATED_LEVELS * PREGENERATED_LEVEL_KEYS)
+#define CHECKSUM_BASIS                   2166136261u  // See "get_checksum".
+
+/******************************************************************************
+  Structure Definitions
+******************************************************************************/
+
+// One row of a map chunk's solidity bitset (bit "x" is set if cell "x" is
+// solid):
+typedef uint16_t map_row_t;
+
+// A cell that's neither SOLID nor EMPTY (e.g., an exit, a door, or loot):
+typedef struct SpecialCell {
+  uint8_t cell;  // See "CHUNK_CELL_INDEX".
+  int8_t type;
+} __attribute__((__packed__)) special_cell_t;
+
+// A CHUNK_SIZE x CHUNK_SIZE block of a location's map, regenerated whenever
+// it's loaded:
+typedef struct MapChunk {
+  map_row_t solid_rows[CHUNK_SIZE];
+  uint8_t num_special_cells;
+  special_cell_t special_cells[MAX_SPECIAL_CELLS];  // Sorted by cell index.
+} __attribute__((__packed__)) map_chunk_t;
+
+typedef struct ResidentChunk {
+  map_chunk_t chunk;
+  GPoint position;  // Chunk coordinates (or UNLOADED_CHUNK).
+  bool generating;  // Waiting to be carved by "run_level_generator".
+} __attribute__((__packed__)) resident_chunk_t;
+
+// A level being generated by "run_level_generator", which picks up where it
+// left off each time it's called (so the work can be spread over several
+// slices). Its layout is chosen up front by "init_level_generator":
+typedef struct LevelGenerator {
+  uint16_t resume_line;  // See "TASK_BEGIN".
+  uint32_t seed,
+           state;  // See "get_seeded_random".
+  int8_t depth,
+         direction,  // The player's direction on entering the level.
+         floor_color_scheme,
+         wall_color_scheme,
+         num_loot,
+         i;  // Index of the room, corridor, etc. being carved.
+  GPoint entrance,
+         exit,
+         room_centers[NUM_LEVEL_ROOMS],
+         dead_ends[NUM_LEVEL_DEAD_ENDS],
+         doorways[NUM_LEVEL_DEAD_ENDS];  // Just outside each dead end's room
+                                         // (or the dead end itself, if short).
+  int8_t room_radii[NUM_LEVEL_ROOMS];
+  resident_chunk_t (*chunks)[RESIDENT_CHUNKS_WIDE];  // Where cells are carved.
+  uint64_t *open_rows;  // If not NULL, a bit is set here for every cell
+                        // carved, in or out of "chunks" (MAP_WIDTH <= 64).
+} level_generator_t;
+
+// The header of a level pregenerated by the worker (its chunks, around the
+// entrance, are saved a row at a time under the keys that follow):
+typedef struct PregeneratedLevel {
+  uint32_t seed,
+           checksum;  // Of the chunks, in order (see "get_checksum").
+  int8_t depth,
+         direction,
+         floor_color_scheme,
+         wall_color_scheme;
+  GPoint entrance,
+         exit;
+} __attribute__((__packed__)) pregenerated_level_t;
+
+/******************************************************************************
+  Function Declarations
+******************************************************************************/
+
+GPoint get_cell_farther_away(const GPoint reference_point,
+                             const int8_t direction,
+                             const int8_t distance);
+int8_t get_opposite_direction(const int8_t direction);
+void set_chunk_cell_type(map_chunk_t *const chunk,
+                         const GPoint cell,
+                         const int8_t type);
+uint8_t find_special_cell(const map_chunk_t *const chunk,
+                          const uint8_t cell_index);
+void clear_map_chunk(map_chunk_t *const chunk);
+void init_level_generator(level_generator_t *const generator,
+                          const uint32_t seed,
+                          const int8_t depth,
+                          resident_chunk_t (*const chunks)
+                            [RESIDENT_CHUNKS_WIDE]);
+bool run_level_generator(level_generator_t *const generator);
+void claim_level_chunks(level_generator_t *const generator);
+void carve_level_room(level_generator_t *const generator,
+                      const GPoint center,
+                      const int8_t radius);
+void carve_level_corridor(level_generator_t *const generator,
+                          GPoint from,
+                          const GPoint to,
+                          const bool vertical_first);
+void carve_level_cell(level_generator_t *const generator,
+                      const GPoint cell,
+                      const int8_t type);
+uint32_t get_level_seed(const uint32_t run_seed, const int8_t depth);
+uint32_t get_hash(uint32_t hash);
+uint32_t get_seeded_random(uint32_t *const state);
+uint32_t get_checksum(const void *const data,
+                      const uint16_t size,
+                      uint32_t checksum);
+bool level_is_pregenerated(const uint32_t run_seed, const int8_t depth);
+
+#endif  // LEVEL_GENERATION_H_
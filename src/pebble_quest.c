@@ -39,9 +39,10 @@ int8_t set_player_direction(const int8_t new_direction) {
    Function: move_player
 
 Description: Attempts to move the player one cell forward (or backward) in a
-             given direction. If loot is present in that cell, the player does
-             not move but is instead shown the loot menu. Moving onto an exit
-             will take the player to a new location.
+             given direction, animating the step. Stepping into an interactive
+             cell (loot, a door, an exit, etc.) uses it instead (see
+             "use_cell"), and moving back onto the entrance, below the first
+             level, will take the player back up (see "cache_level").
 
      Inputs: direction - Desired direction of movement.
 
@@ -49,47 +50,172 @@ Description: Attempts to move the player one cell forward (or backward) in a
 ******************************************************************************/
 bool move_player(const int8_t direction) {
   GPoint destination = get_cell_farther_away(g_player->position, direction, 1);
+  const int8_t type = get_cell_type(destination);
 
-  if (occupiable(destination)) {
-    // Check for loot:
-    if (get_cell_type(destination) >= 0) {
-      g_current_selection = get_cell_type(destination);
-      show_window(LOOT_MENU, NOT_ANIMATED);
-      set_cell_type(destination, EMPTY);
+  // Check for loot, doors, exits, etc. (blocked by any NPC present):
+  if (CELL_ATTRIBUTES(type) & INTERACTIVE) {
+    if (get_npc_at(destination) > NONE ||
+        !use_cell(destination, type)) {
+      return false;
+    }
+  } else if (!occupiable(destination)) {
+    return false;
+
+  // Check for stairs up (the entrance, below the first level):
+  } else if (gpoint_equal(&destination, &g_location->entrance) &&
+             g_player->int8_stats[DEPTH] > 1) {
+    cache_level();
+    init_location(g_player->int8_stats[DEPTH] - 1);
+  } else {
+    step_player(destination);
+    start_movement_animation(direction == g_player->direction ?
+                               STEP_FORWARD_ANIMATION :
+                               STEP_BACKWARD_ANIMATION);
+  }
+  post_event(SCENE_CHANGED_EVENT, 0);
 
-    // Check for an exit:
-    } else if (get_cell_type(destination) == EXIT) {
-      init_location();
+  return true;
+}
 
-    // Shift the player's position:
-    } else {
-      g_player->position = destination;
-    }
+/******************************************************************************
+   Function: step_player
 
-    layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+Description: Shifts the player's position to a given (adjacent) cell,
+             recentering the resident window on entering a new chunk. (The
+             next level is generated in the background once the exit is near;
+             see "pregenerate_next_level".)
+
+     Inputs: destination - Coordinates of the player's new cell.
+
+    Outputs: None.
+******************************************************************************/
+void step_player(const GPoint destination) {
+  g_player->position = destination;
+  if (CHUNK_COORDINATE(destination.x) != g_window_chunk.x + 1 ||
+      CHUNK_COORDINATE(destination.y) != g_window_chunk.y + 1) {
+    recenter_map_window();
+  }
+  if (!g_location->endless &&
+      abs(destination.x - g_location->exit.x) +
+        abs(destination.y - g_location->exit.y) <= NEXT_LEVEL_LOOKAHEAD) {
+    pregenerate_next_level();
+  }
+}
+
+/******************************************************************************
+   Function: start_movement_animation
+
+Description: Starts animating a step or turn the player has just made. The
+             move itself is already done: for a few frames, the scene is drawn
+             from views partway between where the player was and is (see
+             "select_view"). Any animation already underway is cut short.
+
+     Inputs: animation - Type of step or turn.
+
+    Outputs: None.
+******************************************************************************/
+void start_movement_animation(const int8_t animation) {
+  stop_movement_animation();
+  g_movement_animation = animation;
+  g_movement_start_time = get_current_time_ms();
+  g_movement_timer = app_timer_register(MOVEMENT_FRAME_DURATION,
+                                        movement_timer_callback,
+                                        NULL);
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+}
+
+/******************************************************************************
+   Function: stop_movement_animation
+
+Description: Ends any step or turn animation, so the scene is drawn at rest.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void stop_movement_animation(void) {
+  if (g_movement_timer) {
+    app_timer_cancel(g_movement_timer);
+    g_movement_timer = NULL;
+  }
+  g_movement_animation = NONE;
+}
+
+/******************************************************************************
+   Function: use_cell
+
+Description: Uses the interactive cell the player is stepping into: loot is
+             picked up (via the loot menu), keys are pocketed, doors open,
+             locked gates open if the player has a key, pressure traps are
+             sprung (once), and exits lead to a new location. (If the
+             location's map change list is full, loot and keys are stepped
+             over instead, since taking them couldn't be recorded and they'd
+             reappear once their chunk is regenerated.)
+
+     Inputs: cell - Coordinates of the cell of interest.
+             type - The cell's type.
+
+    Outputs: "True" if the cell was used (i.e., the player's turn is spent).
+******************************************************************************/
+bool use_cell(const GPoint cell, const int8_t type) {
+  if ((CELL_ATTRIBUTES(type) & PICKED_UP) &&
+      !map_change_is_recordable(cell)) {
+    step_player(cell);
 
     return true;
   }
+  switch (type) {
+    case KEY:
+      g_player->num_keys++;
+      set_cell_type(cell, EMPTY);
+      break;
+    case LOCKED_GATE:
+      if (g_player->num_keys == 0) {
+        return false;
+      }
+      g_player->num_keys--;
+      set_cell_type(cell, OPEN_DOOR);
+      break;
+    case DOOR:
+      set_cell_type(cell, OPEN_DOOR);
+      break;
+    case TRAP:
+      set_cell_type(cell, EMPTY);
+      step_player(cell);
+      damage_player(TRAP_DAMAGE);
+      break;
+    case EXIT:
+      cache_level();
+      init_location(g_player->int8_stats[DEPTH] + 1);
+      break;
+    default:  // Loot!
+      post_event(LOOT_FOUND_EVENT, type);
+      set_cell_type(cell, EMPTY);
+      break;
+  }
 
-  return false;
+  return true;
 }
 
 /******************************************************************************
    Function: move_npc
 
 Description: Attempts to move a given NPC one cell forward in a given
-             direction.
+             direction. (A direction of NONE leaves the NPC in place.)
 
-     Inputs: npc       - Pointer to the NPC to be moved.
+     Inputs: npc       - Index of the NPC to be moved.
              direction - Desired direction of movement.
 
     Outputs: None.
 ******************************************************************************/
-void move_npc(npc_t *const npc, const int8_t direction) {
-  GPoint destination = get_cell_farther_away(npc->position, direction, 1);
-
-  if (occupiable(destination) && get_cell_type(destination) != EXIT) {
-    npc->position = destination;
+void move_npc(const int8_t npc, const int8_t direction) {
+  GPoint destination = get_cell_farther_away(g_npcs->positions[npc],
+                                             direction,
+                                             1);
+
+  if (direction > NONE && occupiable(destination) && traversable(destination)) {
+    set_npc_position(npc, destination);
+    g_npcs->arrival_directions[npc] = get_opposite_direction(direction);
   }
 }
 
@@ -97,8 +223,8 @@ void move_npc(npc_t *const npc, const int8_t direction) {
    Function: damage_player
 
 Description: Damages the player according to a given damage value (or one more
-             than the player's health recovery rate if the value's too low) and
-             vibrates the watch.
+             than the player's health recovery rate if the value's too low). (A
+             "player damaged" event is posted, which vibrates the watch.)
 
      Inputs: damage - Potential amount of damage.
 
@@ -110,8 +236,8 @@ int8_t damage_player(int8_t damage) {
   if (damage < min_damage) {
     damage = min_damage;
   }
-  vibes_short_pulse();
   adjust_player_current_health(damage * -1);
+  post_event(PLAYER_DAMAGED_EVENT, damage);
 
   return damage;
 }
@@ -124,44 +250,50 @@ Description: Damages a given NPC according to a given damage value (or
              NPC's health to zero or below, the NPC's death is handled, the
              player gains experience points, and a "level up" check is made.
 
-     Inputs: npc    - Pointer to the NPC to be damaged.
+     Inputs: npc    - Index of the NPC to be damaged.
              damage - Potential amount of damage.
 
     Outputs: The amount of damage actually dealt.
 ******************************************************************************/
-int8_t damage_npc(npc_t *const npc, int8_t damage) {
+int8_t damage_npc(const int8_t npc, int8_t damage) {
   if (damage < MIN_DAMAGE_TO_NPC) {
     damage = MIN_DAMAGE_TO_NPC;
   }
-  npc->health -= damage;
+  g_npcs->health[npc] -= damage;
+  post_event(NPC_DAMAGED_EVENT, damage);
 
   // Check for NPC death:
-  if (npc->health <= 0 || npc->status_effects[DISINTEGRATION]) {
-    // Drop loot, if any (extra checks prevent overwriting of Pebbles/exits):
-    if (npc->type == MAGE ||
-        (npc->item > NONE && get_cell_type(npc->position) < EXIT)) {
-      set_cell_type(npc->position, npc->item);
+  if (g_npcs->health[npc] <= 0 ||
+      g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(DISINTEGRATION)) {
+    // Drop loot, if any (extra checks prevent overwriting of Pebbles, open
+    // doors, etc.):
+    if (g_npc_archetypes[g_npcs->types[npc]].loot_policy == PEBBLE_LOOT ||
+        (g_npcs->items[npc] > NONE &&
+         get_cell_type(g_npcs->positions[npc]) == EMPTY)) {
+      set_cell_type(g_npcs->positions[npc], g_npcs->items[npc]);
     }
 
     // Check for "game completion" (death of the final mage):
-    if (g_player->int8_stats[DEPTH] == MAX_DEPTH && npc->type == MAGE) {
-      show_narration(ENDING_NARRATION);
-      npc->type = NONE;
+    if (g_player->int8_stats[DEPTH] == MAX_DEPTH &&
+        g_npcs->types[npc] == MAGE) {
+      post_event(GAME_COMPLETED_EVENT, 0);
+      remove_npc(npc);
 
       return damage;
     }
 
-    // Remove the NPC by merely changing its type:
-    npc->type = NONE;
+    // Remove the NPC (its type and power are still needed below):
+    post_event(NPC_DIED_EVENT, g_npcs->types[npc]);
+    remove_npc(npc);
 
     // Add experience points and check for a "level up":
     if (g_player->int8_stats[LEVEL] < MAX_LEVEL) {
-      g_player->exp_points += npc->power;
+      g_player->exp_points += g_npcs->power[npc];
       if (g_player->exp_points / (6 * g_player->int8_stats[LEVEL]) >=
             g_player->int8_stats[LEVEL]) {
         g_player->int8_stats[LEVEL]++;
-        show_window(LEVEL_UP_MENU, NOT_ANIMATED);
-        show_narration(LEVEL_UP_NARRATION);
+        update_player_stats(STAT_INPUT(LEVEL));
+        post_event(LEVEL_UP_EVENT, g_player->int8_stats[LEVEL]);
       }
     }
   }
@@ -174,33 +306,34 @@ int8_t damage_npc(npc_t *const npc, int8_t damage) {
 
 Description: Applies the effects of a given spell type, according a given max.
              potency, to a given NPC. (Unlike "damage_npc", etc., randomization
-             and the pointer check are both performed here, rather than in the
+             and the NPC check are both performed here, rather than in the
              areas where this function gets called, for memory-saving reasons.)
 
-     Inputs: npc            - Pointer to the targeted NPC.
+     Inputs: npc            - Index of the targeted NPC (or NONE).
              magic_type     - Integer representing the spell's magic type.
              max_potency    - Maximum amount of magical power that may be
                               brought to bear.
 
     Outputs: The amount of damage caused by the spell.
 ******************************************************************************/
-int8_t cast_spell_on_npc(npc_t *const npc,
+int8_t cast_spell_on_npc(const int8_t npc,
                          const int8_t magic_type,
                          const int8_t max_potency) {
   int8_t potency = 0,
          damage = 0,
          spell_resistance;
 
-  if (npc) {
+  // (The NPC may have been killed by a weapon blow.)
+  if (npc > NONE && g_npcs->types[npc] > NONE) {
     // Determine actual spell potency along with the NPC's resistance:
     if (max_potency > 0) {
       potency = rand() % max_potency;
     }
-    spell_resistance = rand() % npc->magical_defense;
+    spell_resistance = rand() % g_npcs->magical_defenses[npc];
 
     // Next, attempt to apply a status effect:
     if (magic_type < PEBBLE_OF_DEATH || potency > spell_resistance) {
-      npc->status_effects[magic_type] += potency;
+      add_status_effect(npc, magic_type, potency);
     }
 
     // Finally, apply damage and check for health absorption:
@@ -213,6 +346,255 @@ int8_t cast_spell_on_npc(npc_t *const npc,
   return damage;
 }
 
+/******************************************************************************
+   Function: get_status_effect
+
+Description: Returns the remaining duration (which doubles as the potency) of a
+             given status effect on a given NPC.
+
+     Inputs: npc    - Index of the NPC of interest.
+             effect - Integer representing the status effect of interest.
+
+    Outputs: Number of status effect intervals remaining (zero if the effect
+             isn't active).
+******************************************************************************/
+uint8_t get_status_effect(const int8_t npc, const int8_t effect) {
+  int8_t i;
+
+  if (g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(effect)) {
+    i = get_status_timer(npc, effect);
+    if (i > NONE) {
+      return get_status_timer_duration(&g_npcs->status_wheel.timers[i]);
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+   Function: add_status_effect
+
+Description: Adds a given amount to the remaining duration of a given status
+             effect on a given NPC, activating the effect if necessary. (If
+             every status timer is in use, the one closest to expiring is
+             taken over by the new effect.)
+
+     Inputs: npc    - Index of the affected NPC.
+             effect - Integer representing the status effect.
+             amount - Number of status effect intervals to be added.
+
+    Outputs: None.
+******************************************************************************/
+void add_status_effect(const int8_t npc,
+                       const int8_t effect,
+                       const int16_t amount) {
+  int8_t i;
+  int16_t duration = amount;
+  status_timer_t *timer;
+
+  if (g_npcs->types[npc] == NONE || amount <= 0) {
+    return;
+  }
+
+  // Extend an active effect or find a free timer for a new one:
+  if (g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(effect)) {
+    i = get_status_timer(npc, effect);
+    duration += get_status_timer_duration(&g_npcs->status_wheel.timers[i]);
+    unschedule_status_timer(i);
+  } else {
+    i = get_status_timer(NONE, NONE);
+    if (i == NONE) {
+      i = evict_status_timer();
+    }
+  }
+  if (duration > MAX_STATUS_EFFECT_DURATION) {
+    duration = MAX_STATUS_EFFECT_DURATION;
+  }
+  timer = &g_npcs->status_wheel.timers[i];
+  timer->npc = npc;
+  timer->effect = effect;
+  schedule_status_timer(i, duration);
+  g_npcs->status_effects[npc] |= STATUS_EFFECT_BIT(effect);
+}
+
+/******************************************************************************
+   Function: clear_status_effects
+
+Description: Removes all status effects from a given NPC, freeing their timers.
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: None.
+******************************************************************************/
+void clear_status_effects(const int8_t npc) {
+  int8_t i;
+
+  if (g_npcs->status_effects[npc]) {
+    for (i = 0; i < MAX_STATUS_TIMERS; ++i) {
+      if (g_npcs->status_wheel.timers[i].npc == npc) {
+        unschedule_status_timer(i);
+        g_npcs->status_wheel.timers[i].npc = NONE;
+      }
+    }
+    g_npcs->status_effects[npc] = 0;
+  }
+}
+
+/******************************************************************************
+   Function: advance_status_wheel
+
+Description: Advances the status effect timer wheel by one slot (i.e., one
+             status effect interval), expiring any effects that have run out.
+             Only the timers in the new slot are visited, so the cost doesn't
+             depend on the number of NPCs.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void advance_status_wheel(void) {
+  int8_t i, next, previous = NONE;
+  status_timer_t *timer;
+
+  g_npcs->status_wheel.position = (g_npcs->status_wheel.position + 1) %
+                                    STATUS_WHEEL_SIZE;
+  for (i = g_npcs->status_wheel.slots[g_npcs->status_wheel.position];
+       i > NONE;
+       i = next) {
+    timer = &g_npcs->status_wheel.timers[i];
+    next = timer->next;
+    if (timer->rounds > 0) {
+      timer->rounds--;
+      previous = i;
+    } else {
+      if (previous == NONE) {
+        g_npcs->status_wheel.slots[timer->slot] = next;
+      } else {
+        g_npcs->status_wheel.timers[previous].next = next;
+      }
+      g_npcs->status_effects[timer->npc] &= ~STATUS_EFFECT_BIT(timer->effect);
+      timer->npc = NONE;
+    }
+  }
+}
+
+/******************************************************************************
+   Function: schedule_status_timer
+
+Description: Places a given status timer into the wheel slot where it will
+             expire after a given number of status effect intervals.
+
+     Inputs: timer_index - Index of the timer in "status_timers".
+             duration    - Number of intervals until expiry (at least one).
+
+    Outputs: None.
+******************************************************************************/
+void schedule_status_timer(const int8_t timer_index, const int16_t duration) {
+  status_timer_t *timer = &g_npcs->status_wheel.timers[timer_index];
+  int8_t first_visit = duration % STATUS_WHEEL_SIZE;
+
+  if (first_visit == 0) {
+    first_visit = STATUS_WHEEL_SIZE;
+  }
+  timer->slot = (g_npcs->status_wheel.position + first_visit) %
+                  STATUS_WHEEL_SIZE;
+  timer->rounds = (duration - first_visit) / STATUS_WHEEL_SIZE;
+  timer->next = g_npcs->status_wheel.slots[timer->slot];
+  g_npcs->status_wheel.slots[timer->slot] = timer_index;
+}
+
+/******************************************************************************
+   Function: unschedule_status_timer
+
+Description: Removes a given status timer from its wheel slot. (The timer's
+             NPC index is left unchanged.)
+
+     Inputs: timer_index - Index of the timer in "status_timers".
+
+    Outputs: None.
+******************************************************************************/
+void unschedule_status_timer(const int8_t timer_index) {
+  status_timer_t *timer = &g_npcs->status_wheel.timers[timer_index];
+  int8_t *link = &g_npcs->status_wheel.slots[timer->slot];
+
+  while (*link != timer_index) {
+    link = &g_npcs->status_wheel.timers[*link].next;
+  }
+  *link = timer->next;
+}
+
+/******************************************************************************
+   Function: get_status_timer
+
+Description: Returns the index of the status timer for a given NPC and status
+             effect. (Passing NONE for both finds a free timer.)
+
+     Inputs: npc_index - Index of the NPC of interest (or NONE).
+             effect    - Integer representing the status effect (or NONE).
+
+    Outputs: Index of the matching timer, or NONE if there is none.
+******************************************************************************/
+int8_t get_status_timer(const int8_t npc_index, const int8_t effect) {
+  int8_t i;
+  status_timer_t *timer;
+
+  for (i = 0; i < MAX_STATUS_TIMERS; ++i) {
+    timer = &g_npcs->status_wheel.timers[i];
+    if (timer->npc == npc_index &&
+        (npc_index == NONE || timer->effect == effect)) {
+      return i;
+    }
+  }
+
+  return NONE;
+}
+
+/******************************************************************************
+   Function: evict_status_timer
+
+Description: Frees the status timer closest to expiring, ending its effect
+             early, so that a new effect can always be applied.
+
+     Inputs: None.
+
+    Outputs: Index of the freed timer.
+******************************************************************************/
+int8_t evict_status_timer(void) {
+  int8_t i, soonest = 0;
+  int16_t duration, min_duration = MAX_STATUS_EFFECT_DURATION + 1;
+  status_timer_t *timer;
+
+  for (i = 0; i < MAX_STATUS_TIMERS; ++i) {
+    duration = get_status_timer_duration(&g_npcs->status_wheel.timers[i]);
+    if (duration < min_duration) {
+      min_duration = duration;
+      soonest = i;
+    }
+  }
+  timer = &g_npcs->status_wheel.timers[soonest];
+  unschedule_status_timer(soonest);
+  g_npcs->status_effects[timer->npc] &= ~STATUS_EFFECT_BIT(timer->effect);
+  timer->npc = NONE;
+
+  return soonest;
+}
+
+/******************************************************************************
+   Function: get_status_timer_duration
+
+Description: Returns the number of status effect intervals remaining before a
+             given (scheduled) status timer expires.
+
+     Inputs: timer - Pointer to the status timer of interest.
+
+    Outputs: Number of intervals remaining.
+******************************************************************************/
+int16_t get_status_timer_duration(const status_timer_t *const timer) {
+  return timer->rounds * STATUS_WHEEL_SIZE +
+         (timer->slot + STATUS_WHEEL_SIZE -
+            g_npcs->status_wheel.position - 1) % STATUS_WHEEL_SIZE + 1;
+}
+
 /******************************************************************************
    Function: adjust_player_current_health
 
@@ -268,117 +650,290 @@ Description: Initializes a new NPC of a given type at a given position (unless
     Outputs: "True" if a new NPC is successfully added.
 ******************************************************************************/
 bool add_new_npc(const int8_t npc_type, const GPoint position) {
-  int8_t i;
-  npc_t *npc;
+  return occupiable(position) &&
+         traversable(position) &&
+         spawn_npc(npc_type, position) > NONE;
+}
+
+/******************************************************************************
+   Function: spawn_npc
+
+Description: Takes an unused NPC from the NPC pool's free list, adds it to the
+             list of living NPCs, and initializes it according to a given type
+             and position (without checking whether the position is
+             occupiable).
+
+     Inputs: npc_type - Desired type for the new NPC.
+             position - Desired spawn point for the new NPC.
+
+    Outputs: Index of the new NPC, or NONE if the NPC pool is full.
+******************************************************************************/
+int8_t spawn_npc(const int8_t npc_type, const GPoint position) {
+  int8_t npc;
+
+  if (g_npcs->num_free_npcs == 0) {
+    return NONE;
+  }
+  npc = g_npcs->free_npcs[--g_npcs->num_free_npcs];
+  g_npcs->live_npc_slots[npc] = g_npcs->num_live_npcs;
+  g_npcs->live_npcs[g_npcs->num_live_npcs++] = npc;
+  init_npc(npc, npc_type, position);
+  g_npcs->pending_damage[npc] = 0;
+  g_npcs->arrival_directions[npc] = NONE;
+  put_npc_to_sleep(npc);
+  if (npc_is_near_player(npc)) {
+    wake_npc(npc);
+  }
+
+  return npc;
+}
+
+/******************************************************************************
+   Function: get_flow_field_direction
+
+Description: Determines in which direction an NPC at a given position ought to
+             move in order to pursue (or flee from) the player, according to
+             the flow field's distances. (The field is updated first if it's
+             out of date.)
 
-  if (occupiable(position) && get_cell_type(position) != EXIT) {
-    for (i = 0; i < MAX_NPCS_AT_ONE_TIME; ++i) {
-      npc = &g_location->npcs[i];
-      if (npc->type == NONE) {
-        init_npc(npc, npc_type, position);
+     Inputs: position - Position of the NPC.
+             fleeing  - If "true", the NPC moves away from the player.
+
+    Outputs: Integer representing the direction in which the NPC ought to move,
+             or NONE if no unoccupied neighboring cell brings it any closer to
+             (or farther from) the player.
+******************************************************************************/
+int8_t get_flow_field_direction(const GPoint position, const bool fleeing) {
+  int8_t direction, best_direction = NONE;
+  int16_t distance, best_distance = FLOW_FIELD_UNREACHABLE;
+  GPoint neighbor;
+
+  if (!flow_field_is_current()) {
+    update_flow_field();
+  }
+  if (traversable(position)) {
+    best_distance = g_flow_field[WINDOW_X(position)][WINDOW_Y(position)];
+  }
 
-        return true;
+  // An NPC fleeing from an untraversable cell (e.g., a mage on the exit) may
+  // step onto any reachable neighbor:
+  if (fleeing && best_distance == FLOW_FIELD_UNREACHABLE) {
+    best_distance = INT16_MIN;
+  }
+  for (direction = 0; direction < NUM_DIRECTIONS; ++direction) {
+    neighbor = get_cell_farther_away(position, direction, 1);
+    if (traversable(neighbor) && occupiable(neighbor)) {
+      distance = g_flow_field[WINDOW_X(neighbor)][WINDOW_Y(neighbor)];
+      if (fleeing ? distance > best_distance &&
+                      distance != FLOW_FIELD_UNREACHABLE :
+                    distance < best_distance) {
+        best_distance = distance;
+        best_direction = direction;
       }
     }
   }
 
-  return false;
+  return best_direction;
+}
+
+/******************************************************************************
+   Function: flow_field_is_current
+
+Description: Determines whether the flow field still reflects the current map
+             and player position.
+
+     Inputs: None.
+
+    Outputs: "True" if the flow field needn't be updated.
+******************************************************************************/
+bool flow_field_is_current(void) {
+  return !g_flow_field_is_stale &&
+         gpoint_equal(&g_flow_field_origin, &g_player->position);
 }
 
 /******************************************************************************
-   Function: get_cell_farther_away
+   Function: update_flow_field
 
-Description: Given a set of cell coordinates, returns new cell coordinates a
-             given distance farther away in a given direction. (These may lie
-             out-of-bounds.)
+Description: Brings the flow field up to date after the player has moved. No
+             cell's distance can grow by more than the player's distance from
+             the field's old origin, so every distance is raised by that much
+             (via the field's offset, without visiting any cells), and then
+             only the cells that are now closer to the player are lowered.
+             (The field is rebuilt if the map has changed, the player isn't
+             reachable from the old origin, or the offset has grown too big.)
 
-     Inputs: reference_point - Reference cell coordinates.
-             direction       - Direction of interest.
-             distance        - How far back we want to go.
+     Inputs: None.
 
-    Outputs: Cell coordinates a given distance farther away from those passed
-             in. (These may lie out-of-bounds.)
+    Outputs: None.
 ******************************************************************************/
-GPoint get_cell_farther_away(const GPoint reference_point,
-                             const int8_t direction,
-                             const int8_t distance) {
-  switch (direction) {
-    case NORTH:
-      return GPoint(reference_point.x, reference_point.y - distance);
-    case SOUTH:
-      return GPoint(reference_point.x, reference_point.y + distance);
-    case EAST:
-      return GPoint(reference_point.x + distance, reference_point.y);
-    default:  // case WEST:
-      return GPoint(reference_point.x - distance, reference_point.y);
+void update_flow_field(void) {
+  int16_t distance = FLOW_FIELD_UNREACHABLE;
+
+  if (!g_flow_field_is_stale &&
+      cell_is_in_window(g_flow_field_origin) &&
+      cell_is_in_window(g_player->position)) {
+    distance = g_flow_field[WINDOW_X(g_player->position)]
+                           [WINDOW_Y(g_player->position)];
+    if (distance != FLOW_FIELD_UNREACHABLE) {
+      distance += g_flow_field_offset;  // Entries are relative to the offset.
+    }
+  }
+  if (distance == FLOW_FIELD_UNREACHABLE ||
+      g_flow_field_offset + distance > MAX_FLOW_FIELD_OFFSET) {
+    rebuild_flow_field();
+    return;
   }
+  g_flow_field_offset += distance;
+  g_flow_field_origin = g_player->position;
+  g_flow_field[WINDOW_X(g_flow_field_origin)]
+              [WINDOW_Y(g_flow_field_origin)] = -g_flow_field_offset;
+  g_flow_field_queue[0] = FLOW_FIELD_CELL_INDEX(g_flow_field_origin);
+  propagate_flow_field(1);
 }
 
 /******************************************************************************
-   Function: get_pursuit_direction
+   Function: rebuild_flow_field
 
-Description: Determines in which direction a character at a given position
-             ought to move in order to pursue a character at another given
-             position. (Simplistic: no complex path-finding.)
+Description: Rebuilds the flow field (each traversable cell's walking distance
+             from the player, within the resident window) via a breadth-first
+             search outward from the player's position.
 
-     Inputs: pursuer - Position of the pursuing character.
-             pursuee - Position of the character being pursued.
+     Inputs: None.
 
-    Outputs: Integer representing the direction in which the NPC ought to move.
+    Outputs: None.
 ******************************************************************************/
-int8_t get_pursuit_direction(const GPoint pursuer, const GPoint pursuee) {
-  int8_t diff_x = pursuer.x - pursuee.x,
-         diff_y = pursuer.y - pursuee.y;
-  const int8_t horizontal_direction = diff_x > 0 ? WEST : EAST,
-               vertical_direction = diff_y > 0 ? NORTH : SOUTH;
-  bool checked_horizontal_direction = false,
-       checked_vertical_direction = false;
+void rebuild_flow_field(void) {
+  int8_t i, j;
 
-  // Check for alignment along the x-axis:
-  if (diff_x == 0) {
-    if (diff_y == 1 /* The two are already touching. */ ||
-        occupiable(get_cell_farther_away(pursuer,
-                                         vertical_direction,
-                                         1))) {
-      return vertical_direction;
+  for (i = 0; i < WINDOW_SIZE; ++i) {
+    for (j = 0; j < WINDOW_SIZE; ++j) {
+      g_flow_field[i][j] = FLOW_FIELD_UNREACHABLE;
     }
-    checked_vertical_direction = true;
+  }
+  g_flow_field_origin = g_player->position;
+  g_flow_field_offset = 0;
+  g_flow_field_is_stale = false;
+  if (cell_is_in_window(g_flow_field_origin)) {
+    g_flow_field[WINDOW_X(g_flow_field_origin)]
+                [WINDOW_Y(g_flow_field_origin)] = 0;
+    g_flow_field_queue[0] = FLOW_FIELD_CELL_INDEX(g_flow_field_origin);
+    propagate_flow_field(1);
+  }
+}
+
+/******************************************************************************
+   Function: open_flow_field_cell
+
+Description: Updates the flow field for a cell that has just become
+             traversable, lowering the distances of any cells to which it
+             provides a shortcut (rather than rebuilding the whole field).
 
-  // Check for alignment along the y-axis:
-  } else if (diff_y == 0) {
-    if (diff_x == 1 /* The two are already touching. */ ||
-        occupiable(get_cell_farther_away(pursuer,
-                                         horizontal_direction,
-                                         1))) {
-      return horizontal_direction;
+     Inputs: cell - Coordinates of the newly traversable cell.
+
+    Outputs: None.
+******************************************************************************/
+void open_flow_field_cell(const GPoint cell) {
+  int8_t direction;
+  int16_t distance = FLOW_FIELD_UNREACHABLE;
+  GPoint neighbor;
+
+  for (direction = 0; direction < NUM_DIRECTIONS; ++direction) {
+    neighbor = get_cell_farther_away(cell, direction, 1);
+    if (cell_is_in_window(neighbor) &&
+        g_flow_field[WINDOW_X(neighbor)][WINDOW_Y(neighbor)] < distance) {
+      distance = g_flow_field[WINDOW_X(neighbor)][WINDOW_Y(neighbor)];
     }
-    checked_horizontal_direction = true;
   }
+  if (distance < FLOW_FIELD_UNREACHABLE) {
+    g_flow_field[WINDOW_X(cell)][WINDOW_Y(cell)] = distance + 1;
+    g_flow_field_queue[0] = FLOW_FIELD_CELL_INDEX(cell);
+    propagate_flow_field(1);
+  }
+}
 
-  // If not aligned along either axis, a direction in either axis will do:
-  while (!checked_horizontal_direction || !checked_vertical_direction) {
-    if (checked_vertical_direction ||
-        (!checked_horizontal_direction && rand() % 2)) {
-      if (occupiable(get_cell_farther_away(pursuer,
-                                           horizontal_direction,
-                                           1))) {
-        return horizontal_direction;
-      }
-      checked_horizontal_direction = true;
-    }
-    if (!checked_vertical_direction) {
-      if (occupiable(get_cell_farther_away(pursuer,
-                                           vertical_direction,
-                                           1))) {
-        return vertical_direction;
+/******************************************************************************
+   Function: propagate_flow_field
+
+Description: Processes the flow field's queue in breadth-first order, lowering
+             the distance of each traversable neighbor that can be reached
+             more quickly via a queued cell. (Each cell is queued at most once
+             per call, so the queue never overflows.)
+
+     Inputs: queue_length - Number of cells initially in the queue.
+
+    Outputs: None.
+******************************************************************************/
+void propagate_flow_field(int16_t queue_length) {
+  int8_t direction;
+  int16_t i, distance;
+  GPoint cell, neighbor;
+
+  for (i = 0; i < queue_length; ++i) {
+    cell = GPoint(g_window_chunk.x * CHUNK_SIZE +
+                    g_flow_field_queue[i] / WINDOW_SIZE,
+                  g_window_chunk.y * CHUNK_SIZE +
+                    g_flow_field_queue[i] % WINDOW_SIZE);
+    distance = g_flow_field[WINDOW_X(cell)][WINDOW_Y(cell)] + 1;
+    for (direction = 0; direction < NUM_DIRECTIONS; ++direction) {
+      neighbor = get_cell_farther_away(cell, direction, 1);
+      if (traversable(neighbor) &&
+          g_flow_field[WINDOW_X(neighbor)][WINDOW_Y(neighbor)] > distance) {
+        g_flow_field[WINDOW_X(neighbor)][WINDOW_Y(neighbor)] = distance;
+        g_flow_field_queue[queue_length++] = FLOW_FIELD_CELL_INDEX(neighbor);
       }
-      checked_vertical_direction = true;
     }
   }
+}
+
+#ifdef FLOW_FIELD_BENCHMARK
+/******************************************************************************
+   Function: benchmark_flow_field
 
-  // If we reach this point, the NPC is stuck in a corner. I'm okay with that:
-  return horizontal_direction;
+Description: Logs how long it takes to rebuild the flow field for the resident
+             window a number of times, then how long it takes to update it
+             as the player steps back and forth between two cells. (Compile
+             with "-DFLOW_FIELD_BENCHMARK".)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void benchmark_flow_field(void) {
+  int8_t direction;
+  int16_t i, rebuild_time;
+  time_t start_s, end_s;
+  uint16_t start_ms, end_ms;
+  GPoint origin = g_player->position, neighbor = origin;
+
+  time_ms(&start_s, &start_ms);
+  for (i = 0; i < FLOW_FIELD_BENCHMARK_RUNS; ++i) {
+    rebuild_flow_field();
+  }
+  time_ms(&end_s, &end_ms);
+  rebuild_time = (end_s - start_s) * 1000 + end_ms - start_ms;
+  for (direction = 0; direction < NUM_DIRECTIONS; ++direction) {
+    if (traversable(get_cell_farther_away(origin, direction, 1))) {
+      neighbor = get_cell_farther_away(origin, direction, 1);
+    }
+  }
+  time_ms(&start_s, &start_ms);
+  for (i = 0; i < FLOW_FIELD_BENCHMARK_RUNS; ++i) {
+    g_player->position = i % 2 ? origin : neighbor;
+    update_flow_field();
+  }
+  time_ms(&end_s, &end_ms);
+  g_player->position = origin;
+  rebuild_flow_field();
+  APP_LOG(APP_LOG_LEVEL_DEBUG,
+          "Flow field: %dx%d window, %d rebuilds in %d ms, %d updates in %d ms",
+          WINDOW_SIZE,
+          WINDOW_SIZE,
+          FLOW_FIELD_BENCHMARK_RUNS,
+          rebuild_time,
+          FLOW_FIELD_BENCHMARK_RUNS,
+          (int) ((end_s - start_s) * 1000 + end_ms - start_ms));
 }
+#endif
 
 /******************************************************************************
    Function: get_direction_to_the_left
@@ -426,28 +981,6 @@ int8_t get_direction_to_the_right(const int8_t reference_direction) {
   }
 }
 
-/******************************************************************************
-   Function: get_opposite_direction
-
-Description: Returns the opposite of a given direction value (i.e., given the
-             argument "NORTH", "SOUTH" will be returned).
-
-     Inputs: direction - The direction whose opposite is desired.
-
-    Outputs: Integer representing the opposite of the given direction.
-******************************************************************************/
-int8_t get_opposite_direction(const int8_t direction) {
-  if (direction == NORTH) {
-    return SOUTH;
-  } else if (direction == SOUTH) {
-    return NORTH;
-  } else if (direction == EAST) {
-    return WEST;
-  } else {  // if (direction == WEST)
-    return EAST;
-  }
-}
-
 /******************************************************************************
    Function: get_nth_item_type
 
@@ -550,1248 +1083,3247 @@ heavy_item_t *get_heavy_item_equipped_at(const int8_t equip_target) {
 /******************************************************************************
    Function: get_cell_type
 
-Description: Returns the type of cell at a given set of coordinates.
+Description: Returns the type of cell at a given set of coordinates. (Cells
+             outside the resident window, or in chunks not yet streamed in and
+             carved, are treated as solid.)
 
      Inputs: cell - Coordinates of the cell of interest.
 
     Outputs: The indicated cell's type.
 ******************************************************************************/
 int8_t get_cell_type(const GPoint cell) {
-  if (cell.x < 0 ||
-      cell.x >= MAP_WIDTH ||
-      cell.y < 0 ||
-      cell.y >= MAP_HEIGHT) {
+  const resident_chunk_t *resident_chunk;
+
+  if (!cell_is_in_window(cell)) {
     return SOLID;
   }
+  resident_chunk = get_resident_chunk(GPoint(CHUNK_COORDINATE(cell.x),
+                                             CHUNK_COORDINATE(cell.y)));
 
-  return g_location->map[cell.x][cell.y];
+  return resident_chunk && !resident_chunk->generating ?
+           get_chunk_cell_type(&resident_chunk->chunk, cell) :
+           SOLID;
 }
 
 /******************************************************************************
-   Function: set_cell_type
+   Function: get_solid_neighborhood
 
-Description: Sets the cell at a given set of coordinates to a given type.
-             (Doesn't test coordinates to ensure they're in-bounds!)
+Description: Returns the solidity of the 3x3 block of cells centered on a given
+             (in-window) cell as a 9-bit mask, read from three rows of the
+             window's solidity bitset at once. (Thanks to the window's solid
+             border, no bounds checks are needed.)
 
-     Inputs: cell - Coordinates of the cell of interest.
-             type - The cell type to be assigned at those coordinates.
+     Inputs: cell - Coordinates of the center cell.
 
-    Outputs: None.
+    Outputs: Bit mask of solid cells, tested via "get_neighborhood_bit".
 ******************************************************************************/
-void set_cell_type(GPoint cell, const int8_t type) {
-  g_location->map[cell.x][cell.y] = type;
+uint16_t get_solid_neighborhood(const GPoint cell) {
+  const int8_t x = WINDOW_X(cell), y = WINDOW_Y(cell);
+
+  return (g_window_solid_rows[y] >> x & 7) |
+         (g_window_solid_rows[y + 1] >> x & 7) << 3 |
+         (g_window_solid_rows[y + 2] >> x & 7) << 6;
 }
 
 /******************************************************************************
-   Function: get_npc_at
+   Function: get_neighborhood_bit
 
-Description: Returns a pointer to the NPC occupying a given cell.
+Description: Returns the bit representing a given neighbor within a mask from
+             "get_solid_neighborhood".
 
-     Inputs: cell - Coordinates of the cell of interest.
+     Inputs: direction   - Direction of the neighbor from the center cell.
+             direction_2 - Second direction for diagonal neighbors (or NONE).
 
-    Outputs: Pointer to the NPC occupying the indicated cell, or NULL if there
-             is none.
+    Outputs: Bit mask with only the neighbor's bit set.
 ******************************************************************************/
-npc_t *get_npc_at(const GPoint cell) {
-  int8_t i;
-  npc_t *npc;
+uint16_t get_neighborhood_bit(const int8_t direction,
+                              const int8_t direction_2) {
+  GPoint neighbor = get_cell_farther_away(NEIGHBORHOOD_CENTER, direction, 1);
 
-  for (i = 0; i < MAX_NPCS_AT_ONE_TIME; ++i) {
-    npc = &g_location->npcs[i];
-    if (npc->type > NONE && gpoint_equal(&npc->position, &cell)) {
-      return npc;
-    }
+  if (direction_2 > NONE) {
+    neighbor = get_cell_farther_away(neighbor, direction_2, 1);
   }
 
-  return NULL;
+  return 1 << (neighbor.y * 3 + neighbor.x);
 }
 
 /******************************************************************************
-   Function: get_stat_title_str
+   Function: cell_is_in_window
 
-Description: Returns a "title" string for a given character stat, including
-             both the stat's name and its current value.
+Description: Determines whether a given set of coordinates lies within the
+             resident window (the RESIDENT_CHUNKS_WIDE x RESIDENT_CHUNKS_WIDE
+             chunks centered on the player's chunk).
 
-     Inputs: stat_index - Integer representing the stat of interest.
+     Inputs: cell - Coordinates of the cell of interest.
 
-    Outputs: String containing the stat name and its current value.
+    Outputs: "True" if the cell lies within the resident window.
 ******************************************************************************/
-char *get_stat_title_str(const int8_t stat_index) {
-  static char stat_str[STAT_TITLE_STR_LEN + 1];
-  int8_t remaining_str_len;
-
-  snprintf(stat_str,
-           STAT_TITLE_STR_LEN + 1,
-           "%s: ",
-           g_stat_names[stat_index + NUM_NEGATIVE_STAT_CONSTANTS]);
-
-  // Add the stat's current value:
-  remaining_str_len = STAT_TITLE_STR_LEN - strlen(stat_str) + 1;
-  if (stat_index == EXPERIENCE_POINTS) {
-    snprintf(stat_str + strlen(stat_str),
-             remaining_str_len,
-             "%u",
-             g_player->exp_points);
-  } else if (stat_index < 0) {
-    snprintf(stat_str + strlen(stat_str),
-             remaining_str_len,
-             "%d/%d",
-             g_player->int16_stats[stat_index + NUM_NEGATIVE_STAT_CONSTANTS],
-             g_player->int16_stats[stat_index + NUM_NEGATIVE_STAT_CONSTANTS +
-                                     2]);
-  } else {
-    snprintf(stat_str + strlen(stat_str),
-             remaining_str_len,
-             "%d",
-             g_player->int8_stats[stat_index]);
-  }
-
-  return stat_str;
+bool cell_is_in_window(const GPoint cell) {
+  return (uint16_t) WINDOW_X(cell) < WINDOW_SIZE &&
+         (uint16_t) WINDOW_Y(cell) < WINDOW_SIZE;
 }
 
 /******************************************************************************
-   Function: occupiable
+   Function: set_cell_type
 
-Description: Determines whether the cell at a given set of coordinates may be
-             occupied by a game character (i.e., it's within map boundaries,
-             non-solid, not already occupied by another character, etc.).
+Description: Sets the cell at a given set of coordinates to a given type,
+             recording the change so it survives regeneration and updating the
+             window's bitsets, and the flow field if the cell's traversability
+             changes. (Cells whose chunks aren't
+             resident, or are still being carved, are left alone. If a chunk's
+             special cell table is full, new loot is simply lost.)
 
      Inputs: cell - Coordinates of the cell of interest.
+             type - The cell type to be assigned at those coordinates.
 
-    Outputs: "True" if the cell is occupiable.
+    Outputs: None.
 ******************************************************************************/
-bool occupiable(const GPoint cell) {
-  return get_cell_type(cell) >= EMPTY &&
-         !gpoint_equal(&g_player->position, &cell) &&
-         get_npc_at(cell) == NULL;
+void set_cell_type(GPoint cell, const int8_t type) {
+  const bool was_traversable = traversable(cell);
+  const int8_t old_type = get_cell_type(cell);
+  window_row_t row_bit, column_bit;
+  resident_chunk_t *const resident_chunk =
+    get_resident_chunk(GPoint(CHUNK_COORDINATE(cell.x),
+                              CHUNK_COORDINATE(cell.y)));
+
+  if (!cell_is_in_window(cell) ||
+      !resident_chunk ||
+      resident_chunk->generating) {
+    return;
+  }
+  row_bit = (window_row_t) 1 << (WINDOW_X(cell) + 1);
+  column_bit = (window_row_t) 1 << (WINDOW_Y(cell) + 1);
+  set_chunk_cell_type(&resident_chunk->chunk, cell, type);
+  record_map_change(cell, old_type, type);
+
+  // Update the window's solidity bitset (by row and by column), then its
+  // movement bitsets:
+  if (CELL_ATTRIBUTES(type) & BLOCKS_SIGHT) {
+    g_window_solid_rows[WINDOW_Y(cell) + 1] |= row_bit;
+    g_window_solid_columns[WINDOW_X(cell) + 1] |= column_bit;
+  } else {
+    g_window_solid_rows[WINDOW_Y(cell) + 1] &= ~row_bit;
+    g_window_solid_columns[WINDOW_X(cell) + 1] &= ~column_bit;
+  }
+  row_bit >>= 1;
+  if (CELL_ATTRIBUTES(type) & BLOCKS_MOVEMENT) {
+    g_window_blocked_rows[WINDOW_Y(cell)] |= row_bit;
+  } else {
+    g_window_blocked_rows[WINDOW_Y(cell)] &= ~row_bit;
+  }
+  if (CELL_ATTRIBUTES(type) & NPC_PASSABLE) {
+    g_window_passable_rows[WINDOW_Y(cell)] |= row_bit;
+  } else {
+    g_window_passable_rows[WINDOW_Y(cell)] &= ~row_bit;
+  }
+
+  // Keep the flow field up to date (a cell becoming untraversable may
+  // lengthen many paths, so that case simply triggers a rebuild, as does any
+  // change while the player's away from the field's origin, since the player
+  // may yet return there):
+  if (was_traversable != traversable(cell)) {
+    if (was_traversable || !flow_field_is_current()) {
+      g_flow_field_is_stale = true;
+    } else {
+      open_flow_field_cell(cell);
+    }
+  }
 }
 
 /******************************************************************************
-   Function: show_narration
+   Function: in_line_of_sight
 
-Description: Displays desired narration text via the narration window.
+Description: Determines whether two cells lie along the same row or column,
+             within sight range of each other, with no solid cells between
+             them (tested all at once against the window's row or column
+             bitset). NPCs don't block the view.
 
-     Inputs: narration - Integer indicating desired narration text.
+     Inputs: cell_1 - Coordinates of the first cell.
+             cell_2 - Coordinates of the second cell.
 
-    Outputs: Integer representing the narration text shown.
+    Outputs: "True" if each cell can be seen from the other.
 ******************************************************************************/
-int8_t show_narration(const int8_t narration) {
-  text_layer_set_text(g_narration_text_layer, g_narration_strings[narration]);
-  show_window(NARRATION_WINDOW, NOT_ANIMATED);
+bool in_line_of_sight(const GPoint cell_1, const GPoint cell_2) {
+  int8_t start, distance;
+  window_row_t line;
+
+  if (!cell_is_in_window(cell_1) || !cell_is_in_window(cell_2)) {
+    return false;
+  } else if (cell_1.y == cell_2.y) {
+    start = WINDOW_X(cell_1) < WINDOW_X(cell_2) ? WINDOW_X(cell_1) :
+                                                  WINDOW_X(cell_2);
+    distance = abs(cell_1.x - cell_2.x);
+    line = g_window_solid_rows[WINDOW_Y(cell_1) + 1];
+  } else if (cell_1.x == cell_2.x) {
+    start = WINDOW_Y(cell_1) < WINDOW_Y(cell_2) ? WINDOW_Y(cell_1) :
+                                                  WINDOW_Y(cell_2);
+    distance = abs(cell_1.y - cell_2.y);
+    line = g_window_solid_columns[WINDOW_X(cell_1) + 1];
+  } else {
+    return false;
+  }
 
-  return g_current_narration = narration;
+  // Both cells and every cell between them must be open:
+  return distance <= MAX_SIGHT_DISTANCE &&
+         (line >> (start + 1) & (((window_row_t) 2 << distance) - 1)) == 0;
 }
 
 /******************************************************************************
-   Function: show_window
+   Function: get_chunk_cell_type
 
-Description: Prepares and displays a given window.
+Description: Returns the type of a given cell within a given map chunk.
 
-     Inputs: window_index - Integer representing the desired window.
-             animated     - If "true", the window will slide into view.
+     Inputs: chunk - Pointer to the chunk containing the cell.
+             cell  - Coordinates of the cell of interest.
 
-    Outputs: Integer representing the newly-displayed window.
+    Outputs: The indicated cell's type.
 ******************************************************************************/
-int8_t show_window(const int8_t window_index, const bool animated) {
-  // If it's a menu, reload menu data and set to the appropriate index:
-  if (window_index < NUM_MENUS) {
-    menu_layer_reload_data(g_menu_layers[window_index]);
-    if (window_index == INVENTORY_MENU) {
-      menu_layer_set_selected_index(g_menu_layers[window_index],
-                                    (MenuIndex) {0, g_current_selection},
-                                    MenuRowAlignCenter,
-                                    NOT_ANIMATED);
-    } else {
-      menu_layer_set_selected_index(g_menu_layers[window_index],
-                                    (MenuIndex) {0, 0},
-                                    MenuRowAlignCenter,
-                                    NOT_ANIMATED);
-    }
-  }
+int8_t get_chunk_cell_type(const map_chunk_t *const chunk, const GPoint cell) {
+  uint8_t i;
+  const uint8_t cell_index = CHUNK_CELL_INDEX(cell);
 
-  // Show the window:
-  if (!window_stack_contains_window(g_windows[window_index])) {
-    window_stack_push(g_windows[window_index], animated);
-  } else {
-    while (window_stack_get_top_window() != g_windows[window_index]) {
-      window_stack_pop(animated);
-    }
+  // Most cells are solid, so check that before searching the special cells:
+  if (chunk->solid_rows[CHUNK_OFFSET(cell.y)] >> CHUNK_OFFSET(cell.x) & 1) {
+    return SOLID;
+  }
+  i = find_special_cell(chunk, cell_index);
+  if (i < chunk->num_special_cells &&
+      chunk->special_cells[i].cell == cell_index) {
+    return chunk->special_cells[i].type;
   }
 
-  return g_current_window = window_index;
+  return EMPTY;
 }
 
 /******************************************************************************
-   Function: main_menu_draw_header_callback
+   Function: get_resident_chunk
 
-Description: Instructions for drawing the main menu's header.
+Description: Returns the resident copy of the map chunk at a given set of
+             chunk coordinates, if it's been loaded. (Each chunk has a fixed
+             slot, so chunks in the window never share one.)
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: chunk_position - Chunk coordinates of the chunk of interest.
 
-    Outputs: None.
+    Outputs: Pointer to the resident chunk, or NULL if it isn't loaded.
 ******************************************************************************/
-static void main_menu_draw_header_callback(GContext *ctx,
-                                           const Layer *cell_layer,
-                                           uint16_t section_index,
-                                           void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "MAIN MENU");
+resident_chunk_t *get_resident_chunk(const GPoint chunk_position) {
+  resident_chunk_t *const resident_chunk =
+    &g_resident_chunks[RESIDENT_CHUNK_SLOT(chunk_position.y)]
+                      [RESIDENT_CHUNK_SLOT(chunk_position.x)];
+
+  if (gpoint_equal(&resident_chunk->position, &chunk_position)) {
+    return resident_chunk;
+  }
+
+  return NULL;
 }
 
 /******************************************************************************
-   Function: level_up_menu_draw_header_callback
+   Function: load_map_chunk
 
-Description: Instructions for drawing the level-up menu's header.
+Description: Claims a given resident chunk slot for the map chunk at a given
+             set of chunk coordinates. In endless mode the chunk is generated
+             right away; otherwise it's left for "generate_level" to carve.
+             (Chunks beyond a fixed map's edges are solid.)
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: resident_chunk - Pointer to the slot to be filled.
+             chunk_position - Chunk coordinates of the chunk to be loaded.
 
     Outputs: None.
 ******************************************************************************/
-static void level_up_menu_draw_header_callback(GContext *ctx,
-                                               const Layer *cell_layer,
-                                               uint16_t section_index,
-                                               void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "BOOST AN ATTRIBUTE");
+void load_map_chunk(resident_chunk_t *const resident_chunk,
+                    const GPoint chunk_position) {
+  map_chunk_t *const chunk = &resident_chunk->chunk;
+
+  clear_map_chunk(chunk);
+  resident_chunk->position = chunk_position;
+  resident_chunk->generating = false;
+  if (g_location->endless) {
+    generate_endless_chunk(chunk, chunk_position);
+  } else if ((uint16_t) chunk_position.x < MAP_CHUNKS_WIDE &&
+             (uint16_t) chunk_position.y < MAP_CHUNKS_WIDE) {
+    resident_chunk->generating = true;
+  }
 }
 
 /******************************************************************************
-   Function: stats_menu_draw_header_callback
+   Function: record_map_change
 
-Description: Instructions for drawing the stats menu's header.
+Description: Records that a given cell of the current location has changed
+             type, so the change can be saved and reapplied whenever its chunk
+             is regenerated. A cell restored to its generated type is simply
+             forgotten. (Endless mode changes aren't recorded. If the list is
+             full, a new change lasts only while its chunk stays resident, so
+             changes that must persist are checked for room beforehand; see
+             "map_change_is_recordable".)
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: cell     - Coordinates of the changed cell.
+             old_type - The cell's type before the change.
+             new_type - The cell's new type.
 
     Outputs: None.
 ******************************************************************************/
-static void stats_menu_draw_header_callback(GContext *ctx,
-                                            const Layer *cell_layer,
-                                            uint16_t section_index,
-                                            void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "CHARACTER STATS");
+void record_map_change(const GPoint cell,
+                       const int8_t old_type,
+                       const int8_t new_type) {
+  uint16_t i;
+  const uint16_t cell_index = MAP_CELL_INDEX(cell);
+  map_change_t *const map_changes = g_location->map_changes;
+
+  if (g_location->endless) {
+    return;
+  }
+  for (i = 0; i < g_location->num_map_changes; ++i) {
+    if (map_changes[i].cell == cell_index) {
+      if (new_type == map_changes[i].generated_type) {
+        map_changes[i] = map_changes[--g_location->num_map_changes];
+      } else {
+        map_changes[i].type = new_type;
+      }
+      return;
+    }
+  }
+
+  // With no change on record, the cell's old type is its generated type:
+  if (new_type != old_type &&
+      g_location->num_map_changes < MAX_MAP_CHANGES) {
+    map_changes[i].cell = cell_index;
+    map_changes[i].type = new_type;
+    map_changes[i].generated_type = old_type;
+    g_location->num_map_changes++;
+  }
 }
 
 /******************************************************************************
-   Function: inventory_menu_draw_header_callback
+   Function: map_change_is_recordable
 
-Description: Instructions for drawing the inventory menu's header.
+Description: Determines whether a change to a given cell of the current
+             location could be recorded: that is, whether the location is
+             endless (nothing's recorded), the cell already has a change on
+             record (which would simply be updated), or there's room left in
+             the map change list.
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: cell - Coordinates of the cell of interest.
 
-    Outputs: None.
+    Outputs: "True" if a change to the cell wouldn't be lost.
 ******************************************************************************/
-static void inventory_menu_draw_header_callback(GContext *ctx,
-                                                const Layer *cell_layer,
-                                                uint16_t section_index,
-                                                void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "INVENTORY");
+bool map_change_is_recordable(const GPoint cell) {
+  uint16_t i;
+  const uint16_t cell_index = MAP_CELL_INDEX(cell);
+
+  if (g_location->endless ||
+      g_location->num_map_changes < MAX_MAP_CHANGES) {
+    return true;
+  }
+  for (i = 0; i < g_location->num_map_changes; ++i) {
+    if (g_location->map_changes[i].cell == cell_index) {
+      return true;
+    }
+  }
+
+  return false;
 }
 
 /******************************************************************************
-   Function: loot_menu_draw_header_callback
+   Function: apply_map_changes
 
-Description: Instructions for drawing the loot menu's header.
+Description: Reapplies the current location's recorded map changes to a given
+             freshly generated resident chunk. (If the location was dropped
+             from the level cache, its loot and keys are removed first, since
+             it's no longer known which of them were taken.)
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: resident_chunk - Pointer to the chunk of interest.
 
     Outputs: None.
 ******************************************************************************/
-static void loot_menu_draw_header_callback(GContext *ctx,
-                                           const Layer *cell_layer,
-                                           uint16_t section_index,
-                                           void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "LOOT");
+void apply_map_changes(resident_chunk_t *const resident_chunk) {
+  uint16_t i;
+  GPoint cell;
+  map_chunk_t *const chunk = &resident_chunk->chunk;
+
+  if (!g_location->endless &&
+      LEVEL_WAS_EVICTED(g_player->int8_stats[DEPTH])) {
+    for (i = chunk->num_special_cells; i-- > 0;) {
+      if (CELL_ATTRIBUTES(chunk->special_cells[i].type) & PICKED_UP) {
+        set_chunk_cell_type(chunk,
+                            GPoint(chunk->special_cells[i].cell % CHUNK_SIZE,
+                                   chunk->special_cells[i].cell / CHUNK_SIZE),
+                            EMPTY);
+      }
+    }
+  }
+
+  for (i = 0; i < g_location->num_map_changes; ++i) {
+    cell = GPoint(g_location->map_changes[i].cell % MAP_WIDTH,
+                  g_location->map_changes[i].cell / MAP_WIDTH);
+    if (CHUNK_COORDINATE(cell.x) == resident_chunk->position.x &&
+        CHUNK_COORDINATE(cell.y) == resident_chunk->position.y) {
+      set_chunk_cell_type(chunk, cell, g_location->map_changes[i].type);
+    }
+  }
 }
 
 /******************************************************************************
-   Function: pebble_options_menu_draw_header_callback
+   Function: recenter_map_window
 
-Description: Instructions for drawing the Pebble options menu's header.
+Description: Centers the resident window on the player's chunk. Chunks that
+             remain within the window keep their slots; the rest are streamed
+             in over the next few steps (see "stream_map_chunks") and read as
+             solid until then. The NPC grid is rebuilt for the new window and
+             the flow field is marked out of date. In endless mode, NPCs
+             outside the new window are dropped.
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void pebble_options_menu_draw_header_callback(GContext *ctx,
-                                                     const Layer *cell_layer,
-                                                     uint16_t section_index,
-                                                     void *data) {
-  menu_cell_basic_header_draw(ctx, cell_layer, "OPTIONS");
+void recenter_map_window(void) {
+  int8_t i, j, npc;
+  GPoint shift = GPoint(0, 0);
+
+  // In endless mode, keep coordinates small by shifting the map whenever the
+  // player strays beyond ENDLESS_MIN_CHUNK to ENDLESS_MAX_CHUNK:
+  if (g_location->endless) {
+    if (CHUNK_COORDINATE(g_player->position.x) < ENDLESS_MIN_CHUNK) {
+      shift.x = -RESIDENT_CHUNKS_WIDE;
+    } else if (CHUNK_COORDINATE(g_player->position.x) >= ENDLESS_MAX_CHUNK) {
+      shift.x = RESIDENT_CHUNKS_WIDE;
+    }
+    if (CHUNK_COORDINATE(g_player->position.y) < ENDLESS_MIN_CHUNK) {
+      shift.y = -RESIDENT_CHUNKS_WIDE;
+    } else if (CHUNK_COORDINATE(g_player->position.y) >= ENDLESS_MAX_CHUNK) {
+      shift.y = RESIDENT_CHUNKS_WIDE;
+    }
+    if (shift.x != 0 || shift.y != 0) {
+      rebase_endless_map(shift);
+    }
+  }
+  g_window_chunk = GPoint(CHUNK_COORDINATE(g_player->position.x) - 1,
+                          CHUNK_COORDINATE(g_player->position.y) - 1);
+  if (g_location->endless) {
+    for (i = g_npcs->num_live_npcs - 1; i >= 0; --i) {
+      npc = g_npcs->live_npcs[i];
+      if (!cell_is_in_window(g_npcs->positions[npc])) {
+        remove_npc(npc);
+      }
+    }
+  }
+  for (i = 0; i < WINDOW_SIZE + 2; ++i) {
+    g_window_solid_rows[i] = g_window_solid_columns[i] = SOLID_WINDOW_ROW;
+  }
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      update_window_bitsets(GPoint(g_window_chunk.x + i,
+                                   g_window_chunk.y + j));
+    }
+  }
+  init_npc_grid();
+  g_flow_field_is_stale = true;
+  g_activity_origin = GPoint(NONE, NONE);
+  g_map_window_is_resident = false;
 }
 
 /******************************************************************************
-   Function: heavy_items_menu_draw_header_callback
+   Function: stream_map_chunks
 
-Description: Instructions for drawing the heavy items menu's header.
+Description: Brings the resident window up to date, one chunk at a time, until
+             every chunk in the window has been loaded or
+             CHUNK_STREAMING_BUDGET milliseconds have elapsed. (At least one
+             chunk is loaded per call.) The new chunks of an ordinary location
+             are then carved together by a single replay of the level
+             generator, run a slice at a time as a background task (see
+             "run_task"), and read as solid until it's done.
 
-     Inputs: ctx           - Pointer to the associated context.
-             cell_layer    - Pointer to the cell layer.
-             section_index - Section number of the header to be drawn.
-             data          - Pointer to additional data (not used).
+     Inputs: None.
 
-    Outputs: None.
+    Outputs: "True" if every chunk in the window is resident.
 ******************************************************************************/
-static void heavy_items_menu_draw_header_callback(GContext *ctx,
-                                                  const Layer *cell_layer,
-                                                  uint16_t section_index,
-                                                  void *data) {
-  char header_str[HEAVY_ITEMS_MENU_HEADER_STR_LEN + 1];
+bool stream_map_chunks(void) {
+  int8_t i, j;
+  bool chunk_loaded = false, generating = false, complete = true;
+  GPoint chunk_position;
+  resident_chunk_t *resident_chunk;
+  const uint32_t start_time = get_current_time_ms();
+
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE && complete; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      chunk_position = GPoint(g_window_chunk.x + i, g_window_chunk.y + j);
+      if (get_resident_chunk(chunk_position)) {
+        continue;
+      } else if (chunk_loaded &&
+                 get_current_time_ms() - start_time >=
+                   CHUNK_STREAMING_BUDGET) {
+        complete = false;
+        break;
+      }
+      resident_chunk =
+        &g_resident_chunks[RESIDENT_CHUNK_SLOT(chunk_position.y)]
+                          [RESIDENT_CHUNK_SLOT(chunk_position.x)];
+      load_map_chunk(resident_chunk, chunk_position);
+      if (resident_chunk->generating) {
+        generating = true;
+      } else {
+        update_window_bitsets(chunk_position);
+      }
+      g_flow_field_is_stale = true;
+      chunk_loaded = true;
+    }
+  }
+  if (generating) {
+    carve_streamed_chunks();
+  }
+#ifdef MAP_STREAMING_STATS
+  if (chunk_loaded) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "Window chunks streamed in %d ms",
+            (int) (get_current_time_ms() - start_time));
+  }
+#endif
 
-  snprintf(header_str,
-           HEAVY_ITEMS_MENU_HEADER_STR_LEN + 1,
-           "%s AN ITEM?",
-           g_current_selection < FIRST_HEAVY_ITEM ? "ENCHANT" : "DROP");
-  menu_cell_basic_header_draw(ctx, cell_layer, header_str);
+  return complete;
 }
 
 /******************************************************************************
-   Function: main_menu_draw_row_callback
+   Function: load_map_window
 
-Description: Instructions for drawing each row (cell) of the main menu.
+Description: Discards any resident chunks, then loads the resident window
+             around the player all at once. (Used when a location is entered
+             or restored, before gameplay resumes.)
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void main_menu_draw_row_callback(GContext *ctx,
-                                        const Layer *cell_layer,
-                                        MenuIndex *cell_index,
-                                        void *data) {
-  menu_cell_basic_draw(ctx,
-                       cell_layer,
-                       g_main_menu_strings[cell_index->row],
-                       g_main_menu_strings[cell_index->row +
-                                             MAIN_MENU_NUM_ROWS],
-                       NULL);
+void load_map_window(void) {
+  unload_map_chunks();
+  recenter_map_window();
+  while (!stream_map_chunks()) {
+    // (Each call makes progress, so this loop always ends.)
+  }
+  finish_task(CARVE_CHUNKS_TASK);
+  g_map_window_is_resident = true;
 }
 
 /******************************************************************************
-   Function: inventory_menu_draw_row_callback
+   Function: carve_streamed_chunks
 
-Description: Instructions for drawing each row (cell) of the inventory menu.
+Description: Starts replaying the current location's level generator, as a
+             background task, to carve the resident chunks that are waiting
+             for it. If a replay is already underway, the chunks it has
+             partly carved are cleared and it starts over, so that the new
+             chunks get every room and corridor too.
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void inventory_menu_draw_row_callback(GContext *ctx,
-                                             const Layer *cell_layer,
-                                             MenuIndex *cell_index,
-                                             void *data) {
-  char title_str[ITEM_TITLE_STR_LEN + 1],
-       subtitle_str[ITEM_SUBTITLE_STR_LEN + 1] = "";
-  heavy_item_t *heavy_item;
-  int8_t item_type = get_nth_item_type(cell_index->row);
+void carve_streamed_chunks(void) {
+  int8_t i, j;
+
+  if (g_task_is_pending[CARVE_CHUNKS_TASK]) {
+    for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+      for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+        if (g_resident_chunks[i][j].generating) {
+          clear_map_chunk(&g_resident_chunks[i][j].chunk);
+        }
+      }
+    }
+  }
+  init_level_generator(&g_chunk_generator,
+                       get_level_seed(g_player->run_seed,
+                                      g_player->int8_stats[DEPTH]),
+                       g_player->int8_stats[DEPTH],
+                       g_resident_chunks);
+  schedule_task(CARVE_CHUNKS_TASK);
+}
 
-  strcpy(title_str, g_item_names[item_type]);
+/******************************************************************************
+   Function: unload_map_chunks
 
-  // Pebbles:
-  if (item_type < FIRST_HEAVY_ITEM) {
-    snprintf(subtitle_str, 6, "(%d) ", g_player->pebbles[item_type]);
-    if (g_player->equipped_pebble == item_type) {
-      strcat(subtitle_str, EQUIPPED_STR);
-    }
+Description: Empties every resident chunk slot without saving its contents.
 
-  // Heavy items:
-  } else {
-    heavy_item = &g_player->heavy_items[cell_index->row -
-                                          get_num_pebble_types_owned()];
-    strcat(title_str, g_magic_type_names[heavy_item->infused_pebble + 1]);
-    if (heavy_item->equipped) {
-      strcat(subtitle_str, EQUIPPED_STR);
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void unload_map_chunks(void) {
+  int8_t i, j;
+
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      g_resident_chunks[i][j].position = UNLOADED_CHUNK;
+      g_resident_chunks[i][j].generating = false;
     }
   }
-  menu_cell_basic_draw(ctx, cell_layer, title_str, subtitle_str, NULL);
 }
 
 /******************************************************************************
-   Function: level_up_menu_draw_row_callback
+   Function: finish_generated_chunks
 
-Description: Instructions for drawing each row (cell) of the level-up menu.
+Description: Reapplies recorded map changes to each resident chunk that has
+             just been carved, then marks it as ready and copies it into the
+             resident window's bitsets (so the flow field is out of date).
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void level_up_menu_draw_row_callback(GContext *ctx,
-                                            const Layer *cell_layer,
-                                            MenuIndex *cell_index,
-                                            void *data) {
-  menu_cell_basic_draw(ctx,
-                       cell_layer,
-                       get_stat_title_str(cell_index->row + FIRST_MAJOR_STAT),
-                       NULL,
-                       NULL);
+void finish_generated_chunks(void) {
+  int8_t i, j;
+  resident_chunk_t *resident_chunk;
+
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      resident_chunk = &g_resident_chunks[i][j];
+      if (resident_chunk->generating) {
+        apply_map_changes(resident_chunk);
+        resident_chunk->generating = false;
+        update_window_bitsets(resident_chunk->position);
+        g_flow_field_is_stale = true;
+      }
+    }
+  }
 }
 
 /******************************************************************************
-   Function: stats_menu_draw_row_callback
+   Function: update_window_bitsets
 
-Description: Instructions for drawing the rows (cells) of each "heavy items"
-             menu: the "replace item" menu and the infusion menu.
+Description: Copies the solidity of a given chunk within the resident window
+             into the window's row and column bitsets, along with any special
+             cells that block sight (e.g., closed doors), and which of its
+             cells block movement or let NPCs pass into the window's movement
+             bitsets. (A chunk that isn't loaded or carved yet is copied as
+             solid, and a chunk outside the window, such as one carved after
+             the window has moved on, is ignored.)
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: chunk_position - Chunk coordinates of the chunk of interest.
 
     Outputs: None.
 ******************************************************************************/
-static void stats_menu_draw_row_callback(GContext *ctx,
-                                         const Layer *cell_layer,
-                                         MenuIndex *cell_index,
-                                         void *data) {
-  menu_cell_basic_draw(ctx,
-                       cell_layer,
-                       get_stat_title_str(cell_index->row -
-                                            NUM_NEGATIVE_STAT_CONSTANTS),
-                       NULL,
-                       NULL);
+void update_window_bitsets(const GPoint chunk_position) {
+  int8_t i, j;
+  uint8_t attributes;
+  const int8_t x = (chunk_position.x - g_window_chunk.x) * CHUNK_SIZE,
+               y = (chunk_position.y - g_window_chunk.y) * CHUNK_SIZE;
+  const resident_chunk_t *resident_chunk = get_resident_chunk(chunk_position);
+  const special_cell_t *special_cell;
+  window_row_t chunk_mask;
+  map_row_t row;
+
+  if ((uint16_t) x >= WINDOW_SIZE || (uint16_t) y >= WINDOW_SIZE) {
+    return;
+  } else if (resident_chunk && resident_chunk->generating) {
+    resident_chunk = NULL;
+  }
+  chunk_mask = (window_row_t) SOLID_MAP_ROW << x;
+  for (i = 0; i < CHUNK_SIZE; ++i) {
+    row = resident_chunk ? resident_chunk->chunk.solid_rows[i] :
+                           SOLID_MAP_ROW;
+    g_window_solid_rows[y + i + 1] &=
+      ~((window_row_t) SOLID_MAP_ROW << (x + 1));
+    g_window_solid_rows[y + i + 1] |= (window_row_t) row << (x + 1);
+    g_window_blocked_rows[y + i] = (g_window_blocked_rows[y + i] &
+                                    ~chunk_mask) |
+                                   (window_row_t) row << x;
+    g_window_passable_rows[y + i] = (g_window_passable_rows[y + i] &
+                                     ~chunk_mask) |
+                                    ((window_row_t) row << x ^ chunk_mask);
+    for (j = 0; j < CHUNK_SIZE; ++j) {
+      if (row >> j & 1) {
+        g_window_solid_columns[x + j + 1] |= (window_row_t) 1 << (y + i + 1);
+      } else {
+        g_window_solid_columns[x + j + 1] &=
+          ~((window_row_t) 1 << (y + i + 1));
+      }
+    }
+  }
+  if (!resident_chunk) {
+    return;
+  }
+  for (i = 0; i < resident_chunk->chunk.num_special_cells; ++i) {
+    special_cell = &resident_chunk->chunk.special_cells[i];
+    attributes = CELL_ATTRIBUTES(special_cell->type);
+    j = special_cell->cell % CHUNK_SIZE;
+    if (attributes & BLOCKS_SIGHT) {
+      g_window_solid_rows[y + special_cell->cell / CHUNK_SIZE + 1] |=
+        (window_row_t) 1 << (x + j + 1);
+      g_window_solid_columns[x + j + 1] |=
+        (window_row_t) 1 << (y + special_cell->cell / CHUNK_SIZE + 1);
+    }
+    if (attributes & BLOCKS_MOVEMENT) {
+      g_window_blocked_rows[y + special_cell->cell / CHUNK_SIZE] |=
+        (window_row_t) 1 << (x + j);
+    }
+    if (!(attributes & NPC_PASSABLE)) {
+      g_window_passable_rows[y + special_cell->cell / CHUNK_SIZE] &=
+        ~((window_row_t) 1 << (x + j));
+    }
+  }
 }
 
 /******************************************************************************
-   Function: loot_menu_draw_row_callback
+   Function: rebase_endless_map
 
-Description: Instructions for drawing each row (cell) of the loot menu.
+Description: Shifts the endless map's origin by a given number of chunks,
+             moving the player, NPCs, and resident chunks the opposite way so
+             nothing changes in the world itself. (Shifts are whole multiples
+             of RESIDENT_CHUNKS_WIDE, so every resident chunk keeps its slot.)
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: shift - Number of chunks by which to shift the origin along each
+                     axis.
 
     Outputs: None.
 ******************************************************************************/
-static void loot_menu_draw_row_callback(GContext *ctx,
-                                        const Layer *cell_layer,
-                                        MenuIndex *cell_index,
-                                        void *data) {
-  menu_cell_basic_draw(ctx,
-                       cell_layer,
-                       g_item_names[g_current_selection],
-                       NULL,
-                       NULL);
+void rebase_endless_map(const GPoint shift) {
+  int8_t i, j, npc;
+
+  g_location->chunk_offset.x += shift.x;
+  g_location->chunk_offset.y += shift.y;
+  g_player->position.x -= shift.x * CHUNK_SIZE;
+  g_player->position.y -= shift.y * CHUNK_SIZE;
+  for (i = 0; i < g_npcs->num_live_npcs; ++i) {
+    npc = g_npcs->live_npcs[i];
+    g_npcs->positions[npc].x -= shift.x * CHUNK_SIZE;
+    g_npcs->positions[npc].y -= shift.y * CHUNK_SIZE;
+  }
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      if (!gpoint_equal(&g_resident_chunks[i][j].position, &UNLOADED_CHUNK)) {
+        g_resident_chunks[i][j].position.x -= shift.x;
+        g_resident_chunks[i][j].position.y -= shift.y;
+      }
+    }
+  }
 }
 
 /******************************************************************************
-   Function: pebble_options_menu_draw_row_callback
+   Function: generate_level
 
-Description: Instructions for drawing each row (cell) of the Pebble options
-             menu.
+Description: Generates the location with a given seed at the player's depth,
+             all at once, carving its cells into whichever resident chunks are
+             waiting for it. Also sets the location's color schemes, entrance,
+             and exit. (The same seed and depth always yield the same
+             location.)
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: seed - The location's seed (see "get_level_seed").
 
-    Outputs: None.
+    Outputs: The direction the player faces on entering the location.
 ******************************************************************************/
-static void pebble_options_menu_draw_row_callback(GContext *ctx,
-                                                  const Layer *cell_layer,
-                                                  MenuIndex *cell_index,
-                                                  void *data) {
-  menu_cell_basic_draw(ctx,
-                       cell_layer,
-                       g_pebble_options_menu_strings[cell_index->row],
-                       g_pebble_options_menu_strings[cell_index->row +
-                                                 PEBBLE_OPTIONS_MENU_NUM_ROWS],
-                       NULL);
+int8_t generate_level(const uint32_t seed) {
+  level_generator_t generator;
+
+  init_level_generator(&generator,
+                       seed,
+                       g_player->int8_stats[DEPTH],
+                       g_resident_chunks);
+  while (!run_level_generator(&generator)) {
+    // (Each call carves another room, corridor, etc.)
+  }
+
+  return use_level_layout(&generator);
 }
 
 /******************************************************************************
-   Function: heavy_items_menu_draw_row_callback
+   Function: use_level_layout
 
-Description: Instructions for drawing the rows (cells) of each "heavy items"
-             menu: the "replace item" menu and the infusion menu.
+Description: Gives the current location the color schemes, entrance, and exit
+             chosen by a given level generator.
 
-     Inputs: ctx        - Pointer to the associated context.
-             cell_layer - Pointer to the layer of the cell to be drawn.
-             cell_index - Pointer to the index struct of the cell to be drawn.
-             data       - Pointer to additional data (not used).
+     Inputs: generator - Pointer to the generator.
 
-    Outputs: None.
+    Outputs: The direction the player faces on entering the location.
 ******************************************************************************/
-static void heavy_items_menu_draw_row_callback(GContext *ctx,
-                                               const Layer *cell_layer,
-                                               MenuIndex *cell_index,
-                                               void *data) {
-  char title_str[ITEM_TITLE_STR_LEN + 1],
-       subtitle_str[ITEM_SUBTITLE_STR_LEN + 1] = "";
-  heavy_item_t *heavy_item = &g_player->heavy_items[cell_index->row];
+int8_t use_level_layout(const level_generator_t *const generator) {
+  g_location->floor_color_scheme = generator->floor_color_scheme;
+  g_location->wall_color_scheme = generator->wall_color_scheme;
+  g_location->entrance = generator->entrance;
+  g_location->exit = generator->exit;
 
-  strcpy(title_str, g_item_names[heavy_item->type]);
-  strcat(title_str, g_magic_type_names[heavy_item->infused_pebble + 1]);
-  if (heavy_item->equipped) {
-    strcpy(subtitle_str, EQUIPPED_STR);
-  }
-  menu_cell_basic_draw(ctx, cell_layer, title_str, subtitle_str, NULL);
+  return generator->direction;
 }
 
 /******************************************************************************
-   Function: menu_select_callback
+   Function: pregenerate_next_level
 
-Description: Called when a menu cell is selected.
+Description: Starts generating the location one level down, around its
+             entrance, as a background task (unless that's already underway or
+             done), so that taking the exit is instant. Since the next location
+             depends only on the run seed and depth, this can start whenever
+             the player nears the exit. (Not needed if the background worker
+             has already pregenerated the level, or is running to do so.)
 
-     Inputs: menu_layer - Pointer to the menu layer.
-             cell_index - Pointer to the index struct of the selected cell.
-             data       - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void menu_select_callback(MenuLayer *menu_layer,
-                          MenuIndex *cell_index,
-                          void *data) {
-  int8_t i, old_item_equip_target;
-  bool item_was_equipped = false;
-  heavy_item_t *heavy_item;
-
-  if (menu_layer == g_menu_layers[MAIN_MENU]) {
-    if (cell_index->row == 0) {  // Play
-      show_window(GRAPHICS_WINDOW, NOT_ANIMATED);
-      if (g_player->int8_stats[DEPTH] == 0 ||
-          g_player->int16_stats[CURRENT_HEALTH] <= 0) {
-        init_player();
-        show_narration(INTRO_NARRATION_1);
-        init_location();
-      }
-    } else if (cell_index->row == 1) {  // Inventory
-      g_current_selection = 0;  // To scroll menu to the top.
-      show_window(INVENTORY_MENU, ANIMATED);
-    } else {  // Character Stats
-      show_window(STATS_MENU, ANIMATED);
-    }
-  } else if (menu_layer == g_menu_layers[LEVEL_UP_MENU]) {
-    g_player->int8_stats[cell_index->row + FIRST_MAJOR_STAT]++;
-    set_player_minor_stats();
-    g_player->int16_stats[CURRENT_HEALTH] = g_player->int16_stats[MAX_HEALTH];
-    g_player->int16_stats[CURRENT_ENERGY] = g_player->int16_stats[MAX_ENERGY];
-    window_stack_pop(NOT_ANIMATED);
-    show_window(STATS_MENU, NOT_ANIMATED);
-  } else if (menu_layer == g_menu_layers[INVENTORY_MENU]) {
-    // Pebbles:
-    if (get_nth_item_type(cell_index->row) < FIRST_HEAVY_ITEM) {
-      g_current_selection = get_nth_item_type(cell_index->row);
-      show_window(PEBBLE_OPTIONS_MENU, ANIMATED);
+void pregenerate_next_level(void) {
+  const int8_t depth = g_player->int8_stats[DEPTH] + 1;
+  const uint32_t seed = get_level_seed(g_player->run_seed, depth);
+
+  if (depth > MAX_DEPTH ||
+      app_worker_is_running() ||
+      level_is_pregenerated(g_player->run_seed, depth) ||
+      (g_next_level.depth == depth && g_next_level.seed == seed)) {
+    return;
+  }
+  init_level_generator(&g_next_level, seed, depth, g_next_level_chunks);
+  claim_level_chunks(&g_next_level);
+  schedule_task(NEXT_LEVEL_TASK);
+}
 
-    // Heavy items:
-    } else {
-      equip_heavy_item(&g_player->heavy_items[cell_index->row -
-                                                get_num_pebble_types_owned()]);
-      menu_layer_reload_data(g_menu_layers[INVENTORY_MENU]);
-    }
-  } else if (menu_layer == g_menu_layers[LOOT_MENU]) {
-    show_window(GRAPHICS_WINDOW, NOT_ANIMATED);
+/******************************************************************************
+   Function: levels_need_pregenerating
 
-    // If it's a Pebble, simply add it to the player's inventory:
-    if (g_current_selection < FIRST_HEAVY_ITEM) {
-      g_player->pebbles[g_current_selection]++;
-      g_current_selection = get_inventory_row_for_pebble(g_current_selection);
-      show_window(INVENTORY_MENU, NOT_ANIMATED);
+Description: Determines whether any of the next NUM_PREGENERATED_LEVELS levels
+             below the player's depth have yet to be pregenerated by the
+             background worker.
 
-    // If it's a heavy item, attempt to add it to the player's inventory:
-    } else {
-      for (i = 0; i < MAX_HEAVY_ITEMS; ++i) {
-        heavy_item = &g_player->heavy_items[i];
-        if (heavy_item->type == NONE) {
-          init_heavy_item(heavy_item, g_current_selection);
-          g_current_selection = i + get_num_pebble_types_owned();
-          show_window(INVENTORY_MENU, NOT_ANIMATED);
+     Inputs: None.
 
-          return;
-        }
-      }
+    Outputs: "True" if there's work for the worker.
+******************************************************************************/
+bool levels_need_pregenerating(void) {
+  int8_t i;
+  const int8_t depth = g_player->int8_stats[DEPTH];
 
-      // If we reach this point, a heavy item must be dropped to add a new one:
-      show_window(HEAVY_ITEMS_MENU, NOT_ANIMATED);
-      show_narration(ENCUMBRANCE_NARRATION);
-    }
-  } else if (menu_layer == g_menu_layers[PEBBLE_OPTIONS_MENU]) {
-    if (cell_index->row == 0) {  // Equip
-      unequip_item_at(RIGHT_HAND);
-      g_player->equipped_pebble = g_current_selection;
-      g_current_selection = get_inventory_row_for_pebble(g_current_selection);
-      show_window(INVENTORY_MENU, NOT_ANIMATED);
-    } else {  // Infuse into Item
-      show_window(HEAVY_ITEMS_MENU, ANIMATED);
+  for (i = 1; i <= NUM_PREGENERATED_LEVELS && depth + i <= MAX_DEPTH; ++i) {
+    if (!level_is_pregenerated(g_player->run_seed, depth + i)) {
+      return true;
     }
-  } else if (menu_layer == g_menu_layers[HEAVY_ITEMS_MENU]) {
-    heavy_item = &g_player->heavy_items[cell_index->row];
+  }
 
-    // "Infuse item" mode:
-    if (g_current_selection < FIRST_HEAVY_ITEM) {
-      // Ensure the item isn't already infused:
-      if (heavy_item->infused_pebble == NONE) {
-        // Infuse the item:
-        if (heavy_item->equipped) {
-          unequip_heavy_item(heavy_item);
-          item_was_equipped = true;
-        }
-        heavy_item->infused_pebble = g_current_selection;
-        if (item_was_equipped) {
-          equip_heavy_item(heavy_item);
-        }
+  return false;
+}
 
-        // Remove the Pebble from the pool of equippable/infusable Pebbles:
-        g_player->pebbles[g_current_selection]--;
-        if (g_player->equipped_pebble == g_current_selection &&
-            g_player->pebbles[g_current_selection] == 0) {
-          g_player->equipped_pebble = NONE;
-        }
+/******************************************************************************
+   Function: request_pregenerated_levels
 
-        // Return to the inventory menu, centered on the newly-infused item:
-        g_current_selection = cell_index->row + get_num_pebble_types_owned();
-        show_window(INVENTORY_MENU, NOT_ANIMATED);
-      }
+Description: Asks the background worker to pregenerate the next
+             NUM_PREGENERATED_LEVELS levels below the player's depth (see
+             "pebble_quest_worker.c"), launching it if it isn't running. (If
+             those levels are already in storage, nothing is done.)
 
-    // "Replace item" mode:
-    } else {
-      // If the item to be replaced is equipped, unequip it:
-      old_item_equip_target = heavy_item->equip_target;
-      if (heavy_item->equipped) {
-        unequip_heavy_item(heavy_item);
-        item_was_equipped = true;
-      }
+     Inputs: None.
 
-      // Reinitialize the heavy item struct:
-      init_heavy_item(heavy_item, g_current_selection);
+    Outputs: None.
+******************************************************************************/
+void request_pregenerated_levels(void) {
+  AppWorkerMessage message = {
+    .data0 = g_player->run_seed & 0xFFFF,
+    .data1 = g_player->run_seed >> 16,
+    .data2 = g_player->int8_stats[DEPTH],
+  };
+
+  if (!levels_need_pregenerating()) {
+    return;
+  }
 
-      // If old item was equipped, equip new one if equip target is the same:
-      if (item_was_equipped &&
-          heavy_item->equip_target == old_item_equip_target) {
-        equip_heavy_item(heavy_item);
-      }
+  // A newly launched worker asks for the request once it's up:
+  if (!app_worker_is_running()) {
+    app_worker_launch();
+  }
+  app_worker_send_message(PREGENERATE_LEVELS_MESSAGE, &message);
+}
 
-      // Show inventory menu to provide an opportunity to adjust equipment:
-      window_stack_pop(NOT_ANIMATED);
-      g_current_selection = cell_index->row + get_num_pebble_types_owned();
-      show_window(INVENTORY_MENU, NOT_ANIMATED);
-    }
+/******************************************************************************
+   Function: worker_message_handler
 
-    // In either mode, we want to adjust minor stats:
-    set_player_minor_stats();
+Description: Handles messages from the background worker, which announces
+             itself on starting up so the app can tell it which levels to
+             pregenerate, and reports back when it's done. Once no levels are
+             left to pregenerate, the worker is stopped.
+
+     Inputs: type    - The message's type.
+             message - Pointer to the message's data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void worker_message_handler(uint16_t type, AppWorkerMessage *message) {
+  if (type == WORKER_STARTED_MESSAGE) {
+    request_pregenerated_levels();
+  } else if (type == LEVELS_PREGENERATED_MESSAGE &&
+             !levels_need_pregenerating()) {
+    app_worker_kill();
   }
 }
 
 /******************************************************************************
-   Function: menu_get_header_height_callback
+   Function: load_pregenerated_level
 
-Description: Returns the section height for a given section of a given menu.
+Description: Loads the resident window around the entrance of the location at
+             the player's depth, if the background worker has pregenerated it,
+             reapplies the location's map changes (if it's being revisited),
+             and gives the location its layout.
 
-     Inputs: menu_layer    - Pointer to the menu of interest.
-             section_index - Section number.
-             data          - Pointer to additional data (not used).
+     Inputs: None.
 
-    Outputs: The number of sections in the indicated menu.
+    Outputs: The direction the player faces on entering the location, or NONE
+             if no valid pregenerated level was found (in which case the
+             resident chunks must be reloaded).
 ******************************************************************************/
-static int16_t menu_get_header_height_callback(MenuLayer *menu_layer,
-                                               uint16_t section_index,
-                                               void *data) {
-  return MENU_CELL_BASIC_HEADER_HEIGHT;
+int8_t load_pregenerated_level(void) {
+  int8_t i, j;
+  GPoint chunk_position;
+  resident_chunk_t *resident_chunk;
+  pregenerated_level_t level;
+  map_chunk_t chunks[RESIDENT_CHUNKS_WIDE];
+  uint32_t checksum = CHECKSUM_BASIS;
+  const int8_t depth = g_player->int8_stats[DEPTH];
+  const uint32_t key = PREGENERATED_LEVEL_KEY(depth);
+
+  if (persist_read_data(key, &level, sizeof(level)) != sizeof(level) ||
+      level.depth != depth ||
+      level.seed != get_level_seed(g_player->run_seed, depth)) {
+    return NONE;
+  }
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    if (persist_read_data(key + 1 + i, chunks, sizeof(chunks)) !=
+          sizeof(chunks)) {
+      return NONE;
+    }
+    checksum = get_checksum(chunks, sizeof(chunks), checksum);
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      chunk_position = GPoint(CHUNK_COORDINATE(level.entrance.x) - 1 + j,
+                              CHUNK_COORDINATE(level.entrance.y) - 1 + i);
+      resident_chunk =
+        &g_resident_chunks[RESIDENT_CHUNK_SLOT(chunk_position.y)]
+                          [RESIDENT_CHUNK_SLOT(chunk_position.x)];
+      resident_chunk->chunk = chunks[j];
+      resident_chunk->position = chunk_position;
+      resident_chunk->generating = false;
+    }
+  }
+  if (checksum != level.checksum) {
+    return NONE;
+  }
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      apply_map_changes(&g_resident_chunks[i][j]);
+    }
+  }
+  g_location->floor_color_scheme = level.floor_color_scheme;
+  g_location->wall_color_scheme = level.wall_color_scheme;
+  g_location->entrance = level.entrance;
+  g_location->exit = level.exit;
+
+  return level.direction;
 }
 
 /******************************************************************************
-   Function: menu_get_num_rows_callback
+   Function: cache_level
+
+Description: Keeps the location the player is leaving in the level cache, as
+             its seed, map changes, and NPCs (minus their status effects), so
+             it can be restored if the player comes back. The least recently
+             left locations are dropped to make room, and their loot counts as
+             taken from then on (see "apply_map_changes"), since which of it
+             was taken is forgotten. The resident window is kept too, so that
+             going straight back needs no generation (see
+             "load_level_window"). Endless locations aren't kept, since their
+             changes aren't recorded.
 
-Description: Returns the number of rows in a given menu (or in a given section
-             of a given menu).
-
-     Inputs: menu_layer    - Pointer to the menu of interest.
-             section_index - Section number.
-             data          - Pointer to additional data (not used).
+     Inputs: None.
 
-    Outputs: The number of rows in the indicated menu.
+    Outputs: None.
 ******************************************************************************/
-static uint16_t menu_get_num_rows_callback(MenuLayer *menu_layer,
-                                           uint16_t section_index,
-                                           void *data) {
-  int8_t i, num_heavy_items = 0;
+void cache_level(void) {
+  int8_t i, depth;
+  const uint16_t num_map_changes = g_location->num_map_changes;
+  const uint8_t num_npcs = g_npcs->num_live_npcs;
+  cached_level_t *const level = &g_level_cache.levels[0];
 
-  // Get number of heavy items owned for inventory and heavy items menus:
-  for (i = 0; i < MAX_HEAVY_ITEMS; ++i) {
-    if (g_player->heavy_items[i].type > NONE) {
-      num_heavy_items++;
-    }
+  if (g_location->endless) {
+    return;
+  }
+  finish_task(CARVE_CHUNKS_TASK);  // So the resident window is complete.
+
+  // Drop the least recently left locations until there's room:
+  while (g_level_cache.num_levels == LEVEL_CACHE_SIZE ||
+         g_level_cache.num_map_changes + num_map_changes >
+           LEVEL_CACHE_CHANGES ||
+         g_level_cache.num_npcs + num_npcs > LEVEL_CACHE_NPCS) {
+    g_level_cache.num_levels--;
+    g_level_cache.num_map_changes -=
+      g_level_cache.levels[g_level_cache.num_levels].num_map_changes;
+    g_level_cache.num_npcs -=
+      g_level_cache.levels[g_level_cache.num_levels].num_npcs;
+    depth = g_level_cache.levels[g_level_cache.num_levels].depth;
+    g_level_cache.evicted_depths[depth / 8] |= 1 << depth % 8;
   }
 
-  if (menu_layer == g_menu_layers[INVENTORY_MENU]) {
-    return get_num_pebble_types_owned() + num_heavy_items;
-  } else if (menu_layer == g_menu_layers[HEAVY_ITEMS_MENU]) {
-    return num_heavy_items;
-  } else if (menu_layer == g_menu_layers[STATS_MENU]) {
-    return STATS_MENU_NUM_ROWS;
-  } else if (menu_layer == g_menu_layers[LOOT_MENU]) {
-    return LOOT_MENU_NUM_ROWS;
-  } else if (menu_layer == g_menu_layers[PEBBLE_OPTIONS_MENU]) {
-    return PEBBLE_OPTIONS_MENU_NUM_ROWS;
-  } else {  // MAIN_MENU or LEVEL_UP_MENU
-    return MAIN_MENU_NUM_ROWS;
+  // Put the location (and its map changes and NPCs) first:
+  memmove(level + 1, level, g_level_cache.num_levels * sizeof(cached_level_t));
+  memmove(&g_level_cache.map_changes[num_map_changes],
+          g_level_cache.map_changes,
+          g_level_cache.num_map_changes * sizeof(map_change_t));
+  memcpy(g_level_cache.map_changes,
+         g_location->map_changes,
+         num_map_changes * sizeof(map_change_t));
+  memmove(&g_level_cache.npcs[num_npcs],
+          g_level_cache.npcs,
+          g_level_cache.num_npcs * sizeof(saved_npc_t));
+  get_saved_npcs(g_level_cache.npcs);
+  for (i = 0; i < num_npcs; ++i) {
+    g_level_cache.npcs[i].status_effects = 0;  // (Their timers aren't kept.)
   }
+  level->seed = get_level_seed(g_player->run_seed,
+                               g_player->int8_stats[DEPTH]);
+  level->depth = g_player->int8_stats[DEPTH];
+  level->direction = g_player->direction;
+  level->position = g_player->position;
+  level->num_map_changes = num_map_changes;
+  level->num_npcs = num_npcs;
+  g_level_cache.num_levels++;
+  g_level_cache.num_map_changes += num_map_changes;
+  g_level_cache.num_npcs += num_npcs;
+  g_level_cache_is_dirty = true;
+
+  // Keep the resident window:
+  g_level_window.seed = level->seed;
+  g_level_window.depth = level->depth;
+  g_level_window.floor_color_scheme = g_location->floor_color_scheme;
+  g_level_window.wall_color_scheme = g_location->wall_color_scheme;
+  g_level_window.entrance = g_location->entrance;
+  g_level_window.exit = g_location->exit;
+  memcpy(g_level_window.chunks,
+         g_resident_chunks,
+         sizeof(g_resident_chunks));
 }
 
 /******************************************************************************
-   Function: draw_scene
+   Function: uncache_level
 
-Description: Draws a (simplistic) 3D scene based on the player's current
-             position, direction, and visibility depth.
+Description: Restores the map changes and NPCs of the location at the player's
+             depth, if it's in the level cache, and puts the player back where
+             they left it, facing the other way. The location is removed from
+             the cache (it's saved as the current location from now on).
+             Otherwise, the location has no map changes.
 
-     Inputs: layer - Pointer to the relevant layer.
-             ctx   - Pointer to the relevant graphics context.
+     Inputs: None.
 
-    Outputs: None.
+    Outputs: "True" if the location was in the cache.
 ******************************************************************************/
-void draw_scene(Layer *layer, GContext *ctx) {
-  int8_t i, depth, spell_beam_width, magic_type = NONE;
-  GPoint cell, cell_2;
-  npc_t *mage = &g_location->npcs[0];
-  heavy_item_t *weapon = get_heavy_item_equipped_at(RIGHT_HAND);
+bool uncache_level(void) {
+  uint8_t i, first_npc = 0;
+  uint16_t first_change = 0;
+  cached_level_t *level;
+  const int8_t depth = g_player->int8_stats[DEPTH];
+  const uint32_t seed = get_level_seed(g_player->run_seed, depth);
+
+  g_location->num_map_changes = 0;
+  for (i = 0; i < g_level_cache.num_levels; ++i) {
+    level = &g_level_cache.levels[i];
+    if (level->depth == depth && level->seed == seed) {
+      g_player->position = level->position;
+      g_player->direction = get_opposite_direction(level->direction);
+      g_location->num_map_changes = level->num_map_changes;
+      memcpy(g_location->map_changes,
+             &g_level_cache.map_changes[first_change],
+             level->num_map_changes * sizeof(map_change_t));
+      g_level_cache.num_map_changes -= level->num_map_changes;
+      memmove(&g_level_cache.map_changes[first_change],
+              &g_level_cache.map_changes[first_change +
+                                         level->num_map_changes],
+              (g_level_cache.num_map_changes - first_change) *
+                sizeof(map_change_t));
+      restore_npcs(&g_level_cache.npcs[first_npc], level->num_npcs);
+      g_level_cache.num_npcs -= level->num_npcs;
+      memmove(&g_level_cache.npcs[first_npc],
+              &g_level_cache.npcs[first_npc + level->num_npcs],
+              (g_level_cache.num_npcs - first_npc) * sizeof(saved_npc_t));
+      g_level_cache.num_levels--;
+      memmove(level,
+              level + 1,
+              (g_level_cache.num_levels - i) * sizeof(cached_level_t));
+      g_level_cache_is_dirty = true;
+
+      return true;
+    }
+    first_change += level->num_map_changes;
+    first_npc += level->num_npcs;
+  }
 
-  // First, draw the background, floor, and ceiling:
-  graphics_context_set_fill_color(ctx, GColorBlack);
-  graphics_fill_rect(ctx,
-                     FULL_SCREEN_FRAME,
-                     NO_CORNER_RADIUS,
-                     GCornerNone);
-  draw_floor_and_ceiling(ctx);
+  return false;
+}
 
-  // Now draw walls and cell contents:
-  for (depth = MAX_VISIBILITY_DEPTH - 2; depth >= 0; --depth) {
-    // Straight ahead at the current depth:
-    cell = get_cell_farther_away(g_player->position,
-                                 g_player->direction,
-                                 depth);
-    if (get_cell_type(cell) >= EMPTY) {
-      draw_cell_walls(ctx, cell, depth, STRAIGHT_AHEAD);
-      draw_cell_contents(ctx, cell, depth, STRAIGHT_AHEAD);
-    }
+/******************************************************************************
+   Function: load_level_window
 
-    // To the left and right at the same depth:
-    for (i = depth + 1; i > 0; --i) {
-      cell_2 = get_cell_farther_away(cell,
-                                get_direction_to_the_left(g_player->direction),
-                                i);
-      if (get_cell_type(cell_2) >= EMPTY) {
-        draw_cell_walls(ctx, cell_2, depth, STRAIGHT_AHEAD - i);
-        draw_cell_contents(ctx, cell_2, depth, STRAIGHT_AHEAD - i);
-      }
-      cell_2 = get_cell_farther_away(cell,
-                               get_direction_to_the_right(g_player->direction),
-                               i);
-      if (get_cell_type(cell_2) >= EMPTY) {
-        draw_cell_walls(ctx, cell_2, depth, STRAIGHT_AHEAD + i);
-        draw_cell_contents(ctx, cell_2, depth, STRAIGHT_AHEAD + i);
-      }
-    }
+Description: Restores the resident window kept on leaving the location at the
+             player's depth, if that was the last location the player left
+             (see "cache_level"), and gives the location its layout.
+
+     Inputs: None.
+
+    Outputs: "True" if a window was kept for the location.
+******************************************************************************/
+bool load_level_window(void) {
+  const int8_t depth = g_player->int8_stats[DEPTH];
+
+  if (g_level_window.depth != depth ||
+      g_level_window.seed != get_level_seed(g_player->run_seed, depth)) {
+    return false;
   }
+  memcpy(g_resident_chunks,
+         g_level_window.chunks,
+         sizeof(g_resident_chunks));
+  g_location->floor_color_scheme = g_level_window.floor_color_scheme;
+  g_location->wall_color_scheme = g_level_window.wall_color_scheme;
+  g_location->entrance = g_level_window.entrance;
+  g_location->exit = g_level_window.exit;
+
+  return true;
+}
 
-  // Draw the "attack slash," if applicable:
-  if (g_player_is_attacking) {
-    if (weapon) {
-      magic_type = weapon->infused_pebble;
-    }
-    for (i = 0; i < 3; ++i) {
-      if (magic_type > NONE) {
-        graphics_context_set_stroke_color(ctx,
-                                      g_magic_type_colors[magic_type][i == 2]);
-      } else {
-        graphics_context_set_stroke_color(ctx, i < 2 ? GColorLightGray :
-                                                       GColorDarkGray);
+/******************************************************************************
+   Function: generate_endless_chunk
+
+Description: Generates the endless map chunk at a given set of chunk
+             coordinates from the level seed: corridors join a door on
+             each edge (shared with the neighboring chunk, so every chunk is
+             reachable) to a central hub, sometimes with a room, loot, or an
+             exit. The same chunk always comes out the same way.
+
+     Inputs: chunk          - Pointer to the (solid) chunk to be filled in.
+             chunk_position - Chunk coordinates of the chunk.
+
+    Outputs: None.
+******************************************************************************/
+void generate_endless_chunk(map_chunk_t *const chunk,
+                            const GPoint chunk_position) {
+  int8_t i, j, radius, type = EMPTY;
+  const GPoint world_chunk =
+    GPoint(g_location->chunk_offset.x + chunk_position.x,
+           g_location->chunk_offset.y + chunk_position.y);
+  uint32_t state = get_endless_hash(world_chunk, NUM_DIRECTIONS);
+  GPoint hub, stub_end;
+
+  hub.x = ENDLESS_DOOR_MARGIN +
+          get_seeded_random(&state) % (CHUNK_SIZE - 2 * ENDLESS_DOOR_MARGIN);
+  hub.y = ENDLESS_DOOR_MARGIN +
+          get_seeded_random(&state) % (CHUNK_SIZE - 2 * ENDLESS_DOOR_MARGIN);
+
+  // Connect each door to the hub:
+  carve_endless_corridor(chunk,
+                         GPoint(get_endless_door(world_chunk, NORTH), 0),
+                         hub,
+                         get_seeded_random(&state) % 2);
+  carve_endless_corridor(chunk,
+                         GPoint(get_endless_door(world_chunk, SOUTH),
+                                CHUNK_SIZE - 1),
+                         hub,
+                         get_seeded_random(&state) % 2);
+  carve_endless_corridor(chunk,
+                         GPoint(0, get_endless_door(world_chunk, WEST)),
+                         hub,
+                         get_seeded_random(&state) % 2);
+  carve_endless_corridor(chunk,
+                         GPoint(CHUNK_SIZE - 1,
+                                get_endless_door(world_chunk, EAST)),
+                         hub,
+                         get_seeded_random(&state) % 2);
+
+  // Add a room around the hub:
+  if (get_seeded_random(&state) % ENDLESS_ROOM_ODDS == 0) {
+    radius = 1 + get_seeded_random(&state) % MAX_ENDLESS_ROOM_RADIUS;
+    for (i = hub.x - radius; i <= hub.x + radius; ++i) {
+      for (j = hub.y - radius; j <= hub.y + radius; ++j) {
+        if (i > 0 && i < CHUNK_SIZE - 1 && j > 0 && j < CHUNK_SIZE - 1) {
+          set_chunk_cell_type(chunk, GPoint(i, j), EMPTY);
+        }
       }
-      graphics_draw_line(ctx,
-                         GPoint(g_attack_slash_x1 + i, g_attack_slash_y1),
-                         GPoint(g_attack_slash_x2 + i, g_attack_slash_y2));
-      graphics_draw_line(ctx,
-                         GPoint(g_attack_slash_x1 - i, g_attack_slash_y1),
-                         GPoint(g_attack_slash_x2 - i, g_attack_slash_y2));
     }
   }
 
-  // Draw "spell beams," if applicable:
-  if (g_player_current_spell_animation > 0) {
-    spell_beam_width = g_player_current_spell_animation % 2 ?
-                         MIN_SPELL_BEAM_BASE_WIDTH          :
-                         MAX_SPELL_BEAM_BASE_WIDTH;
-    magic_type = g_player->equipped_pebble;
-    graphics_context_set_stroke_color(ctx, g_magic_type_colors[magic_type][0]);
-    graphics_draw_line(ctx,
-                       GPoint(SCREEN_CENTER_POINT_X,
-                              GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                       GPoint(SCREEN_CENTER_POINT.x,
-                              SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-    for (i = 0; i <= spell_beam_width; ++i) {
-      graphics_context_set_stroke_color(ctx,
-                                       g_magic_type_colors[magic_type][i % 2]);
-      graphics_draw_line(ctx,
-                         GPoint(SCREEN_CENTER_POINT_X - i,
-                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                         GPoint(SCREEN_CENTER_POINT_X - i / 3,
-                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-      graphics_draw_line(ctx,
-                         GPoint(SCREEN_CENTER_POINT_X + i,
-                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                         GPoint(SCREEN_CENTER_POINT_X + i / 3,
-                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-    }
+  // Add a dead end, possibly with loot or an exit at the end of it (unless
+  // it ends on an existing passage, which an exit could block):
+  stub_end.x = 1 + get_seeded_random(&state) % (CHUNK_SIZE - 2);
+  stub_end.y = 1 + get_seeded_random(&state) % (CHUNK_SIZE - 2);
+  if (get_seeded_random(&state) % ENDLESS_EXIT_ODDS == 0 &&
+      g_player->int8_stats[DEPTH] < MAX_DEPTH) {
+    type = EXIT;
+  } else if (get_seeded_random(&state) % ENDLESS_LOOT_ODDS == 0) {
+    type = FIRST_HEAVY_ITEM +
+           get_seeded_random(&state) % NUM_HEAVY_ITEM_TYPES;
   }
-  if (g_enemy_current_spell_animation > 0) {
-    cell = g_player->position;
-    cell_2 = mage->position;
-    if (((cell.x == cell_2.x) &&
-         ((cell.y < cell_2.y && g_player->direction == SOUTH) ||
-          (cell.y > cell_2.y && g_player->direction == NORTH))) ||
-        ((cell.y == cell_2.y) &&
-         ((cell.x < cell_2.x && g_player->direction == EAST) ||
-          (cell.x > cell_2.x && g_player->direction == WEST)))) {
-      spell_beam_width = g_enemy_current_spell_animation % 2 ?
-                           MIN_SPELL_BEAM_BASE_WIDTH         :
-                           MAX_SPELL_BEAM_BASE_WIDTH;
-      magic_type = mage->item;
-      graphics_context_set_stroke_color(ctx,
-                                        g_magic_type_colors[magic_type][0]);
-      graphics_draw_line(ctx,
-                         GPoint(SCREEN_CENTER_POINT_X,
-                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                         GPoint(SCREEN_CENTER_POINT.x,
-                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-      for (i = 0; i <= spell_beam_width; ++i) {
-        graphics_context_set_stroke_color(ctx,
-                                          g_magic_type_colors[magic_type]
-                                                             [i % 2]);
-        graphics_draw_line(ctx,
-                           GPoint(SCREEN_CENTER_POINT_X - i,
-                                  GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                           GPoint(SCREEN_CENTER_POINT_X - i / 3,
-                                  SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-        graphics_draw_line(ctx,
-                           GPoint(SCREEN_CENTER_POINT_X + i,
-                                  GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
-                           GPoint(SCREEN_CENTER_POINT_X + i / 3,
-                                  SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
-      }
-    }
+  if (get_chunk_cell_type(chunk, stub_end) != SOLID) {
+    type = EMPTY;
   }
+  carve_endless_corridor(chunk,
+                         hub,
+                         stub_end,
+                         get_seeded_random(&state) % 2);
+  set_chunk_cell_type(chunk, stub_end, type);
+}
 
-  // Draw health meter:
-  draw_status_meter(ctx,
-                    GPoint(STATUS_METER_PADDING,
-                           GRAPHICS_FRAME_HEIGHT + STATUS_METER_PADDING +
-                             STATUS_BAR_HEIGHT),
-                    (float) g_player->int16_stats[CURRENT_HEALTH] /
-                      g_player->int16_stats[MAX_HEALTH]);
+/******************************************************************************
+   Function: get_endless_door
 
-  // Draw energy meter:
-  draw_status_meter(ctx,
-                    GPoint(SCREEN_CENTER_POINT_X + STATUS_METER_PADDING +
-                             COMPASS_RADIUS + 1,
-                           GRAPHICS_FRAME_HEIGHT + STATUS_METER_PADDING +
-                             STATUS_BAR_HEIGHT),
-                    (float) g_player->int16_stats[CURRENT_ENERGY] /
-                      g_player->int16_stats[MAX_ENERGY]);
+Description: Returns the position of the door along a given edge of a given
+             endless map chunk. (Neighboring chunks derive a shared edge's
+             door from the same hash, so their doors line up.)
 
-  // Draw compass:
-  graphics_context_set_fill_color(ctx, GColorLightGray);
-  graphics_context_set_stroke_color(ctx, GColorDarkGreen);
-  graphics_fill_circle(ctx,
-                       GPoint(SCREEN_CENTER_POINT_X,
-                              GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT / 2 +
-                                STATUS_BAR_HEIGHT),
-                       COMPASS_RADIUS);
-  graphics_context_set_fill_color(ctx, GColorBlack);
-  gpath_draw_outline(ctx, g_compass_path);
-  gpath_draw_filled(ctx, g_compass_path);
+     Inputs: world_chunk - Endless world coordinates of the chunk.
+             direction   - The edge of interest.
 
-  // Finally, ensure the backlight is on:
-  light_enable_interaction();
+    Outputs: Offset of the door's cell along the edge.
+******************************************************************************/
+int8_t get_endless_door(const GPoint world_chunk, const int8_t direction) {
+  GPoint edge_owner = world_chunk;  // Chunk whose north/west edge it is.
+  int8_t salt = direction;
+
+  if (direction == SOUTH) {
+    edge_owner.y++;
+    salt = NORTH;
+  } else if (direction == EAST) {
+    edge_owner.x++;
+    salt = WEST;
+  }
+
+  return ENDLESS_DOOR_MARGIN + get_endless_hash(edge_owner, salt) %
+                                 (CHUNK_SIZE - 2 * ENDLESS_DOOR_MARGIN);
 }
 
 /******************************************************************************
-   Function: draw_floor_and_ceiling
+   Function: carve_endless_corridor
 
-Description: Draws the floor and ceiling.
+Description: Carves an L-shaped corridor of EMPTY cells between two cells of a
+             given map chunk.
 
-     Inputs: ctx - Pointer to the relevant graphics context.
+     Inputs: chunk          - Pointer to the chunk of interest.
+             from           - Chunk-relative coordinates of the first cell.
+             to             - Chunk-relative coordinates of the second cell.
+             vertical_first - If "true", the corridor runs north/south before
+                              turning east/west.
 
     Outputs: None.
 ******************************************************************************/
-void draw_floor_and_ceiling(GContext *ctx) {
-  uint8_t x, y, max_y, shading_offset;
-
-  max_y = g_back_wall_coords[MAX_VISIBILITY_DEPTH - 2][0][TOP_LEFT].y;
-  for (y = 0; y < max_y; ++y) {
-    // Determine horizontal distance between points:
-    shading_offset = 1 + y / MAX_VISIBILITY_DEPTH;
-    if (y % MAX_VISIBILITY_DEPTH >= MAX_VISIBILITY_DEPTH / 2 +
-                                    MAX_VISIBILITY_DEPTH % 2) {
-      shading_offset++;
-    }
-    graphics_context_set_stroke_color(ctx,
-      g_background_colors[g_location->floor_color_scheme]
-                         [shading_offset > NUM_BACKGROUND_COLORS_PER_SCHEME ?
-                            NUM_BACKGROUND_COLORS_PER_SCHEME - 1            :
-                            shading_offset - 1]);
-    for (x = y % 2 ? 0 : (shading_offset / 2) + (shading_offset % 2);
-         x < GRAPHICS_FRAME_WIDTH;
-         x += shading_offset) {
-      // Draw one point on the ceiling and another on the floor:
-      graphics_draw_pixel(ctx, GPoint(x, y + STATUS_BAR_HEIGHT));
-      graphics_draw_pixel(ctx, GPoint(x, GRAPHICS_FRAME_HEIGHT - y +
-                                           STATUS_BAR_HEIGHT));
+void carve_endless_corridor(map_chunk_t *const chunk,
+                            GPoint from,
+                            const GPoint to,
+                            const bool vertical_first) {
+  set_chunk_cell_type(chunk, from, EMPTY);
+  while (!gpoint_equal(&from, &to)) {
+    if (from.x == to.x || (vertical_first && from.y != to.y)) {
+      from.y += from.y < to.y ? 1 : -1;
+    } else {
+      from.x += from.x < to.x ? 1 : -1;
     }
+    set_chunk_cell_type(chunk, from, EMPTY);
   }
 }
 
 /******************************************************************************
-   Function: draw_cell_walls
+   Function: get_endless_hash
 
-Description: Draws any walls that exist along the back and sides of a given
-             cell.
+Description: Hashes a given endless map chunk's coordinates, together with the
+             level seed and a given salt. (Coordinates wrap around at
+             16 bits, so the endless world is a very large torus.)
 
-     Inputs: ctx      - Pointer to the relevant graphics context.
-             cell     - Coordinates of the cell of interest.
-             depth    - Front-back visual depth of the cell of interest in
-                        "g_back_wall_coords".
-             position - Left-right visual position of the cell of interest in
-                        "g_back_wall_coords".
+     Inputs: world_chunk - Endless world coordinates of the chunk.
+             salt        - Distinguishes different uses of the same chunk.
+
+    Outputs: A pseudorandom 32-bit value.
+******************************************************************************/
+uint32_t get_endless_hash(const GPoint world_chunk, const uint8_t salt) {
+  return get_hash((get_level_seed(g_player->run_seed,
+                                  g_player->int8_stats[DEPTH]) +
+                   salt * 0x9E3779B9) ^
+                  ((uint32_t) (uint16_t) world_chunk.x << 16 |
+                   (uint16_t) world_chunk.y));
+}
+
+#ifdef MAP_STREAMING_STATS
+/******************************************************************************
+   Function: report_map_memory
+
+Description: Logs how much memory the resident map data uses, compared with
+             keeping the whole map (and its per-cell caches) resident, and how
+             much memory and persistent storage the level cache uses (header,
+             map changes, and NPCs). (Compile with "-DMAP_STREAMING_STATS".)
+
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void draw_cell_walls(GContext *ctx,
-                     const GPoint cell,
-                     const int8_t depth,
-                     const int8_t position) {
-  int16_t left, right, top, bottom, y_offset;
-  bool back_wall_drawn, left_wall_drawn, right_wall_drawn;
-  GPoint cell_2;
+void report_map_memory(void) {
+  const int resident_bytes = sizeof(g_resident_chunks) +
+                             sizeof(g_window_solid_rows) +
+                             sizeof(g_window_solid_columns) +
+                             sizeof(g_window_blocked_rows) +
+                             sizeof(g_window_passable_rows) +
+                             sizeof(g_npc_grid) +
+                             sizeof(g_flow_field) +
+                             sizeof(g_flow_field_queue),
+            per_cell_bytes = sizeof(g_npc_grid[0][0]) +
+                             sizeof(g_flow_field[0][0]) +
+                             sizeof(g_flow_field_queue[0]);
+
+  APP_LOG(APP_LOG_LEVEL_DEBUG,
+          "Map memory: %dx%d map, %d bytes resident (%dx%d window), "
+            "%d bytes if fully resident",
+          MAP_WIDTH,
+          MAP_HEIGHT,
+          resident_bytes,
+          WINDOW_SIZE,
+          WINDOW_SIZE,
+          (int) (NUM_MAP_CHUNKS * sizeof(map_chunk_t) +
+                 MAP_WIDTH * MAP_HEIGHT * per_cell_bytes));
+  APP_LOG(APP_LOG_LEVEL_DEBUG,
+          "Level cache: %d/%d levels, %d/%d map changes, %d/%d NPCs, "
+            "%d bytes resident, %d bytes saved (at most %d)",
+          g_level_cache.num_levels,
+          LEVEL_CACHE_SIZE,
+          g_level_cache.num_map_changes,
+          LEVEL_CACHE_CHANGES,
+          g_level_cache.num_npcs,
+          LEVEL_CACHE_NPCS,
+          (int) (sizeof(g_level_cache) + sizeof(g_level_window)),
+          (int) (offsetof(level_cache_t, map_changes) +
+                 g_level_cache.num_map_changes * sizeof(map_change_t) +
+                 g_level_cache.num_npcs * sizeof(saved_npc_t)),
+          (int) sizeof(level_cache_t));
+}
+#endif
 
-  // Back wall:
-  left = g_back_wall_coords[depth][position][TOP_LEFT].x;
-  right = g_back_wall_coords[depth][position][BOTTOM_RIGHT].x;
-  top = g_back_wall_coords[depth][position][TOP_LEFT].y;
-  bottom = g_back_wall_coords[depth][position][BOTTOM_RIGHT].y;
-  if (bottom - top < MIN_WALL_HEIGHT) {
-    return;
-  }
-  back_wall_drawn = left_wall_drawn = right_wall_drawn = false;
-  cell_2 = get_cell_farther_away(cell, g_player->direction, 1);
-  if (get_cell_type(cell_2) <= SOLID) {
-    draw_shaded_quad(ctx,
-                     GPoint(left, top + STATUS_BAR_HEIGHT),
-                     GPoint(left, bottom + STATUS_BAR_HEIGHT),
-                     GPoint(right, top + STATUS_BAR_HEIGHT),
-                     GPoint(right, bottom + STATUS_BAR_HEIGHT),
-                     GPoint(left, top + STATUS_BAR_HEIGHT));
-    graphics_context_set_stroke_color(ctx, GColorBlack);
-    graphics_draw_line(ctx,
-                       GPoint(left, top + STATUS_BAR_HEIGHT),
-                       GPoint(right, top + STATUS_BAR_HEIGHT));
-    graphics_draw_line(ctx,
-                       GPoint(left, bottom + STATUS_BAR_HEIGHT),
-                       GPoint(right, bottom + STATUS_BAR_HEIGHT));
+/******************************************************************************
+   Function: get_npc_at
 
-    // Ad hoc solution to a minor visual issue (remove if no longer relevant):
-    if (top == g_back_wall_coords[1][0][TOP_LEFT].y) {
-      graphics_draw_line(ctx,
-                         GPoint(left, bottom + 1 + STATUS_BAR_HEIGHT),
-                         GPoint(right, bottom + 1 + STATUS_BAR_HEIGHT));
-    }
+Description: Returns the index of the NPC occupying a given cell.
 
-    back_wall_drawn = true;
+     Inputs: cell - Coordinates of the cell of interest.
+
+    Outputs: Index of the NPC occupying the indicated cell, or NONE if there is
+             none.
+******************************************************************************/
+int8_t get_npc_at(const GPoint cell) {
+  if (cell_is_in_window(cell)) {
+    return g_npc_grid[WINDOW_X(cell)][WINDOW_Y(cell)];
   }
 
-  // Left wall:
-  right = left;
-  if (depth == 0) {
-    left = 0;
-    y_offset = top;
-  } else {
-    left = g_back_wall_coords[depth - 1][position][TOP_LEFT].x;
-    y_offset = top - g_back_wall_coords[depth - 1][position][TOP_LEFT].y;
+  return NONE;
+}
+
+/******************************************************************************
+   Function: set_npc_position
+
+Description: Moves a given (living) NPC to a given cell, keeping the NPC grid
+             up to date.
+
+     Inputs: npc      - Index of the NPC of interest.
+             position - Coordinates of the NPC's new cell.
+
+    Outputs: None.
+******************************************************************************/
+void set_npc_position(const int8_t npc, const GPoint position) {
+  GPoint *const old_position = &g_npcs->positions[npc];
+
+  if (get_npc_at(*old_position) == npc) {
+    g_npc_grid[WINDOW_X(*old_position)][WINDOW_Y(*old_position)] = NONE;
   }
-  if (position <= STRAIGHT_AHEAD) {
-    cell_2 = get_cell_farther_away(cell,
-                                get_direction_to_the_left(g_player->direction),
-                                1);
-    if (get_cell_type(cell_2) <= SOLID) {
-      draw_shaded_quad(ctx,
-                       GPoint(left, top - y_offset + STATUS_BAR_HEIGHT),
-                       GPoint(left, bottom + y_offset + STATUS_BAR_HEIGHT),
-                       GPoint(right, top + STATUS_BAR_HEIGHT),
-                       GPoint(right, bottom + STATUS_BAR_HEIGHT),
-                       GPoint(left, top - y_offset + STATUS_BAR_HEIGHT));
-      graphics_context_set_stroke_color(ctx, GColorBlack);
-      graphics_draw_line(ctx,
-                         GPoint(left, top - y_offset + STATUS_BAR_HEIGHT),
-                         GPoint(right, top + STATUS_BAR_HEIGHT));
-      graphics_draw_line(ctx,
-                         GPoint(left, bottom + y_offset + STATUS_BAR_HEIGHT),
-                         GPoint(right, bottom + STATUS_BAR_HEIGHT));
-      left_wall_drawn = true;
-    }
+  *old_position = position;
+  if (cell_is_in_window(position)) {
+    g_npc_grid[WINDOW_X(position)][WINDOW_Y(position)] = npc;
   }
+}
 
-  // Right wall:
-  left = g_back_wall_coords[depth][position][BOTTOM_RIGHT].x;
-  if (depth == 0) {
-    right = GRAPHICS_FRAME_WIDTH - 1;
-  } else {
-    right = g_back_wall_coords[depth - 1][position][BOTTOM_RIGHT].x;
+/******************************************************************************
+   Function: remove_npc
+
+Description: Removes a given NPC from the current location, clearing its status
+             effects and NPC grid cell and returning it to the NPC pool's free
+             list. (Its other stats are left intact.)
+
+     Inputs: npc - Index of the NPC to be removed.
+
+    Outputs: None.
+******************************************************************************/
+void remove_npc(const int8_t npc) {
+  int8_t last_npc;
+  GPoint *const position = &g_npcs->positions[npc];
+
+  if (g_npcs->types[npc] == NONE) {
+    return;
   }
-  if (position >= STRAIGHT_AHEAD) {
-    cell_2 = get_cell_farther_away(cell,
-                               get_direction_to_the_right(g_player->direction),
-                               1);
-    if (get_cell_type(cell_2) <= SOLID) {
-      draw_shaded_quad(ctx,
-                       GPoint(left, top + STATUS_BAR_HEIGHT),
-                       GPoint(left, bottom + STATUS_BAR_HEIGHT),
-                       GPoint(right, top - y_offset + STATUS_BAR_HEIGHT),
-                       GPoint(right, bottom + y_offset + STATUS_BAR_HEIGHT),
-                       GPoint(left, top + STATUS_BAR_HEIGHT));
-      graphics_context_set_stroke_color(ctx, GColorBlack);
-      graphics_draw_line(ctx,
-                         GPoint(left, top + STATUS_BAR_HEIGHT),
-                         GPoint(right, top - y_offset + STATUS_BAR_HEIGHT));
-      graphics_draw_line(ctx,
-                         GPoint(left, bottom + STATUS_BAR_HEIGHT),
-                         GPoint(right, bottom + y_offset + STATUS_BAR_HEIGHT));
-      right_wall_drawn = true;
-    }
+  clear_status_effects(npc);
+  if (get_npc_at(*position) == npc) {
+    g_npc_grid[WINDOW_X(*position)][WINDOW_Y(*position)] = NONE;
   }
+  g_npcs->types[npc] = NONE;
 
-  // Draw vertical lines at corners:
-  graphics_context_set_stroke_color(ctx, GColorBlack);
-  cell_2 = get_cell_farther_away(cell, g_player->direction, 1);
-  if ((back_wall_drawn && (left_wall_drawn ||
-       get_cell_type(get_cell_farther_away(cell_2,
-                                get_direction_to_the_left(g_player->direction),
-                                1)) >= EMPTY)) ||
-      (left_wall_drawn &&
-       get_cell_type(get_cell_farther_away(cell_2,
-                                get_direction_to_the_left(g_player->direction),
-                                1)) >= EMPTY)) {
-    graphics_draw_line(ctx,
-                       GPoint(g_back_wall_coords[depth][position][TOP_LEFT].x,
-                              g_back_wall_coords[depth][position][TOP_LEFT].y +
-                                STATUS_BAR_HEIGHT),
-                       GPoint(g_back_wall_coords[depth][position][TOP_LEFT].x,
-                          g_back_wall_coords[depth][position][BOTTOM_RIGHT].y +
-                            STATUS_BAR_HEIGHT));
-  }
-  if ((back_wall_drawn && (right_wall_drawn ||
-       get_cell_type(get_cell_farther_away(cell_2,
-                               get_direction_to_the_right(g_player->direction),
-                               1)) >= EMPTY)) ||
-      (right_wall_drawn &&
-       get_cell_type(get_cell_farther_away(cell_2,
-                               get_direction_to_the_right(g_player->direction),
-                               1)) >= EMPTY)) {
-    graphics_draw_line(ctx,
-                    GPoint(g_back_wall_coords[depth][position][BOTTOM_RIGHT].x,
-                          g_back_wall_coords[depth][position][BOTTOM_RIGHT].y +
-                            STATUS_BAR_HEIGHT),
-                    GPoint(g_back_wall_coords[depth][position][BOTTOM_RIGHT].x,
-                           g_back_wall_coords[depth][position][TOP_LEFT].y +
-                             STATUS_BAR_HEIGHT));
+  // Move the last living NPC into the removed NPC's slot in the dense list
+  // (after moving the removed NPC out of the active part of the list):
+  if (g_npcs->live_npc_slots[npc] < g_npcs->num_active_npcs) {
+    swap_live_npcs(g_npcs->live_npc_slots[npc], --g_npcs->num_active_npcs);
   }
+  last_npc = g_npcs->live_npcs[--g_npcs->num_live_npcs];
+  g_npcs->live_npcs[g_npcs->live_npc_slots[npc]] = last_npc;
+  g_npcs->live_npc_slots[last_npc] = g_npcs->live_npc_slots[npc];
+  g_npcs->free_npcs[g_npcs->num_free_npcs++] = npc;
 }
 
 /******************************************************************************
-   Function: draw_cell_contents
+   Function: swap_live_npcs
 
-Description: Draws an NPC or any other contents present in a given cell.
+Description: Swaps the NPCs at two given slots of the NPC pool's live list.
 
-     Inputs: ctx      - Pointer to the relevant graphics context.
-             cell     - Coordinates of the cell of interest.
-             depth    - Front-back visual depth of the cell of interest in
-                        "g_back_wall_coords".
-             position - Left-right visual position of the cell of interest in
-                        "g_back_wall_coords".
+     Inputs: slot_1 - Index of the first slot.
+             slot_2 - Index of the second slot.
 
     Outputs: None.
 ******************************************************************************/
-void draw_cell_contents(GContext *ctx,
-                        const GPoint cell,
-                        const int8_t depth,
-                        const int8_t position) {
-  uint8_t drawing_unit;  // Reference variable for drawing contents at depth.
-  int16_t i, x_midpoint1, x_midpoint2;
-  GPoint floor_center_point, top_left_point;
-  npc_t *npc = get_npc_at(cell);
-
-  // Determine the drawing unit and top left point:
-  drawing_unit = (g_back_wall_coords[depth][position][BOTTOM_RIGHT].x -
-                  g_back_wall_coords[depth][position][TOP_LEFT].x) / 10;
-  if ((g_back_wall_coords[depth][position][BOTTOM_RIGHT].x -
-       g_back_wall_coords[depth][position][TOP_LEFT].x) % 10 >= 5) {
-    drawing_unit++;
-  }
-  top_left_point = g_back_wall_coords[depth][position][TOP_LEFT];
-
-  // Determine floor center point:
-  x_midpoint1 = (top_left_point.x +
-                 g_back_wall_coords[depth][position][BOTTOM_RIGHT].x) / 2;
-  if (depth == 0) {
-    if (position < STRAIGHT_AHEAD) {  // To the left of the player.
-      x_midpoint2 = GRAPHICS_FRAME_WIDTH / -2;
-    } else if (position > STRAIGHT_AHEAD) {  // To the right of the player.
-      x_midpoint2 = GRAPHICS_FRAME_WIDTH + GRAPHICS_FRAME_WIDTH / 2;
-    } else {  // Directly under the player.
-      x_midpoint2 = x_midpoint1;
-    }
-    floor_center_point.y = GRAPHICS_FRAME_HEIGHT;
-  } else {
-    x_midpoint2 =
-      (g_back_wall_coords[depth - 1][position][TOP_LEFT].x +
-       g_back_wall_coords[depth - 1][position][BOTTOM_RIGHT].x) / 2;
-    floor_center_point.y =
-      (g_back_wall_coords[depth][position][BOTTOM_RIGHT].y +
-       g_back_wall_coords[depth - 1][position][BOTTOM_RIGHT].y) / 2;
+void swap_live_npcs(const int8_t slot_1, const int8_t slot_2) {
+  const int8_t npc_1 = g_npcs->live_npcs[slot_1],
+               npc_2 = g_npcs->live_npcs[slot_2];
+
+  g_npcs->live_npcs[slot_1] = npc_2;
+  g_npcs->live_npc_slots[npc_2] = slot_1;
+  g_npcs->live_npcs[slot_2] = npc_1;
+  g_npcs->live_npc_slots[npc_1] = slot_2;
+}
+
+/******************************************************************************
+   Function: npc_is_near_player
+
+Description: Determines whether a given NPC lies within NPC_ACTIVITY_RADIUS
+             cells (horizontally plus vertically) of the player.
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: "True" if the NPC should be active.
+******************************************************************************/
+bool npc_is_near_player(const int8_t npc) {
+  return abs(g_npcs->positions[npc].x - g_player->position.x) +
+           abs(g_npcs->positions[npc].y - g_player->position.y) <=
+         NPC_ACTIVITY_RADIUS;
+}
+
+/******************************************************************************
+   Function: npc_is_within_sight_distance
+
+Description: Determines whether a given NPC lies within MAX_SIGHT_DISTANCE
+             cells (horizontally plus vertically) of the player.
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: "True" if the NPC is near enough to see the player.
+******************************************************************************/
+bool npc_is_within_sight_distance(const int8_t npc) {
+  return abs(g_npcs->positions[npc].x - g_player->position.x) +
+           abs(g_npcs->positions[npc].y - g_player->position.y) <=
+         MAX_SIGHT_DISTANCE;
+}
+
+/******************************************************************************
+   Function: put_npc_to_sleep
+
+Description: Makes a given NPC dormant, moving it out of the active part of
+             the live list and noting when it fell asleep. (Dormant NPCs don't
+             act or suffer damage over time until they wake up.)
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: None.
+******************************************************************************/
+void put_npc_to_sleep(const int8_t npc) {
+  if (g_npcs->live_npc_slots[npc] < g_npcs->num_active_npcs) {
+    swap_live_npcs(g_npcs->live_npc_slots[npc], --g_npcs->num_active_npcs);
   }
-  floor_center_point.x = (x_midpoint1 + x_midpoint2) / 2;
-  floor_center_point.y += STATUS_BAR_HEIGHT;
-  top_left_point.y += STATUS_BAR_HEIGHT;
+  g_npcs->dormant_since_steps[npc] = g_simulation_step;
+  g_npcs->dormant_damage_over_time[npc] =
+    get_status_effect(npc, DAMAGE_OVER_TIME);
+}
 
-  // Check for an entrance (hole in the ceiling):
-  if (gpoint_equal(&cell, &g_location->entrance)) {
-    fill_ellipse(ctx,
-                 GPoint(floor_center_point.x,
-                        GRAPHICS_FRAME_HEIGHT - floor_center_point.y +
-                          STATUS_BAR_HEIGHT * 2),
-                 ELLIPSE_RADIUS_RATIO *
-                   (g_back_wall_coords[depth][position][BOTTOM_RIGHT].x -
-                    top_left_point.x),
-                 depth == 0 ?
-                   ELLIPSE_RADIUS_RATIO *
-                    (GRAPHICS_FRAME_HEIGHT -
-                     g_back_wall_coords[depth][position][BOTTOM_RIGHT].y) :
-                   ELLIPSE_RADIUS_RATIO *
-                     (g_back_wall_coords[depth - 1][position][BOTTOM_RIGHT].y -
-                      g_back_wall_coords[depth][position][BOTTOM_RIGHT].y),
-                 GColorBlack);
+/******************************************************************************
+   Function: wake_npc
+
+Description: Makes a given dormant NPC active again. The damage over time it
+             would have suffered while dormant is totaled in closed form and
+             applied just before it next acts. (Its status effects kept
+             running down on the status wheel in the meantime.)
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: None.
+******************************************************************************/
+void wake_npc(const int8_t npc) {
+  int16_t remaining = g_npcs->dormant_damage_over_time[npc],
+          num_intervals,
+          damage;
+
+  if (g_npcs->live_npc_slots[npc] >= g_npcs->num_active_npcs) {
+    swap_live_npcs(g_npcs->live_npc_slots[npc], g_npcs->num_active_npcs++);
+  }
+  g_npcs->next_think_steps[npc] = NPC_FIRST_THINK_STEP(npc);
+
+  // Count the missed intervals (at multiples of STATUS_EFFECT_INTERVAL),
+  // each dealing half the effect's remaining duration (or minimum damage):
+  num_intervals = (g_simulation_step + STATUS_EFFECT_INTERVAL - 1) /
+                    STATUS_EFFECT_INTERVAL -
+                  (g_npcs->dormant_since_steps[npc] +
+                     STATUS_EFFECT_INTERVAL - 1) / STATUS_EFFECT_INTERVAL;
+  if (num_intervals > remaining) {
+    num_intervals = remaining;
   }
+  if (num_intervals > 0) {
+    damage = g_npcs->pending_damage[npc] +
+             remaining * remaining / 4 -
+             (remaining - num_intervals) * (remaining - num_intervals) / 4 +
+             (num_intervals == remaining ? MIN_DAMAGE_TO_NPC : 0);
+    g_npcs->pending_damage[npc] = damage > INT8_MAX ? INT8_MAX : damage;
+  }
+}
 
-  // Check for an exit (hole in the ground) or a shadow cast by loot/NPC:
-  if (npc || get_cell_type(cell) >= EXIT) {
-    fill_ellipse(ctx,
-                 GPoint(floor_center_point.x, floor_center_point.y),
-                 ELLIPSE_RADIUS_RATIO *
-                   (g_back_wall_coords[depth][position][BOTTOM_RIGHT].x -
-                    top_left_point.x),
-                 depth == 0 ?
-                   ELLIPSE_RADIUS_RATIO *
-                    (GRAPHICS_FRAME_HEIGHT -
-                     g_back_wall_coords[depth][position][BOTTOM_RIGHT].y) :
-                   ELLIPSE_RADIUS_RATIO *
-                      (g_back_wall_coords[depth - 1][position][BOTTOM_RIGHT].y -
-                       g_back_wall_coords[depth][position][BOTTOM_RIGHT].y),
-                 GColorBlack);
+/******************************************************************************
+   Function: update_npc_activity
+
+Description: Puts NPCs that are now too far from the player to sleep and wakes
+             up those that are now near enough. Called whenever the player's
+             position has changed.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void update_npc_activity(void) {
+  int8_t i, npc;
+
+  g_activity_origin = g_player->position;
+
+  // Visit active NPCs backward, since a sleeping NPC's slot is taken by the
+  // last active NPC:
+  for (i = g_npcs->num_active_npcs - 1; i >= 0; --i) {
+    npc = g_npcs->live_npcs[i];
+    if (!npc_is_near_player(npc)) {
+      put_npc_to_sleep(npc);
+    }
   }
 
-  // If there's no NPC, check for loot, then we're done:
-  if (npc == NULL) {
-    if (get_cell_type(cell) >= 0) {  // Loot!
-      graphics_context_set_fill_color(ctx, GColorYellow);
-      graphics_fill_rect(ctx,
-                         GRect(floor_center_point.x - drawing_unit * 2,
-                               floor_center_point.y - drawing_unit * 2.5,
-                               drawing_unit * 4,
-                               drawing_unit * 2.5),
-                         drawing_unit / 2,
-                         GCornersTop);
+  // Visit dormant NPCs forward, since a waking NPC's slot is taken by the
+  // first dormant NPC:
+  for (i = g_npcs->num_active_npcs; i < g_npcs->num_live_npcs; ++i) {
+    npc = g_npcs->live_npcs[i];
+    if (npc_is_near_player(npc)) {
+      wake_npc(npc);
     }
+  }
+}
 
-    return;
+/******************************************************************************
+   Function: init_npc_pool
+
+Description: Rebuilds the NPC pool's live and free lists, along with the NPC
+             grid, according to NPC types. (All NPCs start out dormant; the
+             next simulation step wakes those near the player.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void init_npc_pool(void) {
+  int8_t i;
+
+  g_npcs->num_live_npcs = g_npcs->num_active_npcs = 0;
+  g_npcs->num_free_npcs = 0;
+
+  // (Free NPCs are stacked in reverse so lower indices are used first.)
+  for (i = MAX_NPCS_AT_ONE_TIME - 1; i >= 0; --i) {
+    if (g_npcs->types[i] > NONE) {
+      g_npcs->live_npc_slots[i] = g_npcs->num_live_npcs;
+      g_npcs->live_npcs[g_npcs->num_live_npcs++] = i;
+      g_npcs->pending_damage[i] = 0;
+      put_npc_to_sleep(i);
+    } else {
+      g_npcs->free_npcs[g_npcs->num_free_npcs++] = i;
+    }
   }
+  init_npc_grid();
+  g_activity_origin = GPoint(NONE, NONE);
+}
+
+/******************************************************************************
+   Function: init_npc_grid
+
+Description: Rebuilds the NPC grid, which stores the index of the NPC, if any,
+             occupying each cell of the resident window. (NPCs outside the
+             window stay in the pool but have no grid entry.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void init_npc_grid(void) {
+  int8_t i, j;
 
-  // Prepare to draw the NPC:
-  if (npc->type <= WHITE_MONSTER_MEDIUM ||
-      npc->type == WARRIOR_MEDIUM ||
-      npc->type == WARRIOR_LARGE ||
-      (npc->type >= DARK_OGRE && npc->type <= PALE_TROLL)) {
-    drawing_unit++;
+  for (i = 0; i < WINDOW_SIZE; ++i) {
+    for (j = 0; j < WINDOW_SIZE; ++j) {
+      g_npc_grid[i][j] = NONE;
+    }
   }
-  if (npc->type <= WHITE_MONSTER_LARGE ||
-      npc->type == WARRIOR_LARGE ||
-      npc->type == DARK_OGRE ||
-      npc->type == PALE_OGRE) {
-    drawing_unit++;
+  for (i = 0; i < g_npcs->num_live_npcs; ++i) {
+    j = g_npcs->live_npcs[i];
+    if (cell_is_in_window(g_npcs->positions[j])) {
+      g_npc_grid[WINDOW_X(g_npcs->positions[j])]
+                [WINDOW_Y(g_npcs->positions[j])] = j;
+    }
   }
+}
 
-  // Mages:
-  if (npc->type == MAGE) {
-    // Body:
-    graphics_context_set_fill_color(ctx, GColorBlack);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 2,
-                             floor_center_point.y - drawing_unit * 8,
-                             drawing_unit * 4,
-                             drawing_unit * 8),
-                       drawing_unit,
-                       GCornersTop);
+/******************************************************************************
+   Function: clear_npc_pool
 
-    // Head:
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit,
-                             floor_center_point.y - drawing_unit * 10,
-                             drawing_unit * 2,
-                             drawing_unit * 2),
-                       drawing_unit,
-                       GCornersTop);
+Description: Removes all NPCs (and their status effects) from the NPC pool.
 
-    // Eyes:
-    graphics_context_set_fill_color(ctx, RANDOM_BRIGHT_COLOR);
-    graphics_fill_circle(ctx,
-                         GPoint(floor_center_point.x - drawing_unit / 3,
-                                floor_center_point.y - drawing_unit * 9),
-                         drawing_unit / 5);
-    graphics_fill_circle(ctx,
-                         GPoint(floor_center_point.x + drawing_unit / 3,
-                                floor_center_point.y - drawing_unit * 9),
-                         drawing_unit / 5);
+     Inputs: None.
 
-  // Floating monsters:
-  } else if (npc->type <= WHITE_MONSTER_SMALL) {
-    // Body/head:
-    graphics_context_set_fill_color(ctx,
-                                    npc->type % 2 ? GColorDarkCandyAppleRed :
-                                                    GColorBulgarianRose);
-    graphics_fill_circle(ctx,
-                         GPoint(floor_center_point.x,
-                                floor_center_point.y - drawing_unit * 4),
-                         drawing_unit * 3 - drawing_unit / 2);
+    Outputs: None.
+******************************************************************************/
+void clear_npc_pool(void) {
+  int8_t i;
 
-    // Eye:
+  for (i = 0; i < MAX_NPCS_AT_ONE_TIME; ++i) {
+    g_npcs->types[i] = NONE;
+    g_npcs->status_effects[i] = 0;
+    g_npcs->arrival_directions[i] = NONE;
+  }
+  for (i = 0; i < MAX_STATUS_TIMERS; ++i) {
+    g_npcs->status_wheel.timers[i].npc = NONE;
+  }
+  for (i = 0; i < STATUS_WHEEL_SIZE; ++i) {
+    g_npcs->status_wheel.slots[i] = NONE;
+  }
+  g_npcs->status_wheel.position = 0;
+  init_npc_pool();
+}
+
+/******************************************************************************
+   Function: get_saved_npcs
+
+Description: Fills in the compact form of each living NPC (see
+             "saved_npc_t"), as saved to persistent storage or the level cache.
+
+     Inputs: saved_npcs - Array of at least MAX_NPCS_AT_ONE_TIME records.
+
+    Outputs: Number of records filled in.
+******************************************************************************/
+int8_t get_saved_npcs(saved_npc_t *const saved_npcs) {
+  int8_t i, npc;
+
+  for (i = 0; i < g_npcs->num_live_npcs; ++i) {
+    npc = g_npcs->live_npcs[i];
+    saved_npcs[i].npc = npc;
+    saved_npcs[i].x = g_npcs->positions[npc].x;
+    saved_npcs[i].y = g_npcs->positions[npc].y;
+    saved_npcs[i].type = g_npcs->types[npc];
+    saved_npcs[i].item = g_npcs->items[npc];
+    saved_npcs[i].health = g_npcs->health[npc];
+    saved_npcs[i].status_effects = g_npcs->status_effects[npc];
+  }
+
+  return g_npcs->num_live_npcs;
+}
+
+/******************************************************************************
+   Function: restore_npcs
+
+Description: Replaces the NPC pool's contents with NPCs in compact form (see
+             "get_saved_npcs"), recomputing their power and defenses. (Any
+             status effects need their timers restored separately.)
+
+     Inputs: saved_npcs     - Array of saved NPCs.
+             num_saved_npcs - Number of saved NPCs.
+
+    Outputs: None.
+******************************************************************************/
+void restore_npcs(const saved_npc_t *const saved_npcs,
+                  const int8_t num_saved_npcs) {
+  int8_t i, npc;
+
+  clear_npc_pool();
+  for (i = 0; i < num_saved_npcs; ++i) {
+    npc = saved_npcs[i].npc;
+    g_npcs->positions[npc] = GPoint(saved_npcs[i].x, saved_npcs[i].y);
+    g_npcs->types[npc] = saved_npcs[i].type;
+    g_npcs->items[npc] = saved_npcs[i].item;
+    g_npcs->health[npc] = saved_npcs[i].health;
+    g_npcs->status_effects[npc] = saved_npcs[i].status_effects;
+    set_npc_stats(npc);
+  }
+  init_npc_pool();
+}
+
+/******************************************************************************
+   Function: get_stat_title_str
+
+Description: Returns a "title" string for a given character stat, including
+             both the stat's name and its current value.
+
+     Inputs: stat_index - Integer representing the stat of interest.
+
+    Outputs: String containing the stat name and its current value.
+******************************************************************************/
+char *get_stat_title_str(const int8_t stat_index) {
+  static char stat_str[STAT_TITLE_STR_LEN + 1];
+  int8_t remaining_str_len;
+
+  snprintf(stat_str,
+           STAT_TITLE_STR_LEN + 1,
+           "%s: ",
+           g_stat_names[stat_index + NUM_NEGATIVE_STAT_CONSTANTS]);
+
+  // Add the stat's current value:
+  remaining_str_len = STAT_TITLE_STR_LEN - strlen(stat_str) + 1;
+  if (stat_index == EXPERIENCE_POINTS) {
+    snprintf(stat_str + strlen(stat_str),
+             remaining_str_len,
+             "%u",
+             g_player->exp_points);
+  } else if (stat_index < 0) {
+    snprintf(stat_str + strlen(stat_str),
+             remaining_str_len,
+             "%d/%d",
+             g_player->int16_stats[stat_index + NUM_NEGATIVE_STAT_CONSTANTS],
+             g_player->int16_stats[stat_index + NUM_NEGATIVE_STAT_CONSTANTS +
+                                     2]);
+  } else {
+    snprintf(stat_str + strlen(stat_str),
+             remaining_str_len,
+             "%d",
+             g_player->int8_stats[stat_index]);
+  }
+
+  return stat_str;
+}
+
+/******************************************************************************
+   Function: occupiable
+
+Description: Determines whether the cell at a given set of coordinates may be
+             occupied by a game character (i.e., it's within the resident
+             window, doesn't block movement, isn't already occupied by another
+             character, etc.). (Movement is checked against the window's
+             bitset, kept in step with "get_cell_type".)
+
+     Inputs: cell - Coordinates of the cell of interest.
+
+    Outputs: "True" if the cell is occupiable.
+******************************************************************************/
+bool occupiable(const GPoint cell) {
+  return cell_is_in_window(cell) &&
+         !(g_window_blocked_rows[WINDOW_Y(cell)] >> WINDOW_X(cell) & 1) &&
+         !gpoint_equal(&g_player->position, &cell) &&
+         get_npc_at(cell) == NONE;
+}
+
+/******************************************************************************
+   Function: traversable
+
+Description: Determines whether NPCs may walk through a given cell, regardless
+             of who currently occupies it (a single test against the window's
+             bitset; cells outside the window aren't traversable).
+
+     Inputs: cell - Coordinates of the cell of interest.
+
+    Outputs: "True" if the cell is traversable.
+******************************************************************************/
+bool traversable(const GPoint cell) {
+  return cell_is_in_window(cell) &&
+         g_window_passable_rows[WINDOW_Y(cell)] >> WINDOW_X(cell) & 1;
+}
+
+/******************************************************************************
+   Function: show_narration
+
+Description: Displays desired narration text via the narration window.
+
+     Inputs: narration - Integer indicating desired narration text.
+
+    Outputs: Integer representing the narration text shown.
+******************************************************************************/
+int8_t show_narration(const int8_t narration) {
+  text_layer_set_text(g_narration_text_layer, g_narration_strings[narration]);
+  show_window(NARRATION_WINDOW, NOT_ANIMATED);
+
+  return g_current_narration = narration;
+}
+
+/******************************************************************************
+   Function: show_window
+
+Description: Prepares and displays a given window.
+
+     Inputs: window_index - Integer representing the desired window.
+             animated     - If "true", the window will slide into view.
+
+    Outputs: Integer representing the newly-displayed window.
+******************************************************************************/
+int8_t show_window(const int8_t window_index, const bool animated) {
+  // If it's a menu, reload menu data and set to the appropriate index:
+  if (window_index < NUM_MENUS) {
+    menu_layer_reload_data(g_menu_layers[window_index]);
+    if (window_index == INVENTORY_MENU) {
+      menu_layer_set_selected_index(g_menu_layers[window_index],
+                                    (MenuIndex) {0, g_current_selection},
+                                    MenuRowAlignCenter,
+                                    NOT_ANIMATED);
+    } else {
+      menu_layer_set_selected_index(g_menu_layers[window_index],
+                                    (MenuIndex) {0, 0},
+                                    MenuRowAlignCenter,
+                                    NOT_ANIMATED);
+    }
+  }
+
+  // Show the window:
+  if (!window_stack_contains_window(g_windows[window_index])) {
+    window_stack_push(g_windows[window_index], animated);
+  } else {
+    while (window_stack_get_top_window() != g_windows[window_index]) {
+      window_stack_pop(animated);
+    }
+  }
+
+  return g_current_window = window_index;
+}
+
+/******************************************************************************
+   Function: post_event
+
+Description: Adds a gameplay event to the event queue, to be handled the next
+             time "dispatch_events" is called. Events are coalesced as they're
+             posted: if one of the same type is already queued, it just takes
+             the new value (e.g., the latest loot found), so the queue never
+             holds more than one event per type and can't overflow mid-step.
+
+     Inputs: type  - Integer representing the event type.
+             value - Additional event data (damage amount, item type, etc.).
+
+    Outputs: None.
+******************************************************************************/
+void post_event(const int8_t type, const int8_t value) {
+  uint8_t i;
+  game_event_t *event;
+
+  for (i = 0; i < g_num_queued_events; ++i) {
+    event = &g_event_queue[(g_event_queue_head + i) % EVENT_QUEUE_CAPACITY];
+    if (event->type == type) {
+      event->value = value;
+      return;
+    }
+  }
+  event = &g_event_queue[(g_event_queue_head + g_num_queued_events++) %
+                           EVENT_QUEUE_CAPACITY];
+  event->type = type;
+  event->value = value;
+}
+
+/******************************************************************************
+   Function: dispatch_events
+
+Description: Handles all queued gameplay events at once, coalescing their side
+             effects: at most one vibration, one set of window transitions,
+             and one redraw, however many events were posted. Called at the end
+             of each simulation timer callback and each gameplay input.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void dispatch_events(void) {
+  game_event_t *event;
+  int8_t loot = NONE;
+  bool player_damaged = false,
+       player_died = false,
+       leveled_up = false,
+       game_completed = false;
+
+  if (g_num_queued_events == 0) {
+    return;
+  }
+  while (g_num_queued_events > 0) {
+    event = &g_event_queue[g_event_queue_head];
+    g_event_queue_head = (g_event_queue_head + 1) % EVENT_QUEUE_CAPACITY;
+    g_num_queued_events--;
+    switch (event->type) {
+      case PLAYER_DAMAGED_EVENT:
+        player_damaged = true;
+        break;
+      case PLAYER_DIED_EVENT:
+        player_died = true;
+        break;
+      case LEVEL_UP_EVENT:
+        leveled_up = true;
+        break;
+      case LOOT_FOUND_EVENT:
+        loot = event->value;
+        break;
+      case GAME_COMPLETED_EVENT:
+        game_completed = true;
+        break;
+      default:  // NPC_DAMAGED_EVENT, NPC_DIED_EVENT, SCENE_CHANGED_EVENT
+        break;
+    }
+  }
+
+  if (player_damaged) {
+    vibes_short_pulse();
+  }
+
+  // Window transitions (death and game completion override all others):
+  if (player_died) {
+    show_window(MAIN_MENU, NOT_ANIMATED);
+    show_window(STATS_MENU, NOT_ANIMATED);
+    show_narration(DEATH_NARRATION);
+  } else if (game_completed) {
+    show_narration(ENDING_NARRATION);
+  } else {
+    if (loot > NONE) {
+      g_current_selection = loot;
+      show_window(LOOT_MENU, NOT_ANIMATED);
+    }
+    if (leveled_up) {
+      show_window(LEVEL_UP_MENU, NOT_ANIMATED);
+      show_narration(LEVEL_UP_NARRATION);
+    }
+  }
+
+  if (g_current_window == GRAPHICS_WINDOW) {
+    layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+  }
+}
+
+/******************************************************************************
+   Function: main_menu_draw_header_callback
+
+Description: Instructions for drawing the main menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void main_menu_draw_header_callback(GContext *ctx,
+                                           const Layer *cell_layer,
+                                           uint16_t section_index,
+                                           void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "MAIN MENU");
+}
+
+/******************************************************************************
+   Function: level_up_menu_draw_header_callback
+
+Description: Instructions for drawing the level-up menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void level_up_menu_draw_header_callback(GContext *ctx,
+                                               const Layer *cell_layer,
+                                               uint16_t section_index,
+                                               void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "BOOST AN ATTRIBUTE");
+}
+
+/******************************************************************************
+   Function: stats_menu_draw_header_callback
+
+Description: Instructions for drawing the stats menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void stats_menu_draw_header_callback(GContext *ctx,
+                                            const Layer *cell_layer,
+                                            uint16_t section_index,
+                                            void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "CHARACTER STATS");
+}
+
+/******************************************************************************
+   Function: inventory_menu_draw_header_callback
+
+Description: Instructions for drawing the inventory menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void inventory_menu_draw_header_callback(GContext *ctx,
+                                                const Layer *cell_layer,
+                                                uint16_t section_index,
+                                                void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "INVENTORY");
+}
+
+/******************************************************************************
+   Function: loot_menu_draw_header_callback
+
+Description: Instructions for drawing the loot menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void loot_menu_draw_header_callback(GContext *ctx,
+                                           const Layer *cell_layer,
+                                           uint16_t section_index,
+                                           void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "LOOT");
+}
+
+/******************************************************************************
+   Function: pebble_options_menu_draw_header_callback
+
+Description: Instructions for drawing the Pebble options menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void pebble_options_menu_draw_header_callback(GContext *ctx,
+                                                     const Layer *cell_layer,
+                                                     uint16_t section_index,
+                                                     void *data) {
+  menu_cell_basic_header_draw(ctx, cell_layer, "OPTIONS");
+}
+
+/******************************************************************************
+   Function: heavy_items_menu_draw_header_callback
+
+Description: Instructions for drawing the heavy items menu's header.
+
+     Inputs: ctx           - Pointer to the associated context.
+             cell_layer    - Pointer to the cell layer.
+             section_index - Section number of the header to be drawn.
+             data          - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void heavy_items_menu_draw_header_callback(GContext *ctx,
+                                                  const Layer *cell_layer,
+                                                  uint16_t section_index,
+                                                  void *data) {
+  char header_str[HEAVY_ITEMS_MENU_HEADER_STR_LEN + 1];
+
+  snprintf(header_str,
+           HEAVY_ITEMS_MENU_HEADER_STR_LEN + 1,
+           "%s AN ITEM?",
+           g_current_selection < FIRST_HEAVY_ITEM ? "ENCHANT" : "DROP");
+  menu_cell_basic_header_draw(ctx, cell_layer, header_str);
+}
+
+/******************************************************************************
+   Function: main_menu_draw_row_callback
+
+Description: Instructions for drawing each row (cell) of the main menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void main_menu_draw_row_callback(GContext *ctx,
+                                        const Layer *cell_layer,
+                                        MenuIndex *cell_index,
+                                        void *data) {
+  menu_cell_basic_draw(ctx,
+                       cell_layer,
+                       g_main_menu_strings[cell_index->row],
+                       g_main_menu_strings[cell_index->row +
+                                             MAIN_MENU_NUM_ROWS],
+                       NULL);
+}
+
+/******************************************************************************
+   Function: inventory_menu_draw_row_callback
+
+Description: Instructions for drawing each row (cell) of the inventory menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void inventory_menu_draw_row_callback(GContext *ctx,
+                                             const Layer *cell_layer,
+                                             MenuIndex *cell_index,
+                                             void *data) {
+  char title_str[ITEM_TITLE_STR_LEN + 1],
+       subtitle_str[ITEM_SUBTITLE_STR_LEN + 1] = "";
+  heavy_item_t *heavy_item;
+  int8_t item_type = get_nth_item_type(cell_index->row);
+
+  strcpy(title_str, g_item_names[item_type]);
+
+  // Pebbles:
+  if (item_type < FIRST_HEAVY_ITEM) {
+    snprintf(subtitle_str, 6, "(%d) ", g_player->pebbles[item_type]);
+    if (g_player->equipped_pebble == item_type) {
+      strcat(subtitle_str, EQUIPPED_STR);
+    }
+
+  // Heavy items:
+  } else {
+    heavy_item = &g_player->heavy_items[cell_index->row -
+                                          get_num_pebble_types_owned()];
+    strcat(title_str, g_magic_type_names[heavy_item->infused_pebble + 1]);
+    if (heavy_item->equipped) {
+      strcat(subtitle_str, EQUIPPED_STR);
+    }
+  }
+  menu_cell_basic_draw(ctx, cell_layer, title_str, subtitle_str, NULL);
+}
+
+/******************************************************************************
+   Function: level_up_menu_draw_row_callback
+
+Description: Instructions for drawing each row (cell) of the level-up menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void level_up_menu_draw_row_callback(GContext *ctx,
+                                            const Layer *cell_layer,
+                                            MenuIndex *cell_index,
+                                            void *data) {
+  menu_cell_basic_draw(ctx,
+                       cell_layer,
+                       get_stat_title_str(cell_index->row + FIRST_MAJOR_STAT),
+                       NULL,
+                       NULL);
+}
+
+/******************************************************************************
+   Function: stats_menu_draw_row_callback
+
+Description: Instructions for drawing the rows (cells) of each "heavy items"
+             menu: the "replace item" menu and the infusion menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void stats_menu_draw_row_callback(GContext *ctx,
+                                         const Layer *cell_layer,
+                                         MenuIndex *cell_index,
+                                         void *data) {
+  menu_cell_basic_draw(ctx,
+                       cell_layer,
+                       get_stat_title_str(cell_index->row -
+                                            NUM_NEGATIVE_STAT_CONSTANTS),
+                       NULL,
+                       NULL);
+}
+
+/******************************************************************************
+   Function: loot_menu_draw_row_callback
+
+Description: Instructions for drawing each row (cell) of the loot menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void loot_menu_draw_row_callback(GContext *ctx,
+                                        const Layer *cell_layer,
+                                        MenuIndex *cell_index,
+                                        void *data) {
+  menu_cell_basic_draw(ctx,
+                       cell_layer,
+                       g_item_names[g_current_selection],
+                       NULL,
+                       NULL);
+}
+
+/******************************************************************************
+   Function: pebble_options_menu_draw_row_callback
+
+Description: Instructions for drawing each row (cell) of the Pebble options
+             menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void pebble_options_menu_draw_row_callback(GContext *ctx,
+                                                  const Layer *cell_layer,
+                                                  MenuIndex *cell_index,
+                                                  void *data) {
+  menu_cell_basic_draw(ctx,
+                       cell_layer,
+                       g_pebble_options_menu_strings[cell_index->row],
+                       g_pebble_options_menu_strings[cell_index->row +
+                                                 PEBBLE_OPTIONS_MENU_NUM_ROWS],
+                       NULL);
+}
+
+/******************************************************************************
+   Function: heavy_items_menu_draw_row_callback
+
+Description: Instructions for drawing the rows (cells) of each "heavy items"
+             menu: the "replace item" menu and the infusion menu.
+
+     Inputs: ctx        - Pointer to the associated context.
+             cell_layer - Pointer to the layer of the cell to be drawn.
+             cell_index - Pointer to the index struct of the cell to be drawn.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void heavy_items_menu_draw_row_callback(GContext *ctx,
+                                               const Layer *cell_layer,
+                                               MenuIndex *cell_index,
+                                               void *data) {
+  char title_str[ITEM_TITLE_STR_LEN + 1],
+       subtitle_str[ITEM_SUBTITLE_STR_LEN + 1] = "";
+  heavy_item_t *heavy_item = &g_player->heavy_items[cell_index->row];
+
+  strcpy(title_str, g_item_names[heavy_item->type]);
+  strcat(title_str, g_magic_type_names[heavy_item->infused_pebble + 1]);
+  if (heavy_item->equipped) {
+    strcpy(subtitle_str, EQUIPPED_STR);
+  }
+  menu_cell_basic_draw(ctx, cell_layer, title_str, subtitle_str, NULL);
+}
+
+/******************************************************************************
+   Function: menu_select_callback
+
+Description: Called when a menu cell is selected.
+
+     Inputs: menu_layer - Pointer to the menu layer.
+             cell_index - Pointer to the index struct of the selected cell.
+             data       - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+void menu_select_callback(MenuLayer *menu_layer,
+                          MenuIndex *cell_index,
+                          void *data) {
+  int8_t i, old_item_equip_target;
+  bool item_was_equipped = false;
+  heavy_item_t *heavy_item;
+
+  if (menu_layer == g_menu_layers[MAIN_MENU]) {
+    if (cell_index->row == 0) {  // Play
+      show_window(GRAPHICS_WINDOW, NOT_ANIMATED);
+      if (g_player->int8_stats[DEPTH] == 0 ||
+          g_player->int16_stats[CURRENT_HEALTH] <= 0) {
+        init_player();
+        show_narration(INTRO_NARRATION_1);
+        init_location(g_player->int8_stats[DEPTH] + 1);
+      }
+    } else if (cell_index->row == 1) {  // Inventory
+      g_current_selection = 0;  // To scroll menu to the top.
+      show_window(INVENTORY_MENU, ANIMATED);
+    } else if (cell_index->row == 2) {  // Character Stats
+      show_window(STATS_MENU, ANIMATED);
+    } else {  // Endless Mode
+      show_window(GRAPHICS_WINDOW, NOT_ANIMATED);
+      if (g_player->int8_stats[DEPTH] == 0 ||
+          g_player->int16_stats[CURRENT_HEALTH] <= 0) {
+        init_player();
+        show_narration(INTRO_NARRATION_1);
+        init_endless_location();
+      } else if (!g_location->endless) {
+        init_endless_location();
+      }
+    }
+  } else if (menu_layer == g_menu_layers[LEVEL_UP_MENU]) {
+    g_player->int8_stats[cell_index->row + FIRST_MAJOR_STAT]++;
+    update_player_stats(STAT_INPUT(cell_index->row + FIRST_MAJOR_STAT));
+    g_player->int16_stats[CURRENT_HEALTH] = g_player->int16_stats[MAX_HEALTH];
+    g_player->int16_stats[CURRENT_ENERGY] = g_player->int16_stats[MAX_ENERGY];
+    window_stack_pop(NOT_ANIMATED);
+    show_window(STATS_MENU, NOT_ANIMATED);
+  } else if (menu_layer == g_menu_layers[INVENTORY_MENU]) {
+    // Pebbles:
+    if (get_nth_item_type(cell_index->row) < FIRST_HEAVY_ITEM) {
+      g_current_selection = get_nth_item_type(cell_index->row);
+      show_window(PEBBLE_OPTIONS_MENU, ANIMATED);
+
+    // Heavy items:
+    } else {
+      equip_heavy_item(&g_player->heavy_items[cell_index->row -
+                                                get_num_pebble_types_owned()]);
+      menu_layer_reload_data(g_menu_layers[INVENTORY_MENU]);
+    }
+  } else if (menu_layer == g_menu_layers[LOOT_MENU]) {
+    show_window(GRAPHICS_WINDOW, NOT_ANIMATED);
+
+    // If it's a Pebble, simply add it to the player's inventory:
+    if (g_current_selection < FIRST_HEAVY_ITEM) {
+      g_player->pebbles[g_current_selection]++;
+      g_current_selection = get_inventory_row_for_pebble(g_current_selection);
+      show_window(INVENTORY_MENU, NOT_ANIMATED);
+
+    // If it's a heavy item, attempt to add it to the player's inventory:
+    } else {
+      for (i = 0; i < MAX_HEAVY_ITEMS; ++i) {
+        heavy_item = &g_player->heavy_items[i];
+        if (heavy_item->type == NONE) {
+          init_heavy_item(heavy_item, g_current_selection);
+          g_current_selection = i + get_num_pebble_types_owned();
+          show_window(INVENTORY_MENU, NOT_ANIMATED);
+
+          return;
+        }
+      }
+
+      // If we reach this point, a heavy item must be dropped to add a new one:
+      show_window(HEAVY_ITEMS_MENU, NOT_ANIMATED);
+      show_narration(ENCUMBRANCE_NARRATION);
+    }
+  } else if (menu_layer == g_menu_layers[PEBBLE_OPTIONS_MENU]) {
+    if (cell_index->row == 0) {  // Equip
+      unequip_item_at(RIGHT_HAND);
+      g_player->equipped_pebble = g_current_selection;
+      g_current_selection = get_inventory_row_for_pebble(g_current_selection);
+      show_window(INVENTORY_MENU, NOT_ANIMATED);
+    } else {  // Infuse into Item
+      show_window(HEAVY_ITEMS_MENU, ANIMATED);
+    }
+  } else if (menu_layer == g_menu_layers[HEAVY_ITEMS_MENU]) {
+    heavy_item = &g_player->heavy_items[cell_index->row];
+
+    // "Infuse item" mode:
+    if (g_current_selection < FIRST_HEAVY_ITEM) {
+      // Ensure the item isn't already infused:
+      if (heavy_item->infused_pebble == NONE) {
+        // Infuse the item:
+        if (heavy_item->equipped) {
+          unequip_heavy_item(heavy_item);
+          item_was_equipped = true;
+        }
+        heavy_item->infused_pebble = g_current_selection;
+        if (item_was_equipped) {
+          equip_heavy_item(heavy_item);
+        }
+
+        // Remove the Pebble from the pool of equippable/infusable Pebbles:
+        g_player->pebbles[g_current_selection]--;
+        if (g_player->equipped_pebble == g_current_selection &&
+            g_player->pebbles[g_current_selection] == 0) {
+          g_player->equipped_pebble = NONE;
+        }
+
+        // Return to the inventory menu, centered on the newly-infused item:
+        g_current_selection = cell_index->row + get_num_pebble_types_owned();
+        show_window(INVENTORY_MENU, NOT_ANIMATED);
+      }
+
+    // "Replace item" mode:
+    } else {
+      // If the item to be replaced is equipped, unequip it:
+      old_item_equip_target = heavy_item->equip_target;
+      if (heavy_item->equipped) {
+        unequip_heavy_item(heavy_item);
+        item_was_equipped = true;
+      }
+
+      // Reinitialize the heavy item struct:
+      init_heavy_item(heavy_item, g_current_selection);
+
+      // If old item was equipped, equip new one if equip target is the same:
+      if (item_was_equipped &&
+          heavy_item->equip_target == old_item_equip_target) {
+        equip_heavy_item(heavy_item);
+      }
+
+      // Show inventory menu to provide an opportunity to adjust equipment:
+      window_stack_pop(NOT_ANIMATED);
+      g_current_selection = cell_index->row + get_num_pebble_types_owned();
+      show_window(INVENTORY_MENU, NOT_ANIMATED);
+    }
+  }
+}
+
+/******************************************************************************
+   Function: menu_get_header_height_callback
+
+Description: Returns the section height for a given section of a given menu.
+
+     Inputs: menu_layer    - Pointer to the menu of interest.
+             section_index - Section number.
+             data          - Pointer to additional data (not used).
+
+    Outputs: The number of sections in the indicated menu.
+******************************************************************************/
+static int16_t menu_get_header_height_callback(MenuLayer *menu_layer,
+                                               uint16_t section_index,
+                                               void *data) {
+  return MENU_CELL_BASIC_HEADER_HEIGHT;
+}
+
+/******************************************************************************
+   Function: menu_get_num_rows_callback
+
+Description: Returns the number of rows in a given menu (or in a given section
+             of a given menu).
+
+     Inputs: menu_layer    - Pointer to the menu of interest.
+             section_index - Section number.
+             data          - Pointer to additional data (not used).
+
+    Outputs: The number of rows in the indicated menu.
+******************************************************************************/
+static uint16_t menu_get_num_rows_callback(MenuLayer *menu_layer,
+                                           uint16_t section_index,
+                                           void *data) {
+  int8_t i, num_heavy_items = 0;
+
+  // Get number of heavy items owned for inventory and heavy items menus:
+  for (i = 0; i < MAX_HEAVY_ITEMS; ++i) {
+    if (g_player->heavy_items[i].type > NONE) {
+      num_heavy_items++;
+    }
+  }
+
+  if (menu_layer == g_menu_layers[INVENTORY_MENU]) {
+    return get_num_pebble_types_owned() + num_heavy_items;
+  } else if (menu_layer == g_menu_layers[HEAVY_ITEMS_MENU]) {
+    return num_heavy_items;
+  } else if (menu_layer == g_menu_layers[STATS_MENU]) {
+    return STATS_MENU_NUM_ROWS;
+  } else if (menu_layer == g_menu_layers[LOOT_MENU]) {
+    return LOOT_MENU_NUM_ROWS;
+  } else if (menu_layer == g_menu_layers[PEBBLE_OPTIONS_MENU]) {
+    return PEBBLE_OPTIONS_MENU_NUM_ROWS;
+  } else {  // MAIN_MENU or LEVEL_UP_MENU
+    return MAIN_MENU_NUM_ROWS;
+  }
+}
+
+/******************************************************************************
+   Function: draw_scene
+
+Description: Draws a (simplistic) 3D scene based on the player's current
+             position, direction, and visibility depth.
+
+     Inputs: layer - Pointer to the relevant layer.
+             ctx   - Pointer to the relevant graphics context.
+
+    Outputs: None.
+******************************************************************************/
+void draw_scene(Layer *layer, GContext *ctx) {
+  int8_t i, depth, max_offset, left_offset, right_offset, spell_beam_width,
+         magic_type = NONE;
+  GPoint cell, cell_2;
+  heavy_item_t *weapon = get_heavy_item_equipped_at(RIGHT_HAND);
+  uint32_t wall_start_time, wall_time = 0;
+#ifdef FRAME_PROFILER
+  const uint32_t start_time = get_current_time_ms();
+#endif
+
+  // First, draw the background, floor, and ceiling (shaded for the player's
+  // light, which also determines how far away cells are drawn, and seen from
+  // partway through any step or turn):
+  select_view();
+  update_shading();
+  graphics_context_set_fill_color(ctx, GColorBlack);
+  graphics_fill_rect(ctx,
+                     FULL_SCREEN_FRAME,
+                     NO_CORNER_RADIUS,
+                     GCornerNone);
+  draw_floor_and_ceiling(ctx);
+
+  // Now draw walls and cell contents (skipping cells beyond the light radius,
+  // where walking distance is depth plus sideways offset; all of them lie
+  // well inside the resident window, which is centered on the player's
+  // chunk):
+  for (depth = g_light_radius < MAX_VISIBILITY_DEPTH - 2 ?
+                 g_light_radius : MAX_VISIBILITY_DEPTH - 2;
+       depth >= 0;
+       --depth) {
+    // Straight ahead at the current depth:
+    cell = get_cell_farther_away(g_view_position, g_view_direction, depth);
+    if (!WINDOW_CELL_IS_SOLID(cell)) {
+      wall_start_time = get_current_time_ms();
+      draw_cell_walls(ctx, cell, depth, STRAIGHT_AHEAD);
+      wall_time += get_current_time_ms() - wall_start_time;
+      draw_cell_contents(ctx, cell, depth, STRAIGHT_AHEAD);
+    }
+
+    // To the left and right at the same depth (farther to the right while
+    // the view is shifted left, mid-turn):
+    max_offset = g_light_radius - depth < STRAIGHT_AHEAD ?
+                   g_light_radius - depth : STRAIGHT_AHEAD;
+    left_offset = max_offset < depth + 1 ? max_offset : depth + 1;
+    right_offset = g_view->shift ? max_offset : left_offset;
+    for (i = right_offset; i > 0; --i) {
+      if (i <= left_offset) {
+        cell_2 = get_cell_farther_away(cell,
+                                 get_direction_to_the_left(g_view_direction),
+                                 i);
+        if (!WINDOW_CELL_IS_SOLID(cell_2)) {
+          wall_start_time = get_current_time_ms();
+          draw_cell_walls(ctx, cell_2, depth, STRAIGHT_AHEAD - i);
+          wall_time += get_current_time_ms() - wall_start_time;
+          draw_cell_contents(ctx, cell_2, depth, STRAIGHT_AHEAD - i);
+        }
+      }
+      cell_2 = get_cell_farther_away(cell,
+                                get_direction_to_the_right(g_view_direction),
+                                i);
+      if (!WINDOW_CELL_IS_SOLID(cell_2)) {
+        wall_start_time = get_current_time_ms();
+        draw_cell_walls(ctx, cell_2, depth, STRAIGHT_AHEAD + i);
+        wall_time += get_current_time_ms() - wall_start_time;
+        draw_cell_contents(ctx, cell_2, depth, STRAIGHT_AHEAD + i);
+      }
+    }
+  }
+
+  // Draw the "attack slash," if applicable:
+  if (g_player_is_attacking) {
+    if (weapon) {
+      magic_type = weapon->infused_pebble;
+    }
+    for (i = 0; i < 3; ++i) {
+      if (magic_type > NONE) {
+        graphics_context_set_stroke_color(ctx,
+                                      g_magic_type_colors[magic_type][i == 2]);
+      } else {
+        graphics_context_set_stroke_color(ctx, i < 2 ? GColorLightGray :
+                                                       GColorDarkGray);
+      }
+      graphics_draw_line(ctx,
+                         GPoint(g_attack_slash_x1 + i, g_attack_slash_y1),
+                         GPoint(g_attack_slash_x2 + i, g_attack_slash_y2));
+      graphics_draw_line(ctx,
+                         GPoint(g_attack_slash_x1 - i, g_attack_slash_y1),
+                         GPoint(g_attack_slash_x2 - i, g_attack_slash_y2));
+    }
+  }
+
+  // Draw "spell beams," if applicable:
+  if (g_player_current_spell_animation > 0) {
+    spell_beam_width = g_player_current_spell_animation % 2 ?
+                         MIN_SPELL_BEAM_BASE_WIDTH          :
+                         MAX_SPELL_BEAM_BASE_WIDTH;
+    magic_type = g_player->equipped_pebble;
+    graphics_context_set_stroke_color(ctx, g_magic_type_colors[magic_type][0]);
+    graphics_draw_line(ctx,
+                       GPoint(SCREEN_CENTER_POINT_X,
+                              GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                       GPoint(SCREEN_CENTER_POINT.x,
+                              SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+    for (i = 0; i <= spell_beam_width; ++i) {
+      graphics_context_set_stroke_color(ctx,
+                                       g_magic_type_colors[magic_type][i % 2]);
+      graphics_draw_line(ctx,
+                         GPoint(SCREEN_CENTER_POINT_X - i,
+                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                         GPoint(SCREEN_CENTER_POINT_X - i / 3,
+                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+      graphics_draw_line(ctx,
+                         GPoint(SCREEN_CENTER_POINT_X + i,
+                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                         GPoint(SCREEN_CENTER_POINT_X + i / 3,
+                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+    }
+  }
+  if (g_enemy_current_spell_animation > 0) {
+    cell = g_player->position;
+    cell_2 = g_npcs->positions[g_enemy_spell_caster];
+    if (in_line_of_sight(cell, cell_2) &&
+        ((cell.y < cell_2.y && g_player->direction == SOUTH) ||
+         (cell.y > cell_2.y && g_player->direction == NORTH) ||
+         (cell.x < cell_2.x && g_player->direction == EAST) ||
+         (cell.x > cell_2.x && g_player->direction == WEST))) {
+      spell_beam_width = g_enemy_current_spell_animation % 2 ?
+                           MIN_SPELL_BEAM_BASE_WIDTH         :
+                           MAX_SPELL_BEAM_BASE_WIDTH;
+      magic_type = g_npcs->items[g_enemy_spell_caster];
+      graphics_context_set_stroke_color(ctx,
+                                        g_magic_type_colors[magic_type][0]);
+      graphics_draw_line(ctx,
+                         GPoint(SCREEN_CENTER_POINT_X,
+                                GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                         GPoint(SCREEN_CENTER_POINT.x,
+                                SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+      for (i = 0; i <= spell_beam_width; ++i) {
+        graphics_context_set_stroke_color(ctx,
+                                          g_magic_type_colors[magic_type]
+                                                             [i % 2]);
+        graphics_draw_line(ctx,
+                           GPoint(SCREEN_CENTER_POINT_X - i,
+                                  GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                           GPoint(SCREEN_CENTER_POINT_X - i / 3,
+                                  SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+        graphics_draw_line(ctx,
+                           GPoint(SCREEN_CENTER_POINT_X + i,
+                                  GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT),
+                           GPoint(SCREEN_CENTER_POINT_X + i / 3,
+                                  SCREEN_CENTER_POINT_Y + STATUS_BAR_HEIGHT));
+      }
+    }
+  }
+
+  // Draw health meter:
+  draw_status_meter(ctx,
+                    GPoint(STATUS_METER_PADDING,
+                           GRAPHICS_FRAME_HEIGHT + STATUS_METER_PADDING +
+                             STATUS_BAR_HEIGHT),
+                    (float) g_player->int16_stats[CURRENT_HEALTH] /
+                      g_player->int16_stats[MAX_HEALTH]);
+
+  // Draw energy meter:
+  draw_status_meter(ctx,
+                    GPoint(SCREEN_CENTER_POINT_X + STATUS_METER_PADDING +
+                             COMPASS_RADIUS + 1,
+                           GRAPHICS_FRAME_HEIGHT + STATUS_METER_PADDING +
+                             STATUS_BAR_HEIGHT),
+                    (float) g_player->int16_stats[CURRENT_ENERGY] /
+                      g_player->int16_stats[MAX_ENERGY]);
+
+  // Draw compass:
+  graphics_context_set_fill_color(ctx, GColorLightGray);
+  graphics_context_set_stroke_color(ctx, GColorDarkGreen);
+  graphics_fill_circle(ctx,
+                       GPoint(SCREEN_CENTER_POINT_X,
+                              GRAPHICS_FRAME_HEIGHT + STATUS_BAR_HEIGHT / 2 +
+                                STATUS_BAR_HEIGHT),
+                       COMPASS_RADIUS);
+  graphics_context_set_fill_color(ctx, GColorBlack);
+  gpath_draw_outline(ctx, g_compass_path);
+  gpath_draw_filled(ctx, g_compass_path);
+
+  // If textured walls keep taking too long to draw, dither them instead
+  // (until the shading changes, e.g., on the next level; a single slow frame
+  // may just be the system busy elsewhere):
+  if (!g_wall_textures_enabled ||
+      wall_time <= WALL_TEXTURE_FRAME_BUDGET) {
+    g_wall_texture_overruns = 0;
+  } else if (++g_wall_texture_overruns >= WALL_TEXTURE_OVERRUN_FRAMES) {
+    g_wall_textures_enabled = false;
+  }
+#ifdef FRAME_PROFILER
+  g_profiled_frame_ms += get_current_time_ms() - start_time;
+  if (++g_profiled_frames == FRAME_PROFILER_FRAMES) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG,
+            "Frames: %d drawn in %d ms (depth %d, light radius %d)",
+            g_profiled_frames,
+            (int) g_profiled_frame_ms,
+            g_player->int8_stats[DEPTH],
+            g_light_radius);
+    g_profiled_frame_ms = g_profiled_frames = 0;
+  }
+#endif
+}
+
+/******************************************************************************
+   Function: select_view
+
+Description: Determines what to draw the scene from: the player's cell and
+             direction at rest, or, partway through a step or turn, a view
+             between where the player was and is. Each phase has its own
+             precomputed view (see "init_views"), and the phase follows the
+             time elapsed since the move, so a late frame skips ahead. Going
+             backward uses the forward step's views in reverse, drawn from the
+             player's new cell; going forward, they're drawn from the cell
+             just left. Likewise, turning right pans the old view left, and
+             turning left pans the new one in from the left.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void select_view(void) {
+  int8_t phase;
+  const uint32_t elapsed_time = get_current_time_ms() - g_movement_start_time;
+
+  g_view = &g_views[REST_VIEW];
+  g_view_position = g_player->position;
+  g_view_direction = g_player->direction;
+  if (g_movement_animation == NONE ||
+      elapsed_time >= MOVEMENT_ANIMATION_FRAMES * MOVEMENT_FRAME_DURATION) {
+    return;
+  }
+  phase = elapsed_time / MOVEMENT_FRAME_DURATION + 1;
+  switch (g_movement_animation) {
+    case STEP_FORWARD_ANIMATION:
+      g_view = &g_views[STEP_VIEW(phase)];
+      g_view_position = get_cell_farther_away(g_player->position,
+                                 get_opposite_direction(g_player->direction),
+                                              1);
+      break;
+    case STEP_BACKWARD_ANIMATION:
+      g_view = &g_views[STEP_VIEW(MOVEMENT_ANIMATION_FRAMES + 1 - phase)];
+      break;
+    case TURN_LEFT_ANIMATION:
+      g_view = &g_views[TURN_VIEW(MOVEMENT_ANIMATION_FRAMES + 1 - phase)];
+      break;
+    default:  // TURN_RIGHT_ANIMATION
+      g_view = &g_views[TURN_VIEW(phase)];
+      g_view_direction = get_direction_to_the_left(g_player->direction);
+      break;
+  }
+}
+
+/******************************************************************************
+   Function: get_light_radius
+
+Description: Determines how far the player's light reaches. On dark levels
+             (see "LEVEL_IS_DARK") that's only a cell or so, more with the
+             Pebble of Light equipped or with equipment infused with it;
+             elsewhere, everything in view is lit.
+
+     Inputs: None.
+
+    Outputs: Light radius, in cells of walking distance.
+******************************************************************************/
+int8_t get_light_radius(void) {
+  int8_t i, radius = DARK_LEVEL_LIGHT_RADIUS;
+
+  if (!LEVEL_IS_DARK(g_player->int8_stats[DEPTH])) {
+    return MAX_LIGHT_DISTANCE;
+  }
+  if (g_player->equipped_pebble == PEBBLE_OF_LIGHT) {
+    radius += PEBBLE_OF_LIGHT_RADIUS_BONUS;
+  }
+  for (i = 0; i < MAX_HEAVY_ITEMS; ++i) {
+    if (g_player->heavy_items[i].equipped &&
+        g_player->heavy_items[i].infused_pebble == PEBBLE_OF_LIGHT) {
+      radius += INFUSED_LIGHT_RADIUS_BONUS;
+    }
+  }
+
+  return radius;
+}
+
+/******************************************************************************
+   Function: update_shading
+
+Description: Updates the light radius and, if it or the location has changed,
+             rebuilds the floor and wall color lookup tables, which give each
+             color of the location's schemes as seen at each distance. On dark
+             levels, colors fall off toward black at the edge of the light
+             (and a little faster the deeper the level); elsewhere, each row of
+             a table is simply a copy of its scheme. (Textured walls, if
+             they were disabled for running over budget, are re-enabled.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void update_shading(void) {
+  int8_t i, j, falloff;
+  const int8_t depth = g_player->int8_stats[DEPTH];
+  uint32_t key;
+
+  g_light_radius = get_light_radius();
+  key = (uint32_t) (uint8_t) depth |
+        (uint32_t) (uint8_t) g_light_radius << 8 |
+        (uint32_t) (uint8_t) g_location->floor_color_scheme << 16 |
+        (uint32_t) (uint8_t) g_location->wall_color_scheme << 24;
+  if (key == g_shading_key) {
+    return;
+  }
+  g_shading_key = key;
+  g_wall_textures_enabled = true;  // Given another chance to fit the budget.
+  g_wall_texture_overruns = 0;
+  for (i = 0; i <= MAX_LIGHT_DISTANCE; ++i) {
+    falloff = LEVEL_IS_DARK(depth) ?
+                i * NUM_BACKGROUND_COLORS_PER_SCHEME / (g_light_radius + 1) +
+                  depth / DARKNESS_DEPTH_INTERVAL :
+                0;
+    for (j = 0; j < NUM_BACKGROUND_COLORS_PER_SCHEME; ++j) {
+      if (j + falloff < NUM_BACKGROUND_COLORS_PER_SCHEME) {
+        g_floor_shades[i][j] =
+          g_background_colors[g_location->floor_color_scheme][j + falloff];
+        g_wall_shades[i][j] =
+          g_background_colors[g_location->wall_color_scheme][j + falloff];
+      } else {
+        g_floor_shades[i][j] = g_wall_shades[i][j] = GColorBlack;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+   Function: update_floor_colors
+
+Description: Picks the two colors of each row of floor (and ceiling) tiles, as
+             seen from the view's cell (see "select_view"). Tiles alternate
+             like a checkerboard aligned to map cells, so the pattern flips
+             with each step (but looks the same in every direction). (If
+             neither the shading, the parity of the view's cell, nor the
+             view's floor rows have changed, there's nothing to do.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void update_floor_colors(void) {
+  uint8_t y, shade;
+  GColor light, dark;
+  const floor_row_t *row;
+  const uint8_t parity = (g_view_position.x + g_view_position.y) & 1;
+  const uint32_t phase = g_shading_key | (uint32_t) parity << 31;
+
+  if (phase == g_floor_phase && g_view->floor_rows == g_floor_phase_rows) {
+    return;
+  }
+  g_floor_phase = phase;
+  g_floor_phase_rows = g_view->floor_rows;
+  for (y = 0; y < MAX_FLOOR_ROWS; ++y) {
+    row = &g_view->floor_rows[y];
+    shade = row->step > NUM_BACKGROUND_COLORS_PER_SCHEME ?
+              NUM_BACKGROUND_COLORS_PER_SCHEME - 1         :
+              row->step - 1;
+    light = g_floor_shades[row->distance][shade];
+    dark = shade + FLOOR_TILE_SHADE_STEP < NUM_BACKGROUND_COLORS_PER_SCHEME ?
+             g_floor_shades[row->distance][shade + FLOOR_TILE_SHADE_STEP] :
+             GColorBlack;
+    if ((parity + row->distance) % 2) {
+      g_floor_row_colors[y][0] = dark;
+      g_floor_row_colors[y][1] = light;
+    } else {
+      g_floor_row_colors[y][0] = light;
+      g_floor_row_colors[y][1] = dark;
+    }
+  }
+}
+
+/******************************************************************************
+   Function: draw_floor_and_ceiling
+
+Description: Draws the floor and ceiling as a field of dots, out to the light
+             radius (see "update_shading"), in tiles aligned to map cells (see
+             "update_floor_colors" and "init_floor_rows") and shifted with the
+             view.
+
+     Inputs: ctx - Pointer to the relevant graphics context.
+
+    Outputs: None.
+******************************************************************************/
+void draw_floor_and_ceiling(GContext *ctx) {
+  uint8_t x, y, max_y;
+  int8_t tile;
+  int16_t boundary;
+  const floor_row_t *row;
+
+  update_floor_colors();
+  max_y = g_view->wall_coords[g_light_radius < MAX_VISIBILITY_DEPTH - 2 ?
+                                g_light_radius : MAX_VISIBILITY_DEPTH - 2]
+                             [0][TOP_LEFT].y;
+  for (y = 0; y < max_y; ++y) {
+    row = &g_view->floor_rows[y];
+    tile = row->first_tile;
+    boundary = row->first_boundary + g_view->shift * FLOOR_SUBPIXELS;
+    graphics_context_set_stroke_color(ctx, g_floor_row_colors[y][tile & 1]);
+    for (x = y % 2 ? 0 : (row->step / 2) + (row->step % 2);
+         x < GRAPHICS_FRAME_WIDTH;
+         x += row->step) {
+      // Check for the next tile (far away, a step may cross more than one):
+      if (x * FLOOR_SUBPIXELS >= boundary) {
+        do {
+          boundary += row->tile_width;
+          tile++;
+        } while (x * FLOOR_SUBPIXELS >= boundary);
+        graphics_context_set_stroke_color(ctx,
+                                          g_floor_row_colors[y][tile & 1]);
+      }
+
+      // Draw one point on the ceiling and another on the floor:
+      graphics_draw_pixel(ctx, GPoint(x, y + STATUS_BAR_HEIGHT));
+      graphics_draw_pixel(ctx, GPoint(x, GRAPHICS_FRAME_HEIGHT - y +
+                                           STATUS_BAR_HEIGHT));
+    }
+  }
+}
+
+/******************************************************************************
+   Function: draw_cell_walls
+
+Description: Draws any walls that exist along the back and sides of a given
+             cell.
+
+     Inputs: ctx      - Pointer to the relevant graphics context.
+             cell     - Coordinates of the cell of interest.
+             depth    - Front-back visual depth of the cell of interest in
+                        "g_back_wall_coords".
+             position - Left-right visual position of the cell of interest in
+                        "g_back_wall_coords".
+
+    Outputs: None.
+******************************************************************************/
+void draw_cell_walls(GContext *ctx,
+                     const GPoint cell,
+                     const int8_t depth,
+                     const int8_t position) {
+  int16_t left, right, top, bottom, y_offset, back_left, back_right;
+  bool back_wall_drawn, left_wall_drawn, right_wall_drawn;
+  const int8_t left_direction = get_direction_to_the_left(g_view_direction),
+               right_direction =
+                 get_direction_to_the_right(g_view_direction);
+  const uint16_t solid_neighbors = get_solid_neighborhood(cell);
+  const GColor *const colors =
+    g_wall_shades[depth + abs(position - STRAIGHT_AHEAD)];
+  const int8_t texture = g_wall_textures_enabled ?
+    g_scheme_wall_textures[g_location->wall_color_scheme] : NONE;
+  const uint8_t *const texels = texture == NONE ||
+                                !g_wall_texture_is_loaded[texture] ?
+                                  NULL : g_wall_textures[texture];
+
+  // Back wall (x coordinates shifted with the view, mid-turn):
+  left = back_left = g_view->wall_coords[depth][position][TOP_LEFT].x +
+                     g_view->shift;
+  right = back_right = g_view->wall_coords[depth][position][BOTTOM_RIGHT].x +
+                       g_view->shift;
+  top = g_view->wall_coords[depth][position][TOP_LEFT].y;
+  bottom = g_view->wall_coords[depth][position][BOTTOM_RIGHT].y;
+  if (bottom - top < MIN_WALL_HEIGHT) {
+    return;
+  }
+  back_wall_drawn = left_wall_drawn = right_wall_drawn = false;
+  if (solid_neighbors & get_neighborhood_bit(g_view_direction, NONE)) {
+    draw_shaded_quad(ctx,
+                     GPoint(left, top + STATUS_BAR_HEIGHT),
+                     GPoint(left, bottom + STATUS_BAR_HEIGHT),
+                     GPoint(right, top + STATUS_BAR_HEIGHT),
+                     GPoint(right, bottom + STATUS_BAR_HEIGHT),
+                     GPoint(left, top + STATUS_BAR_HEIGHT),
+                     colors,
+                     texels,
+                     TEXTURE_STEP(right - left));
+    graphics_context_set_stroke_color(ctx, GColorBlack);
+    graphics_draw_line(ctx,
+                       GPoint(left, top + STATUS_BAR_HEIGHT),
+                       GPoint(right, top + STATUS_BAR_HEIGHT));
+    graphics_draw_line(ctx,
+                       GPoint(left, bottom + STATUS_BAR_HEIGHT),
+                       GPoint(right, bottom + STATUS_BAR_HEIGHT));
+
+    // Ad hoc solution to a minor visual issue (remove if no longer relevant):
+    if (top == g_view->wall_coords[1][0][TOP_LEFT].y) {
+      graphics_draw_line(ctx,
+                         GPoint(left, bottom + 1 + STATUS_BAR_HEIGHT),
+                         GPoint(right, bottom + 1 + STATUS_BAR_HEIGHT));
+    }
+
+    // A closed door is drawn on the wall it blocks:
+    if (get_cell_type(get_cell_farther_away(cell, g_view_direction, 1)) ==
+          DOOR) {
+      graphics_context_set_fill_color(ctx, GColorWindsorTan);
+      graphics_fill_rect(ctx,
+                         GRect(left + (right - left) / 4,
+                               top + (bottom - top) / 4 + STATUS_BAR_HEIGHT,
+                               (right - left) / 2,
+                               bottom - top - (bottom - top) / 4),
+                         NO_CORNER_RADIUS,
+                         GCornerNone);
+      graphics_draw_rect(ctx,
+                         GRect(left + (right - left) / 4,
+                               top + (bottom - top) / 4 + STATUS_BAR_HEIGHT,
+                               (right - left) / 2,
+                               bottom - top - (bottom - top) / 4));
+    }
+
+    back_wall_drawn = true;
+  }
+
+  // Left wall:
+  right = left;
+  if (depth == 0) {
+    left = g_view->shift;
+    y_offset = top;
+  } else {
+    left = g_view->wall_coords[depth - 1][position][TOP_LEFT].x +
+           g_view->shift;
+    y_offset = top - g_view->wall_coords[depth - 1][position][TOP_LEFT].y;
+  }
+  if (position <= STRAIGHT_AHEAD) {
+    if (solid_neighbors & get_neighborhood_bit(left_direction, NONE)) {
+      draw_shaded_quad(ctx,
+                       GPoint(left, top - y_offset + STATUS_BAR_HEIGHT),
+                       GPoint(left, bottom + y_offset + STATUS_BAR_HEIGHT),
+                       GPoint(right, top + STATUS_BAR_HEIGHT),
+                       GPoint(right, bottom + STATUS_BAR_HEIGHT),
+                       GPoint(left, top - y_offset + STATUS_BAR_HEIGHT),
+                       colors,
+                       texels,
+                       TEXTURE_STEP(right - left));
+      graphics_context_set_stroke_color(ctx, GColorBlack);
+      graphics_draw_line(ctx,
+                         GPoint(left, top - y_offset + STATUS_BAR_HEIGHT),
+                         GPoint(right, top + STATUS_BAR_HEIGHT));
+      graphics_draw_line(ctx,
+                         GPoint(left, bottom + y_offset + STATUS_BAR_HEIGHT),
+                         GPoint(right, bottom + STATUS_BAR_HEIGHT));
+      left_wall_drawn = true;
+    }
+  }
+
+  // Right wall:
+  left = back_right;
+  if (depth == 0) {
+    right = GRAPHICS_FRAME_WIDTH - 1 + g_view->shift;
+  } else {
+    right = g_view->wall_coords[depth - 1][position][BOTTOM_RIGHT].x +
+            g_view->shift;
+  }
+  if (position >= STRAIGHT_AHEAD) {
+    if (solid_neighbors & get_neighborhood_bit(right_direction, NONE)) {
+      draw_shaded_quad(ctx,
+                       GPoint(left, top + STATUS_BAR_HEIGHT),
+                       GPoint(left, bottom + STATUS_BAR_HEIGHT),
+                       GPoint(right, top - y_offset + STATUS_BAR_HEIGHT),
+                       GPoint(right, bottom + y_offset + STATUS_BAR_HEIGHT),
+                       GPoint(left, top + STATUS_BAR_HEIGHT),
+                       colors,
+                       texels,
+                       TEXTURE_STEP(right - left));
+      graphics_context_set_stroke_color(ctx, GColorBlack);
+      graphics_draw_line(ctx,
+                         GPoint(left, top + STATUS_BAR_HEIGHT),
+                         GPoint(right, top - y_offset + STATUS_BAR_HEIGHT));
+      graphics_draw_line(ctx,
+                         GPoint(left, bottom + STATUS_BAR_HEIGHT),
+                         GPoint(right, bottom + y_offset + STATUS_BAR_HEIGHT));
+      right_wall_drawn = true;
+    }
+  }
+
+  // Draw vertical lines at corners:
+  graphics_context_set_stroke_color(ctx, GColorBlack);
+  if ((back_wall_drawn && (left_wall_drawn ||
+       !(solid_neighbors & get_neighborhood_bit(g_view_direction,
+                                             left_direction)))) ||
+      (left_wall_drawn &&
+       !(solid_neighbors & get_neighborhood_bit(g_view_direction,
+                                             left_direction)))) {
+    graphics_draw_line(ctx,
+                       GPoint(back_left, top + STATUS_BAR_HEIGHT),
+                       GPoint(back_left, bottom + STATUS_BAR_HEIGHT));
+  }
+  if ((back_wall_drawn && (right_wall_drawn ||
+       !(solid_neighbors & get_neighborhood_bit(g_view_direction,
+                                             right_direction)))) ||
+      (right_wall_drawn &&
+       !(solid_neighbors & get_neighborhood_bit(g_view_direction,
+                                             right_direction)))) {
+    graphics_draw_line(ctx,
+                       GPoint(back_right, bottom + STATUS_BAR_HEIGHT),
+                       GPoint(back_right, top + STATUS_BAR_HEIGHT));
+  }
+}
+
+/******************************************************************************
+   Function: draw_cell_contents
+
+Description: Draws an NPC or any other contents present in a given cell
+             (loot, an exit, a key, etc.; see "g_cell_attributes").
+
+     Inputs: ctx      - Pointer to the relevant graphics context.
+             cell     - Coordinates of the cell of interest.
+             depth    - Front-back visual depth of the cell of interest in
+                        "g_view->wall_coords".
+             position - Left-right visual position of the cell of interest in
+                        "g_view->wall_coords".
+
+    Outputs: None.
+******************************************************************************/
+void draw_cell_contents(GContext *ctx,
+                        const GPoint cell,
+                        const int8_t depth,
+                        const int8_t position) {
+  uint8_t drawing_unit,  // Reference variable for drawing contents at depth.
+          h_radius,
+          v_radius;  // Of the cell's floor (or ceiling) ellipse.
+  int16_t i;
+  GPoint floor_center_point;
+  int8_t npc = get_npc_at(cell);
+  const int8_t type = get_cell_type(cell);
+  const npc_archetype_t *archetype;
+
+  // Most cells have nothing to draw:
+  if (npc == NONE &&
+      !(CELL_ATTRIBUTES(type) & DRAWN) &&
+      !gpoint_equal(&cell, &g_location->entrance)) {
+    return;
+  }
+
+  // Determine the drawing unit, floor center point, and ellipse radii:
+  drawing_unit = get_drawing_unit(depth, position);
+  floor_center_point = get_floor_center_point(depth, position);
+  h_radius = ELLIPSE_RADIUS_RATIO *
+               (g_view->wall_coords[depth][position][BOTTOM_RIGHT].x -
+                g_view->wall_coords[depth][position][TOP_LEFT].x);
+  v_radius = depth == 0 ?
+               ELLIPSE_RADIUS_RATIO *
+                 (GRAPHICS_FRAME_HEIGHT -
+                  g_view->wall_coords[depth][position][BOTTOM_RIGHT].y) :
+               ELLIPSE_RADIUS_RATIO *
+                 (g_view->wall_coords[depth - 1][position][BOTTOM_RIGHT].y -
+                  g_view->wall_coords[depth][position][BOTTOM_RIGHT].y);
+
+  // Check for an entrance (hole in the ceiling):
+  if (gpoint_equal(&cell, &g_location->entrance)) {
+    fill_ellipse(ctx,
+                 GPoint(floor_center_point.x,
+                        GRAPHICS_FRAME_HEIGHT - floor_center_point.y +
+                          STATUS_BAR_HEIGHT * 2),
+                 h_radius,
+                 v_radius,
+                 GColorBlack);
+  }
+
+  // Check for an exit (hole in the ground) or a shadow cast by loot:
+  if (CELL_ATTRIBUTES(type) & FLOOR_ELLIPSE) {
+    fill_ellipse(ctx, floor_center_point, h_radius, v_radius, GColorBlack);
+  }
+
+  // If there's no NPC, check for loot, keys, etc., then we're done:
+  if (npc == NONE) {
+    if (CELL_ATTRIBUTES(type) & LOOT) {
+      graphics_context_set_fill_color(ctx, GColorYellow);
+      graphics_fill_rect(ctx,
+                         GRect(floor_center_point.x - drawing_unit * 2,
+                               floor_center_point.y - drawing_unit * 2.5,
+                               drawing_unit * 4,
+                               drawing_unit * 2.5),
+                         drawing_unit / 2,
+                         GCornersTop);
+    } else if (type == KEY) {
+      graphics_context_set_fill_color(ctx, GColorChromeYellow);
+      graphics_fill_circle(ctx,
+                           GPoint(floor_center_point.x - drawing_unit,
+                                  floor_center_point.y - drawing_unit),
+                           drawing_unit);
+      graphics_fill_rect(ctx,
+                         GRect(floor_center_point.x,
+                               floor_center_point.y - drawing_unit * 1.5,
+                               drawing_unit * 2,
+                               drawing_unit),
+                         NO_CORNER_RADIUS,
+                         GCornerNone);
+    } else if (type == TRAP) {  // A pressure plate.
+      graphics_context_set_fill_color(ctx, GColorDarkGray);
+      graphics_fill_rect(ctx,
+                         GRect(floor_center_point.x - drawing_unit * 3,
+                               floor_center_point.y - drawing_unit / 2,
+                               drawing_unit * 6,
+                               drawing_unit),
+                         NO_CORNER_RADIUS,
+                         GCornerNone);
+    } else if (type == LOCKED_GATE) {  // Bars from floor to ceiling.
+      graphics_context_set_stroke_color(ctx, GColorLightGray);
+      for (i = -2; i <= 2; ++i) {
+        graphics_draw_line(ctx,
+                           GPoint(floor_center_point.x + i * drawing_unit * 2,
+                                  floor_center_point.y),
+                           GPoint(floor_center_point.x + i * drawing_unit * 2,
+                                  GRAPHICS_FRAME_HEIGHT - floor_center_point.y +
+                                    STATUS_BAR_HEIGHT * 2));
+      }
+    }
+
+    return;
+  }
+
+  // Prepare to draw the NPC (partway from its previous cell if it has only
+  // just moved) and its shadow:
+  interpolate_npc_movement(npc,
+                           depth,
+                           position,
+                           &floor_center_point,
+                           &drawing_unit);
+  fill_ellipse(ctx, floor_center_point, h_radius, v_radius, GColorBlack);
+  archetype = &g_npc_archetypes[g_npcs->types[npc]];
+  drawing_unit += archetype->size;
+
+  // Mages:
+  if (archetype->body == MAGE_BODY) {
+    // Body:
+    graphics_context_set_fill_color(ctx, GColorBlack);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 2,
+                             floor_center_point.y - drawing_unit * 8,
+                             drawing_unit * 4,
+                             drawing_unit * 8),
+                       drawing_unit,
+                       GCornersTop);
+
+    // Head:
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit,
+                             floor_center_point.y - drawing_unit * 10,
+                             drawing_unit * 2,
+                             drawing_unit * 2),
+                       drawing_unit,
+                       GCornersTop);
+
+    // Eyes:
+    graphics_context_set_fill_color(ctx, RANDOM_BRIGHT_COLOR);
+    graphics_fill_circle(ctx,
+                         GPoint(floor_center_point.x - drawing_unit / 3,
+                                floor_center_point.y - drawing_unit * 9),
+                         drawing_unit / 5);
+    graphics_fill_circle(ctx,
+                         GPoint(floor_center_point.x + drawing_unit / 3,
+                                floor_center_point.y - drawing_unit * 9),
+                         drawing_unit / 5);
+
+  // Floating monsters:
+  } else if (archetype->body == FLOATING_MONSTER_BODY) {
+    // Body/head:
+    graphics_context_set_fill_color(ctx,
+                                    archetype->color_variant ?
+                                      GColorDarkCandyAppleRed :
+                                      GColorBulgarianRose);
+    graphics_fill_circle(ctx,
+                         GPoint(floor_center_point.x,
+                                floor_center_point.y - drawing_unit * 4),
+                         drawing_unit * 3 - drawing_unit / 2);
+
+    // Eye:
     i = floor_center_point.y - drawing_unit * 5;
     fill_ellipse(ctx,
                  GPoint(floor_center_point.x, i),
                  drawing_unit + 1,
                  drawing_unit / 2 + 1,
                  GColorPastelYellow);
-    graphics_context_set_fill_color(ctx, npc->type % 2 ? GColorVividCerulean :
-                                                         GColorDukeBlue);
+    graphics_context_set_fill_color(ctx, archetype->color_variant ?
+                                           GColorVividCerulean :
+                                           GColorDukeBlue);
     graphics_fill_circle(ctx,
                          GPoint(floor_center_point.x, i),
                          drawing_unit / 2);
@@ -1800,801 +4332,1544 @@ void draw_cell_contents(GContext *ctx,
                          GPoint(floor_center_point.x, i),
                          drawing_unit / 5);
 
-    // Mouth:
-    for (i = floor_center_point.x - drawing_unit +
-               ((npc->type == BLACK_MONSTER_MEDIUM ||
-                 npc->type == WHITE_MONSTER_MEDIUM) ? 1 : 0);
-         i < floor_center_point.x + drawing_unit - drawing_unit / 4;
-         i += drawing_unit / 2) {
-      graphics_context_set_fill_color(ctx, GColorSunsetOrange);
-      graphics_fill_rect(ctx,
-                         GRect(i,
-                               floor_center_point.y - drawing_unit * 4,
-                               drawing_unit / 2,
-                               drawing_unit + (drawing_unit / 4) *
-                                 (time(0) % 2 + 1)),
-                         drawing_unit / 2,
-                         GCornersAll);
+    // Mouth:
+    for (i = floor_center_point.x - drawing_unit +
+               (archetype->size == MEDIUM_NPC ? 1 : 0);
+         i < floor_center_point.x + drawing_unit - drawing_unit / 4;
+         i += drawing_unit / 2) {
+      graphics_context_set_fill_color(ctx, GColorSunsetOrange);
+      graphics_fill_rect(ctx,
+                         GRect(i,
+                               floor_center_point.y - drawing_unit * 4,
+                               drawing_unit / 2,
+                               drawing_unit + (drawing_unit / 4) *
+                                 (ANIMATION_FRAME + 1)),
+                         drawing_unit / 2,
+                         GCornersAll);
+    }
+
+  // Goblins, trolls, and ogres:
+  } else if (archetype->body == HUMANOID_MONSTER_BODY) {
+    // Legs:
+    graphics_context_set_fill_color(ctx, archetype->color_variant ?
+                                           GColorLimerick :
+                                           GColorArmyGreen);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 2,
+                             floor_center_point.y - drawing_unit * 3,
+                             drawing_unit,
+                             drawing_unit * 3),
+                       drawing_unit,
+                       GCornerTopLeft);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x + drawing_unit,
+                             floor_center_point.y - drawing_unit * 3,
+                             drawing_unit,
+                             drawing_unit * 3),
+                       drawing_unit,
+                       GCornerTopRight);
+
+    // Torso and head:
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit,
+                             floor_center_point.y - drawing_unit * 6 -
+                               drawing_unit / 2,
+                             drawing_unit * 2,
+                             drawing_unit * 4 + drawing_unit / 2),
+                       drawing_unit,
+                       GCornersTop);
+
+    // Arms:
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 3,
+                             floor_center_point.y - drawing_unit * 5 -
+                               drawing_unit / 2,
+                             drawing_unit * 6,
+                             drawing_unit),
+                       drawing_unit / 2,
+                       GCornersAll);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 3,
+                             floor_center_point.y - drawing_unit * 5 -
+                               drawing_unit / 2,
+                             drawing_unit,
+                             drawing_unit * 2),
+                       drawing_unit / 2,
+                       GCornersAll);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x + drawing_unit * 2,
+                             floor_center_point.y - drawing_unit * 6 -
+                               drawing_unit / 2,
+                             drawing_unit,
+                             drawing_unit * 2),
+                       drawing_unit / 2,
+                       GCornersAll);
+
+    // Eyes:
+    graphics_context_set_fill_color(ctx, GColorPastelYellow);
+    graphics_fill_circle(ctx,
+                         GPoint(floor_center_point.x - drawing_unit / 2,
+                                floor_center_point.y - drawing_unit * 5 -
+                                  drawing_unit / 2),
+                         drawing_unit / 6);
+    graphics_fill_circle(ctx,
+                         GPoint(floor_center_point.x + drawing_unit / 2 - 1,
+                                floor_center_point.y - drawing_unit * 5 -
+                                  drawing_unit / 2),
+                         drawing_unit / 6);
+
+    // Mouth (too small to see far away, or gliding in from there):
+    if (depth < 4 && drawing_unit >= 3) {
+      for (i = floor_center_point.x - drawing_unit / 2 -
+                 (archetype->size == LARGE_NPC ? 1 : 0);
+           i < floor_center_point.x + drawing_unit / 2;
+           i += drawing_unit / 3) {
+        graphics_context_set_fill_color(ctx, GColorSunsetOrange);
+        graphics_fill_rect(ctx,
+                           GRect(i,
+                                 floor_center_point.y - drawing_unit * 5,
+                                 drawing_unit / 3,
+                                 drawing_unit / 2 + (ANIMATION_FRAME ? 0 :
+                                                     drawing_unit / 4)),
+                           drawing_unit / 2,
+                           GCornersAll);
+      }
+    }
+
+  // Warriors:
+  } else {
+    // Legs:
+    graphics_context_set_fill_color(ctx, GColorWindsorTan);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit -
+                               drawing_unit / 2,
+                             floor_center_point.y - drawing_unit * 4,
+                             drawing_unit,
+                             drawing_unit * 4),
+                       NO_CORNER_RADIUS,
+                       GCornerNone);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x + drawing_unit / 2,
+                             floor_center_point.y - drawing_unit * 4,
+                             drawing_unit,
+                             drawing_unit * 4),
+                       NO_CORNER_RADIUS,
+                       GCornerNone);
+
+    // Arms (as one big rectangle behind the torso, shield, and weapon):
+    graphics_context_set_fill_color(ctx, GColorMelon);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 2 -
+                               drawing_unit / 2,
+                             floor_center_point.y - drawing_unit * 7,
+                             drawing_unit * 5,
+                             drawing_unit * 2 + 1 -
+                               (ANIMATION_FRAME ? drawing_unit / 2 : 0)),
+                       drawing_unit / 2,
+                       GCornersAll);
+
+    // Torso:
+    graphics_context_set_fill_color(ctx, GColorDarkGray);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit -
+                               drawing_unit / 2,
+                             floor_center_point.y - drawing_unit * 7,
+                             drawing_unit * 3,
+                             drawing_unit * 4),
+                       NO_CORNER_RADIUS,
+                       GCornerNone);
+
+    // Head:
+    graphics_context_set_fill_color(ctx, GColorLightGray);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit + 1,
+                             floor_center_point.y - drawing_unit * 9,
+                             drawing_unit * 2 - 2,
+                             drawing_unit * 2),
+                       drawing_unit / 4,
+                       GCornersTop);
+    graphics_context_set_fill_color(ctx, GColorBlack);
+         graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit / 2 -
+                               drawing_unit % 2,
+                             floor_center_point.y - drawing_unit * 8 -
+                               drawing_unit / 2,
+                             drawing_unit,
+                             drawing_unit / 3),
+                       NO_CORNER_RADIUS,
+                       GCornerNone);
+
+    // Shield:
+    graphics_context_set_fill_color(ctx, GColorBrass);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x + drawing_unit / 2,
+                             floor_center_point.y - drawing_unit * 6,
+                             drawing_unit * 3,
+                             drawing_unit * 3),
+                       drawing_unit,
+                       GCornersBottom);
+
+    // Weapon:
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 2 -
+                               drawing_unit / 2 - drawing_unit / 4,
+                             floor_center_point.y - drawing_unit * 6 -
+                               (ANIMATION_FRAME ? drawing_unit / 2 : 0),
+                             drawing_unit + drawing_unit / 2,
+                             drawing_unit / 2),
+                       drawing_unit / 4,
+                       GCornersBottom);
+    graphics_context_set_fill_color(ctx, GColorLightGray);
+    graphics_fill_rect(ctx,
+                       GRect(floor_center_point.x - drawing_unit * 2 -
+                               drawing_unit / 4,
+                             floor_center_point.y - drawing_unit * 10 -
+                               (ANIMATION_FRAME ? drawing_unit / 2 : 0),
+                             drawing_unit / 2,
+                             drawing_unit * 4),
+                       drawing_unit,
+                       GCornersTop);
+  }
+}
+
+/******************************************************************************
+   Function: get_drawing_unit
+
+Description: Determines the reference unit for drawing a cell's contents: a
+             tenth (rounded) of the width of the cell's back wall.
+
+     Inputs: depth    - Front-back visual depth of the cell of interest in
+                        "g_view->wall_coords".
+             position - Left-right visual position of the cell of interest in
+                        "g_view->wall_coords".
+
+    Outputs: The drawing unit, in pixels.
+******************************************************************************/
+uint8_t get_drawing_unit(const int8_t depth, const int8_t position) {
+  const int16_t wall_width =
+    g_view->wall_coords[depth][position][BOTTOM_RIGHT].x -
+    g_view->wall_coords[depth][position][TOP_LEFT].x;
+
+  return wall_width / 10 + (wall_width % 10 >= 5 ? 1 : 0);
+}
+
+/******************************************************************************
+   Function: get_floor_center_point
+
+Description: Determines where the center of a cell's floor is drawn (midway
+             between its back wall and its near edge, shifted with the view,
+             mid-turn).
+
+     Inputs: depth    - Front-back visual depth of the cell of interest in
+                        "g_view->wall_coords".
+             position - Left-right visual position of the cell of interest in
+                        "g_view->wall_coords".
+
+    Outputs: Screen coordinates of the floor's center.
+******************************************************************************/
+GPoint get_floor_center_point(const int8_t depth, const int8_t position) {
+  int16_t x_midpoint1, x_midpoint2, y;
+
+  x_midpoint1 = (g_view->wall_coords[depth][position][TOP_LEFT].x +
+                 g_view->wall_coords[depth][position][BOTTOM_RIGHT].x +
+                 g_view->shift * 2) / 2;
+  if (depth == 0) {  // Its near edge spans the screen (or a neighbor's).
+    x_midpoint2 = (position - STRAIGHT_AHEAD) * GRAPHICS_FRAME_WIDTH +
+                  GRAPHICS_FRAME_WIDTH / 2 + g_view->shift;
+    y = GRAPHICS_FRAME_HEIGHT;
+  } else {
+    x_midpoint2 =
+      (g_view->wall_coords[depth - 1][position][TOP_LEFT].x +
+       g_view->wall_coords[depth - 1][position][BOTTOM_RIGHT].x +
+       g_view->shift * 2) / 2;
+    y = (g_view->wall_coords[depth][position][BOTTOM_RIGHT].y +
+         g_view->wall_coords[depth - 1][position][BOTTOM_RIGHT].y) / 2;
+  }
+
+  return GPoint((x_midpoint1 + x_midpoint2) / 2, y + STATUS_BAR_HEIGHT);
+}
+
+/******************************************************************************
+   Function: interpolate_npc_movement
+
+Description: If a given NPC moved during the latest simulation step, adjusts
+             where it's drawn to lie partway between its previous cell and its
+             current one, according to the fraction of the next step that has
+             elapsed (see "get_step_interpolation"). NPCs arriving from cells
+             outside the view's projection (e.g., from behind the player) are
+             drawn where they are.
+
+     Inputs: npc                - Index of the NPC of interest.
+             depth              - Front-back visual depth of the NPC's cell.
+             position           - Left-right visual position of the NPC's
+                                  cell.
+             floor_center_point - Pointer to the cell's floor center point, to
+                                  be adjusted.
+             drawing_unit       - Pointer to the cell's drawing unit, to be
+                                  adjusted.
+
+    Outputs: None.
+******************************************************************************/
+void interpolate_npc_movement(const int8_t npc,
+                              const int8_t depth,
+                              const int8_t position,
+                              GPoint *const floor_center_point,
+                              uint8_t *const drawing_unit) {
+  int8_t previous_depth = depth, previous_position = position;
+  uint16_t fraction;
+  GPoint previous_point;
+  const int8_t direction = g_npcs->arrival_directions[npc];
+
+  if (direction == NONE) {
+    return;
+  }
+  fraction = get_step_interpolation();
+  if (fraction >= STEP_INTERPOLATION_SCALE) {
+    return;
+  }
+  if (direction == g_view_direction) {
+    previous_depth++;
+  } else if (direction == get_opposite_direction(g_view_direction)) {
+    previous_depth--;
+  } else if (direction == get_direction_to_the_left(g_view_direction)) {
+    previous_position--;
+  } else {
+    previous_position++;
+  }
+  if (previous_depth < 0 ||
+      previous_depth >= MAX_VISIBILITY_DEPTH - 1 ||
+      previous_position < 0 ||
+      previous_position > STRAIGHT_AHEAD * 2) {
+    return;
+  }
+  previous_point = get_floor_center_point(previous_depth, previous_position);
+  floor_center_point->x = previous_point.x +
+                          (floor_center_point->x - previous_point.x) *
+                            fraction / STEP_INTERPOLATION_SCALE;
+  floor_center_point->y = previous_point.y +
+                          (floor_center_point->y - previous_point.y) *
+                            fraction / STEP_INTERPOLATION_SCALE;
+  *drawing_unit = get_drawing_unit(previous_depth, previous_position) +
+                  (*drawing_unit -
+                   get_drawing_unit(previous_depth, previous_position)) *
+                    fraction / STEP_INTERPOLATION_SCALE;
+}
+
+/******************************************************************************
+   Function: draw_shaded_quad
+
+Description: Draws a shaded quadrilateral according to specifications, either
+             dithered or texture-mapped. Assumes the left and right sides are
+             parallel.
+
+     Inputs: ctx         - Pointer to the relevant graphics context.
+             upper_left  - Coordinates of the upper-left point.
+             lower_left  - Coordinates of the lower-left point.
+             upper_right - Coordinates of the upper-right point.
+             lower_right - Coordinates of the lower-right point.
+             shading_ref - Reference coordinates to assist in determining
+                           shading offset values for the quad's location in
+                           the 3D environment. (For walls, this is the same as
+                           "upper_left".)
+             colors      - The color scheme to shade with, as seen at the
+                           quad's distance (see "update_shading").
+             texture     - Shade offsets of the texture to map onto the quad,
+                           stretched once across it (NULL to dither).
+             column_step - Texture distance covered by each column of the
+                           quad (see "TEXTURE_STEP").
+
+    Outputs: None.
+******************************************************************************/
+void draw_shaded_quad(GContext *ctx,
+                      const GPoint upper_left,
+                      const GPoint lower_left,
+                      const GPoint upper_right,
+                      const GPoint lower_right,
+                      const GPoint shading_ref,
+                      const GColor *const colors,
+                      const uint8_t *const texture,
+                      const uint16_t column_step) {
+  int16_t i, j, shading_offset, half_shading_offset, top, bottom, rise,
+          color_index, texel_index, stroke_index;
+  uint16_t u, v, row_step;
+  const uint8_t *column;
+  const int16_t run = upper_right.x - upper_left.x;
+  GColor primary_color = GColorWhite;
+
+  for (i = upper_left.x > 0 ? upper_left.x : 0;  // Skip columns off screen.
+       i <= upper_right.x && i < GRAPHICS_FRAME_WIDTH;
+       ++i) {
+    // Determine the column's extent (in integers only, as the watch has no
+    // FPU) and the vertical distance between points:
+    rise = run ? (i - upper_left.x) * (upper_right.y - upper_left.y) / run : 0;
+    top = upper_left.y + rise;
+    bottom = lower_left.y - rise;
+    shading_offset = 1 + (shading_ref.y + rise) / MAX_VISIBILITY_DEPTH;
+    if ((shading_ref.y + rise) % MAX_VISIBILITY_DEPTH >=
+        MAX_VISIBILITY_DEPTH / 2 + MAX_VISIBILITY_DEPTH % 2) {
+      shading_offset++;
+    }
+    half_shading_offset = (shading_offset / 2) + (shading_offset % 2);
+    if (shading_offset - 3 > NUM_BACKGROUND_COLORS_PER_SCHEME) {
+      color_index = NUM_BACKGROUND_COLORS_PER_SCHEME - 1;
+    } else if (shading_offset > 4) {
+      color_index = shading_offset - 4;
+    } else {
+      color_index = 0;
+    }
+    primary_color = colors[color_index];
+
+    // Now, draw points from top to bottom:
+    if (texture == NULL) {
+      for (j = top; j < bottom; ++j) {
+        if ((j + rise + (i % 2 == 0 ? 0 : half_shading_offset)) %
+            shading_offset == 0) {
+          graphics_context_set_stroke_color(ctx, primary_color);
+        } else {
+          graphics_context_set_stroke_color(ctx, GColorBlack);
+        }
+        graphics_draw_pixel(ctx, GPoint(i, j));
+      }
+      continue;
+    }
+
+    // Or, for a textured quad, step down a column of the texture, each
+    // texel's shade offset darkening the primary color:
+    if (bottom <= top) {
+      continue;
+    }
+    u = (i - upper_left.x) * column_step;
+    column = &texture[(u >> WALL_TEXTURE_SHIFT) & (WALL_TEXTURE_SIZE - 1)];
+    row_step = TEXTURE_STEP(bottom - top);
+    stroke_index = NONE;
+    for (j = top, v = 0; j < bottom; ++j, v += row_step) {
+      texel_index = color_index + WALL_TEXTURE_SHADE_STEP *
+                    column[((v >> WALL_TEXTURE_SHIFT) &
+                            (WALL_TEXTURE_SIZE - 1)) * WALL_TEXTURE_SIZE];
+      if (texel_index >= NUM_BACKGROUND_COLORS_PER_SCHEME) {
+        texel_index = NUM_BACKGROUND_COLORS_PER_SCHEME - 1;
+      }
+      if (texel_index != stroke_index) {
+        graphics_context_set_stroke_color(ctx, colors[texel_index]);
+        stroke_index = texel_index;
+      }
+      graphics_draw_pixel(ctx, GPoint(i, j));
+    }
+  }
+}
+
+/******************************************************************************
+   Function: draw_status_meter
+
+Description: Draws a "status meter" (such as a "health meter") at a given point
+             according to given max. and current values of the attribute to be
+             represented.
+
+     Inputs: ctx    - Pointer to the relevant graphics context.
+             origin - Top-left corner of the status meter.
+             ratio  - Ratio of "current value" / "max. value" for the attribute
+                      to be represented.
+
+    Outputs: None.
+******************************************************************************/
+void draw_status_meter(GContext *ctx,
+                       GPoint origin,
+                       const float ratio) {
+  uint8_t filled_meter_width = ratio * STATUS_METER_WIDTH;
+
+  if (origin.x < SCREEN_CENTER_POINT_X) {  // Health meter:
+    graphics_context_set_fill_color(ctx, GColorRed);
+  } else {  // Energy meter:
+    graphics_context_set_fill_color(ctx, GColorBlue);
+  }
+
+  // First, draw a "full" meter:
+  graphics_fill_rect(ctx,
+                     GRect(origin.x,
+                           origin.y,
+                           STATUS_METER_WIDTH,
+                           STATUS_METER_HEIGHT),
+                     SMALL_CORNER_RADIUS,
+                     GCornersAll);
+
+  // Now draw the "empty" portion:
+  if (ratio < 1) {
+    if (origin.x < SCREEN_CENTER_POINT_X) {  // Health meter:
+      graphics_context_set_fill_color(ctx, GColorBulgarianRose);
+    } else {  // Energy meter:
+      graphics_context_set_fill_color(ctx, GColorOxfordBlue);
+    }
+    graphics_fill_rect(ctx,
+                       GRect(origin.x + filled_meter_width,
+                             origin.y,
+                             STATUS_METER_WIDTH - filled_meter_width + 1,
+                             STATUS_METER_HEIGHT),
+                       SMALL_CORNER_RADIUS,
+                       filled_meter_width < SMALL_CORNER_RADIUS ? GCornersAll :
+                                                                GCornersRight);
+  }
+}
+
+/******************************************************************************
+   Function: fill_ellipse
+
+Description: Draws a filled ellipse according to given specifications.
+
+     Inputs: ctx      - Pointer to the relevant graphics context.
+             center   - Central coordinates of the ellipse (with respect to the
+                        graphics frame).
+             h_radius - Horizontal radius.
+             v_radius - Vertical radius.
+             color    - Desired color ("GColorBlack" or "GColorWhite").
+
+    Outputs: None.
+******************************************************************************/
+void fill_ellipse(GContext *ctx,
+                  const GPoint center,
+                  const uint8_t h_radius,
+                  const uint8_t v_radius,
+                  const GColor color) {
+  int16_t theta;
+  uint8_t x_offset, y_offset;
+
+  graphics_context_set_stroke_color(ctx, color);
+  for (theta = 0; theta < NINETY_DEGREES; theta += DEFAULT_ROTATION_RATE) {
+    x_offset = cos_lookup(theta) * h_radius / TRIG_MAX_RATIO;
+    y_offset = sin_lookup(theta) * v_radius / TRIG_MAX_RATIO;
+    graphics_draw_line(ctx,
+                       GPoint(center.x - x_offset, center.y - y_offset),
+                       GPoint(center.x + x_offset, center.y - y_offset));
+    graphics_draw_line(ctx,
+                       GPoint(center.x - x_offset, center.y + y_offset),
+                       GPoint(center.x + x_offset, center.y + y_offset));
+  }
+}
+
+/******************************************************************************
+   Function: player_spell_timer_callback
+
+Description: Called when the player's spell timer reaches zero.
+
+     Inputs: data - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void player_spell_timer_callback(void *data) {
+  if (--g_player_current_spell_animation > 0) {
+    g_player_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
+                                              player_spell_timer_callback,
+                                              NULL);
+  }
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+}
+
+/******************************************************************************
+   Function: enemy_spell_timer_callback
+
+Description: Called when the enemy's spell timer reaches zero.
+
+     Inputs: data - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void enemy_spell_timer_callback(void *data) {
+  if (--g_enemy_current_spell_animation > 0) {
+    g_enemy_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
+                                             enemy_spell_timer_callback,
+                                             NULL);
+  }
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+}
+
+/******************************************************************************
+   Function: attack_timer_callback
+
+Description: Called when the attack timer reaches zero.
+
+     Inputs: data - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void attack_timer_callback(void *data) {
+  g_player_is_attacking = false;
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+}
+
+/******************************************************************************
+   Function: movement_timer_callback
+
+Description: Called at each frame of a step or turn animation. Frames are
+             timed from the start of the animation (see "select_view"), so if
+             drawing falls behind, frames are skipped rather than queued; once
+             the last one is due, the scene is drawn at rest.
+
+     Inputs: data - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void movement_timer_callback(void *data) {
+  const uint32_t elapsed_time = get_current_time_ms() -
+                                  g_movement_start_time;
+
+  if (elapsed_time < MOVEMENT_ANIMATION_FRAMES * MOVEMENT_FRAME_DURATION) {
+    g_movement_timer = app_timer_register(MOVEMENT_FRAME_DURATION -
+                                            elapsed_time %
+                                              MOVEMENT_FRAME_DURATION,
+                                          movement_timer_callback,
+                                          NULL);
+  } else {
+    g_movement_timer = NULL;
+    g_movement_animation = NONE;
+  }
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+}
+
+/******************************************************************************
+   Function: graphics_window_appear
+
+Description: Called when the graphics window appears.
+
+     Inputs: window - Pointer to the graphics window.
+
+    Outputs: None.
+******************************************************************************/
+static void graphics_window_appear(Window *window) {
+  g_player_current_spell_animation = g_enemy_current_spell_animation = 0;
+  g_player_is_attacking = false;
+  g_current_window = GRAPHICS_WINDOW;
+  start_simulation();
+}
+
+/******************************************************************************
+   Function: graphics_window_disappear
+
+Description: Called when the graphics window disappears (e.g., when a menu is
+             shown). Pauses the simulation.
+
+     Inputs: window - Pointer to the graphics window.
+
+    Outputs: None.
+******************************************************************************/
+static void graphics_window_disappear(Window *window) {
+  stop_simulation();
+  stop_movement_animation();
+}
+
+/******************************************************************************
+   Function: main_menu_appear
+
+Description: Called when the main menu appears.
+
+     Inputs: window - Pointer to the main menu window.
+
+    Outputs: None.
+******************************************************************************/
+static void main_menu_appear(Window *window) {
+  g_current_window = MAIN_MENU;
+}
+
+/******************************************************************************
+   Function: graphics_up_single_repeating_click
+
+Description: The graphics window's single repeating click handler for the "up"
+             button. Moves the player one cell forward.
+
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_up_single_repeating_click(ClickRecognizerRef recognizer,
+                                        void *context) {
+  if (g_current_window == GRAPHICS_WINDOW) {
+    move_player(g_player->direction);
+    dispatch_events();
+    register_player_input();
+  }
+}
+
+/******************************************************************************
+   Function: graphics_up_multi_click
+
+Description: The graphics window's multi-click handler for the "up" button.
+             Turns the player to the left (animated).
+
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_up_multi_click(ClickRecognizerRef recognizer, void *context) {
+  if (g_current_window == GRAPHICS_WINDOW) {
+    set_player_direction(get_direction_to_the_left(g_player->direction));
+    start_movement_animation(TURN_LEFT_ANIMATION);
+    register_player_input();
+  }
+}
+
+/******************************************************************************
+   Function: graphics_down_single_repeating_click
+
+Description: The graphics window's single repeating click handler for the
+             "down" button. Moves the player one cell backward.
+
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_down_single_repeating_click(ClickRecognizerRef recognizer,
+                                          void *context) {
+  if (g_current_window == GRAPHICS_WINDOW) {
+    move_player(get_opposite_direction(g_player->direction));
+    dispatch_events();
+    register_player_input();
+  }
+}
+
+/******************************************************************************
+   Function: graphics_down_multi_click
+
+Description: The graphics window's multi-click handler for the "down" button.
+             Turns the player to the right (animated).
+
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_down_multi_click(ClickRecognizerRef recognizer, void *context) {
+  if (g_current_window == GRAPHICS_WINDOW) {
+    set_player_direction(get_direction_to_the_right(g_player->direction));
+    start_movement_animation(TURN_RIGHT_ANIMATION);
+    register_player_input();
+  }
+}
+
+/******************************************************************************
+   Function: graphics_select_single_repeating_click
+
+Description: The graphics window's single repeating click handler for the
+             "select" button button. Activate's the player's current attack or
+             spell.
+
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_select_single_repeating_click(ClickRecognizerRef recognizer,
+                                            void *context) {
+  int8_t damage, npc = NONE;
+  GPoint cell;
+  heavy_item_t *weapon = get_heavy_item_equipped_at(RIGHT_HAND);
+
+  if (g_current_window == GRAPHICS_WINDOW &&
+      g_player->int16_stats[CURRENT_ENERGY] >=
+        g_player->int8_stats[FATIGUE_RATE]) {
+    adjust_player_current_energy(g_player->int8_stats[FATIGUE_RATE] * -1);
+    stop_movement_animation();  // Attacks are drawn at rest.
+
+    // Check for a targeted NPC (the window's solid border ends the search):
+    cell = get_cell_farther_away(g_player->position, g_player->direction, 1);
+    while (!WINDOW_CELL_IS_SOLID(cell)) {
+      npc = get_npc_at(cell);
+
+      // If we've found an NPC or the attack isn't ranged, we're done:
+      if (npc > NONE || g_player->equipped_pebble == NONE) {
+        break;
+      }
+      cell = get_cell_farther_away(cell, g_player->direction, 1);
     }
 
-  // Goblins, trolls, and ogres:
-  } else if (npc->type >= DARK_OGRE && npc->type <= PALE_GOBLIN) {
-    // Legs:
-    graphics_context_set_fill_color(ctx, npc->type % 2 ? GColorLimerick :
-                                                         GColorArmyGreen);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 2,
-                             floor_center_point.y - drawing_unit * 3,
-                             drawing_unit,
-                             drawing_unit * 3),
-                       drawing_unit,
-                       GCornerTopLeft);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x + drawing_unit,
-                             floor_center_point.y - drawing_unit * 3,
-                             drawing_unit,
-                             drawing_unit * 3),
-                       drawing_unit,
-                       GCornerTopRight);
+    // If a Pebble is equipped, cast a spell:
+    if (g_player->equipped_pebble > NONE) {
+      g_player_current_spell_animation = NUM_SPELL_ANIMATIONS;
+      g_player_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
+                                                player_spell_timer_callback,
+                                                NULL);
+      cast_spell_on_npc(npc,
+                        g_player->equipped_pebble,
+                        g_player->int8_stats[MAGICAL_POWER]);
 
-    // Torso and head:
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit,
-                             floor_center_point.y - drawing_unit * 6 -
-                               drawing_unit / 2,
-                             drawing_unit * 2,
-                             drawing_unit * 4 + drawing_unit / 2),
-                       drawing_unit,
-                       GCornersTop);
+    // Otherwise, the player is attacking with a physical weapon:
+    } else {
+      if (npc > NONE) {
+        damage = damage_npc(npc,
+                            rand() % g_player->int8_stats[PHYSICAL_POWER] -
+                              rand() % g_npcs->physical_defenses[npc]);
+      }
+
+      if (weapon) {
+        // Check for wound/stun effect from sharp/blunt weapons:
+        if (npc > NONE &&
+            rand() % g_player->int8_stats[PHYSICAL_POWER] >
+              rand() % g_npcs->physical_defenses[npc]) {
+          add_status_effect(npc,
+                            weapon->type % 2 ? DAMAGE_OVER_TIME : STUN,
+                            damage);
+        }
+
+        // Check for an infused Pebble:
+        if (weapon->infused_pebble > NONE) {
+          cast_spell_on_npc(npc,
+                            weapon->infused_pebble,
+                            g_player->int8_stats[MAGICAL_POWER] / 2);
+        }
+      }
+
+      // Set up the "attack slash" graphic:
+      g_player_is_attacking = true;
+      g_attack_slash_x1 = rand() % (GRAPHICS_FRAME_WIDTH / 3) +
+                            GRAPHICS_FRAME_WIDTH / 3;
+      g_attack_slash_x2 = rand() % (GRAPHICS_FRAME_WIDTH / 3) +
+                            GRAPHICS_FRAME_WIDTH / 3;
+      g_attack_slash_y1 = rand() % (GRAPHICS_FRAME_HEIGHT / 3) +
+                            STATUS_BAR_HEIGHT;
+      g_attack_slash_y2 = GRAPHICS_FRAME_HEIGHT - STATUS_BAR_HEIGHT -
+                            rand() % (GRAPHICS_FRAME_HEIGHT / 3);
+      g_attack_timer = app_timer_register(DEFAULT_TIMER_DURATION,
+                                          attack_timer_callback,
+                                          NULL);
+    }
+
+    post_event(SCENE_CHANGED_EVENT, 0);
+    dispatch_events();
+    register_player_input();
+  }
+}
+
+/******************************************************************************
+   Function: graphics_click_config_provider
+
+Description: Button-click configuration provider for the graphics window.
+
+     Inputs: context - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void graphics_click_config_provider(void *context) {
+  // "Up" button:
+  window_single_repeating_click_subscribe(BUTTON_ID_UP,
+                                          PLAYER_ACTION_REPEAT_INTERVAL,
+                                          graphics_up_single_repeating_click);
+  window_multi_click_subscribe(BUTTON_ID_UP,
+                               MULTI_CLICK_MIN,
+                               MULTI_CLICK_MAX,
+                               MULTI_CLICK_TIMEOUT,
+                               LAST_CLICK_ONLY,
+                               graphics_up_multi_click);
+
+  // "Down" button:
+  window_single_repeating_click_subscribe(BUTTON_ID_DOWN,
+                                         PLAYER_ACTION_REPEAT_INTERVAL,
+                                         graphics_down_single_repeating_click);
+  window_multi_click_subscribe(BUTTON_ID_DOWN,
+                               MULTI_CLICK_MIN,
+                               MULTI_CLICK_MAX,
+                               MULTI_CLICK_TIMEOUT,
+                               LAST_CLICK_ONLY,
+                               graphics_down_multi_click);
 
-    // Arms:
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 3,
-                             floor_center_point.y - drawing_unit * 5 -
-                               drawing_unit / 2,
-                             drawing_unit * 6,
-                             drawing_unit),
-                       drawing_unit / 2,
-                       GCornersAll);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 3,
-                             floor_center_point.y - drawing_unit * 5 -
-                               drawing_unit / 2,
-                             drawing_unit,
-                             drawing_unit * 2),
-                       drawing_unit / 2,
-                       GCornersAll);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x + drawing_unit * 2,
-                             floor_center_point.y - drawing_unit * 6 -
-                               drawing_unit / 2,
-                             drawing_unit,
-                             drawing_unit * 2),
-                       drawing_unit / 2,
-                       GCornersAll);
+  // "Select" button:
+  window_single_repeating_click_subscribe(BUTTON_ID_SELECT,
+                                       PLAYER_ACTION_REPEAT_INTERVAL,
+                                       graphics_select_single_repeating_click);
+}
 
-    // Eyes:
-    graphics_context_set_fill_color(ctx, GColorPastelYellow);
-    graphics_fill_circle(ctx,
-                         GPoint(floor_center_point.x - drawing_unit / 2,
-                                floor_center_point.y - drawing_unit * 5 -
-                                  drawing_unit / 2),
-                         drawing_unit / 6);
-    graphics_fill_circle(ctx,
-                         GPoint(floor_center_point.x + drawing_unit / 2 - 1,
-                                floor_center_point.y - drawing_unit * 5 -
-                                  drawing_unit / 2),
-                         drawing_unit / 6);
+/******************************************************************************
+   Function: narration_single_click
 
-    // Mouth:
-    if (depth < 4) {
-      for (i = floor_center_point.x - drawing_unit / 2 -
-                 (npc->type <= PALE_OGRE ? 1 : 0);
-           i < floor_center_point.x + drawing_unit / 2;
-           i += drawing_unit / 3) {
-        graphics_context_set_fill_color(ctx, GColorSunsetOrange);
-        graphics_fill_rect(ctx,
-                           GRect(i,
-                                 floor_center_point.y - drawing_unit * 5,
-                                 drawing_unit / 3,
-                                 drawing_unit / 2 + (time(0) % 2 ? 0 :
-                                                     drawing_unit / 4)),
-                           drawing_unit / 2,
-                           GCornersAll);
-      }
-    }
+Description: The narration window's single-click handler for all buttons. Shows
+             the next narration, if any, or hides the narration window.
 
-  // Warriors:
+     Inputs: recognizer - The click recognizer.
+             context    - Pointer to the associated context.
+
+    Outputs: None.
+******************************************************************************/
+void narration_single_click(ClickRecognizerRef recognizer, void *context) {
+  if (g_current_narration < INTRO_NARRATION_4) {
+    show_narration(++g_current_narration);
   } else {
-    // Legs:
-    graphics_context_set_fill_color(ctx, GColorWindsorTan);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit -
-                               drawing_unit / 2,
-                             floor_center_point.y - drawing_unit * 4,
-                             drawing_unit,
-                             drawing_unit * 4),
-                       NO_CORNER_RADIUS,
-                       GCornerNone);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x + drawing_unit / 2,
-                             floor_center_point.y - drawing_unit * 4,
-                             drawing_unit,
-                             drawing_unit * 4),
-                       NO_CORNER_RADIUS,
-                       GCornerNone);
+    window_stack_pop(NOT_ANIMATED);
+  }
+}
 
-    // Arms (as one big rectangle behind the torso, shield, and weapon):
-    graphics_context_set_fill_color(ctx, GColorMelon);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 2 -
-                               drawing_unit / 2,
-                             floor_center_point.y - drawing_unit * 7,
-                             drawing_unit * 5,
-                             drawing_unit * 2 + 1 -
-                               (time(0) % 2 ? drawing_unit / 2 : 0)),
-                       drawing_unit / 2,
-                       GCornersAll);
+/******************************************************************************
+   Function: narration_click_config_provider
 
-    // Torso:
-    graphics_context_set_fill_color(ctx, GColorDarkGray);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit -
-                               drawing_unit / 2,
-                             floor_center_point.y - drawing_unit * 7,
-                             drawing_unit * 3,
-                             drawing_unit * 4),
-                       NO_CORNER_RADIUS,
-                       GCornerNone);
+Description: Button-click configurations for the narration window.
 
-    // Head:
-    graphics_context_set_fill_color(ctx, GColorLightGray);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit + 1,
-                             floor_center_point.y - drawing_unit * 9,
-                             drawing_unit * 2 - 2,
-                             drawing_unit * 2),
-                       drawing_unit / 4,
-                       GCornersTop);
-    graphics_context_set_fill_color(ctx, GColorBlack);
-         graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit / 2 -
-                               drawing_unit % 2,
-                             floor_center_point.y - drawing_unit * 8 -
-                               drawing_unit / 2,
-                             drawing_unit,
-                             drawing_unit / 3),
-                       NO_CORNER_RADIUS,
-                       GCornerNone);
+     Inputs: context - Pointer to the associated context.
 
-    // Shield:
-    graphics_context_set_fill_color(ctx, GColorBrass);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x + drawing_unit / 2,
-                             floor_center_point.y - drawing_unit * 6,
-                             drawing_unit * 3,
-                             drawing_unit * 3),
-                       drawing_unit,
-                       GCornersBottom);
+    Outputs: None.
+******************************************************************************/
+void narration_click_config_provider(void *context) {
+  window_single_click_subscribe(BUTTON_ID_SELECT, narration_single_click);
+  window_single_click_subscribe(BUTTON_ID_UP, narration_single_click);
+  window_single_click_subscribe(BUTTON_ID_DOWN, narration_single_click);
+  window_single_click_subscribe(BUTTON_ID_BACK, narration_single_click);
+}
 
-    // Weapon:
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 2 -
-                               drawing_unit / 2 - drawing_unit / 4,
-                             floor_center_point.y - drawing_unit * 6 -
-                               (time(0) % 2 ? drawing_unit / 2 : 0),
-                             drawing_unit + drawing_unit / 2,
-                             drawing_unit / 2),
-                       drawing_unit / 4,
-                       GCornersBottom);
-    graphics_context_set_fill_color(ctx, GColorLightGray);
-    graphics_fill_rect(ctx,
-                       GRect(floor_center_point.x - drawing_unit * 2 -
-                               drawing_unit / 4,
-                             floor_center_point.y - drawing_unit * 10 -
-                               (time(0) % 2 ? drawing_unit / 2 : 0),
-                             drawing_unit / 2,
-                             drawing_unit * 4),
-                       drawing_unit,
-                       GCornersTop);
+/******************************************************************************
+   Function: simulation_timer_callback
+
+Description: Called every SIMULATION_STEP_DURATION milliseconds (approximately)
+             while in active gameplay. Runs however many fixed-length steps of
+             game time have elapsed since the last call (up to
+             MAX_CATCH_UP_STEPS, beyond which missed steps are dropped), then
+             re-arms the simulation timer.
+
+     Inputs: data - Pointer to additional data (not used).
+
+    Outputs: None.
+******************************************************************************/
+static void simulation_timer_callback(void *data) {
+  uint8_t num_steps;
+  uint32_t current_time = get_current_time_ms();
+
+  g_simulation_timer = NULL;
+  g_simulation_time_accumulator += current_time - g_last_simulation_time;
+  g_last_simulation_time = current_time;
+  num_steps = g_simulation_time_accumulator / SIMULATION_STEP_DURATION;
+  if (num_steps > MAX_CATCH_UP_STEPS) {
+    num_steps = MAX_CATCH_UP_STEPS;
+    g_simulation_time_accumulator %= SIMULATION_STEP_DURATION;
+  } else {
+    g_simulation_time_accumulator -= num_steps * SIMULATION_STEP_DURATION;
+  }
+
+  // Stop early if the player dies (events are then dispatched all at once):
+  while (num_steps-- > 0 && g_player->int16_stats[CURRENT_HEALTH] > 0) {
+    simulation_step();
+  }
+  dispatch_events();
+
+  // Keep stepping unless nothing can change until the next input or spawn:
+  if (g_current_window == GRAPHICS_WINDOW && !simulation_can_idle()) {
+    g_simulation_timer = app_timer_register(SIMULATION_STEP_DURATION -
+                                              g_simulation_time_accumulator,
+                                            simulation_timer_callback,
+                                            NULL);
   }
+  start_npc_movement_animation();
 }
 
 /******************************************************************************
-   Function: draw_shaded_quad
+   Function: simulation_step
 
-Description: Draws a shaded quadrilateral according to specifications. Assumes
-             the left and right sides are parallel.
+Description: Advances the game world by one fixed-length step. NPCs act when
+             the AI scheduler says they're due (see "run_ai_scheduler"), and
+             status effects and player stat recovery proceed at their own step
+             intervals. (NPC generation is handled separately by
+             "spawn_timer_callback".)
 
-     Inputs: ctx         - Pointer to the relevant graphics context.
-             upper_left  - Coordinates of the upper-left point.
-             lower_left  - Coordinates of the lower-left point.
-             upper_right - Coordinates of the upper-right point.
-             lower_right - Coordinates of the lower-right point.
-             shading_ref - Reference coordinates to assist in determining
-                           shading offset values for the quad's location in
-                           the 3D environment. (For walls, this is the same as
-                           "upper_left".)
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void draw_shaded_quad(GContext *ctx,
-                      const GPoint upper_left,
-                      const GPoint lower_left,
-                      const GPoint upper_right,
-                      const GPoint lower_right,
-                      const GPoint shading_ref) {
-  int16_t i, j, shading_offset, half_shading_offset;
-  float dy_over_dx = (float) (upper_right.y - upper_left.y) /
-                             (upper_right.x - upper_left.x);
-  GColor primary_color = GColorWhite;
+void simulation_step(void) {
+  int8_t i, npc;
+  bool world_changed;
 
-  for (i = upper_left.x; i <= upper_right.x && i < GRAPHICS_FRAME_WIDTH; ++i) {
-    // Determine vertical distance between points:
-    shading_offset = 1 + ((shading_ref.y + (i - upper_left.x) * dy_over_dx) /
-                          MAX_VISIBILITY_DEPTH);
-    if ((int16_t) (shading_ref.y + (i - upper_left.x) * dy_over_dx) %
-        MAX_VISIBILITY_DEPTH >= MAX_VISIBILITY_DEPTH / 2 +
-                                MAX_VISIBILITY_DEPTH % 2) {
-      shading_offset++;
+  g_simulation_step++;
+
+  // Stream in any chunks the resident window still lacks:
+  if (!g_map_window_is_resident) {
+    g_map_window_is_resident = stream_map_chunks();
+  }
+
+  // Handle NPC behavior (only NPCs near the player are active; only moves
+  // made during this step are interpolated):
+  for (i = 0; i < g_npcs->num_live_npcs; ++i) {
+    g_npcs->arrival_directions[g_npcs->live_npcs[i]] = NONE;
+  }
+  if (!gpoint_equal(&g_activity_origin, &g_player->position)) {
+    update_npc_activity();
+  }
+  world_changed = run_ai_scheduler();
+  if (g_player->int16_stats[CURRENT_HEALTH] <= 0) {
+    return;
+  }
+
+  // Apply wounding/burning damage, then let status effects run down:
+  if (g_simulation_step % STATUS_EFFECT_INTERVAL == 0) {
+    for (i = g_npcs->num_active_npcs - 1; i >= 0; --i) {
+      npc = g_npcs->live_npcs[i];
+      if (g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(DAMAGE_OVER_TIME)) {
+        damage_npc(npc, get_status_effect(npc, DAMAGE_OVER_TIME) / 2);
+      }
     }
-    half_shading_offset = (shading_offset / 2) + (shading_offset % 2);
-    if (shading_offset - 3 > NUM_BACKGROUND_COLORS_PER_SCHEME) {
-      primary_color = g_background_colors[g_location->wall_color_scheme]
-                                        [NUM_BACKGROUND_COLORS_PER_SCHEME - 1];
-    } else if (shading_offset > 4) {
-      primary_color = g_background_colors[g_location->wall_color_scheme]
-                                         [shading_offset - 4];
-    } else {
-      primary_color = g_background_colors[g_location->wall_color_scheme][0];
+    advance_status_wheel();
+  }
+
+  // Handle player stat recovery:
+  if (g_simulation_step % STAT_RECOVERY_INTERVAL == 0 &&
+      player_is_recovering()) {
+    adjust_player_current_health(g_player->int8_stats[HEALTH_REGEN]);
+    adjust_player_current_energy(g_player->int8_stats[ENERGY_REGEN]);
+    world_changed = true;
+  }
+
+  if (world_changed) {
+    post_event(SCENE_CHANGED_EVENT, 0);
+  }
+}
+
+/******************************************************************************
+   Function: run_ai_scheduler
+
+Description: Lets active NPCs that are due act, until every NPC has been
+             visited or AI_TIME_BUDGET milliseconds have elapsed. NPCs within
+             MAX_SIGHT_DISTANCE of the player go first, so they never wait
+             behind distant ones; the rest are visited round-robin. (At least
+             one NPC acts per step, and NPCs left over when time runs out stay
+             due, so the next step resumes with them.) Stops early if the
+             player dies.
+
+     Inputs: None.
+
+    Outputs: "True" if any NPC acted.
+******************************************************************************/
+bool run_ai_scheduler(void) {
+  int8_t i, npc, num_visits = g_npcs->num_active_npcs;
+  uint32_t start_time = get_current_time_ms();
+
+  g_ai_max_lag = 0;
+  g_ai_npcs_processed = 0;
+
+  // First, NPCs near the player (a removed or dormant NPC's slot is taken by
+  // another NPC, so only move on if this NPC is still in its slot):
+  for (i = 0; i < g_npcs->num_active_npcs;) {
+    npc = g_npcs->live_npcs[i];
+    if (g_npcs->next_think_steps[npc] <= g_simulation_step &&
+        npc_is_within_sight_distance(npc) &&
+        !run_npc_turn(npc, start_time)) {
+      num_visits = 0;
+      break;
+    }
+    if (g_npcs->live_npcs[i] == npc) {
+      i++;
     }
+  }
 
-    // Now, draw points from top to bottom:
-    for (j = upper_left.y + (i - upper_left.x) * dy_over_dx;
-         j < lower_left.y - (i - upper_left.x) * dy_over_dx;
-         ++j) {
-      if ((j + (int16_t) ((i - upper_left.x) * dy_over_dx) +
-          (i % 2 == 0 ? 0 : half_shading_offset)) % shading_offset == 0) {
-        graphics_context_set_stroke_color(ctx, primary_color);
-      } else {
-        graphics_context_set_stroke_color(ctx, GColorBlack);
-      }
-      graphics_draw_pixel(ctx, GPoint(i, j));
+  // Then the rest, round-robin:
+  while (num_visits-- > 0) {
+    if (g_npcs->ai_cursor >= g_npcs->num_active_npcs) {
+      g_npcs->ai_cursor = 0;
+    }
+    npc = g_npcs->live_npcs[g_npcs->ai_cursor];
+    if (g_npcs->next_think_steps[npc] <= g_simulation_step &&
+        !run_npc_turn(npc, start_time)) {
+      break;
+    }
+    if (g_npcs->live_npcs[g_npcs->ai_cursor] == npc) {
+      g_npcs->ai_cursor++;
     }
   }
+#ifdef AI_SCHEDULER_STATS
+  APP_LOG(APP_LOG_LEVEL_DEBUG,
+          "AI step %d: %d NPCs processed, max. lag %d steps",
+          (int) g_simulation_step,
+          g_ai_npcs_processed,
+          (int) g_ai_max_lag);
+#endif
+
+  return g_ai_npcs_processed > 0;
 }
 
 /******************************************************************************
-   Function: draw_status_meter
+   Function: run_npc_turn
 
-Description: Draws a "status meter" (such as a "health meter") at a given point
-             according to given max. and current values of the attribute to be
-             represented.
+Description: Lets a given NPC that's due act, unless AI_TIME_BUDGET has run
+             out (and at least one NPC has already acted this step). Damage
+             deferred while the NPC was dormant is applied first, and an NPC
+             that wanders out of range goes dormant.
 
-     Inputs: ctx    - Pointer to the relevant graphics context.
-             origin - Top-left corner of the status meter.
-             ratio  - Ratio of "current value" / "max. value" for the attribute
-                      to be represented.
+     Inputs: npc        - Index of the NPC of interest.
+             start_time - Time at which the AI scheduler started this step.
 
-    Outputs: None.
+    Outputs: "False" if the AI scheduler should stop (because time ran out or
+             the player died).
 ******************************************************************************/
-void draw_status_meter(GContext *ctx,
-                       GPoint origin,
-                       const float ratio) {
-  uint8_t filled_meter_width = ratio * STATUS_METER_WIDTH;
+bool run_npc_turn(const int8_t npc, const uint32_t start_time) {
+  int8_t damage;
+  uint32_t lag;
+
+  if (g_ai_npcs_processed > 0 &&
+      get_current_time_ms() - start_time >= AI_TIME_BUDGET) {
+    return false;
+  }
+  lag = g_simulation_step - g_npcs->next_think_steps[npc];
+  if (lag > g_ai_max_lag) {
+    g_ai_max_lag = lag;
+  }
+  g_npcs->next_think_steps[npc] = g_simulation_step +
+                                    get_npc_think_interval(npc);
+  g_ai_npcs_processed++;
+
+  // Apply damage deferred while the NPC was dormant, then let it act:
+  if (g_npcs->pending_damage[npc] > 0) {
+    damage = g_npcs->pending_damage[npc];
+    g_npcs->pending_damage[npc] = 0;
+    damage_npc(npc, damage);
+  }
+  if (g_npcs->types[npc] > NONE) {
+    run_npc_ai(npc);
+    if (g_npcs->types[npc] > NONE && !npc_is_near_player(npc)) {
+      put_npc_to_sleep(npc);
+    }
+  }
 
-  if (origin.x < SCREEN_CENTER_POINT_X) {  // Health meter:
-    graphics_context_set_fill_color(ctx, GColorRed);
-  } else {  // Energy meter:
-    graphics_context_set_fill_color(ctx, GColorBlue);
+  // Check for player death:
+  if (g_player->int16_stats[CURRENT_HEALTH] <= 0) {
+    post_event(PLAYER_DIED_EVENT, 0);
+    return false;
   }
 
-  // First, draw a "full" meter:
-  graphics_fill_rect(ctx,
-                     GRect(origin.x,
-                           origin.y,
-                           STATUS_METER_WIDTH,
-                           STATUS_METER_HEIGHT),
-                     SMALL_CORNER_RADIUS,
-                     GCornersAll);
+  return true;
+}
 
-  // Now draw the "empty" portion:
-  if (ratio < 1) {
-    if (origin.x < SCREEN_CENTER_POINT_X) {  // Health meter:
-      graphics_context_set_fill_color(ctx, GColorBulgarianRose);
-    } else {  // Energy meter:
-      graphics_context_set_fill_color(ctx, GColorOxfordBlue);
-    }
-    graphics_fill_rect(ctx,
-                       GRect(origin.x + filled_meter_width,
-                             origin.y,
-                             STATUS_METER_WIDTH - filled_meter_width + 1,
-                             STATUS_METER_HEIGHT),
-                       SMALL_CORNER_RADIUS,
-                       filled_meter_width < SMALL_CORNER_RADIUS ? GCornersAll :
-                                                                GCornersRight);
+/******************************************************************************
+   Function: get_npc_think_interval
+
+Description: Determines how many steps a given NPC should wait between actions
+             according to its distance from the player. (NPCs near enough to
+             see the player act every NPC_ACTION_INTERVAL steps, while those
+             farther away act less often.)
+
+     Inputs: npc - Index of the NPC of interest.
+
+    Outputs: Number of steps until the NPC should act again.
+******************************************************************************/
+uint8_t get_npc_think_interval(const int8_t npc) {
+  if (npc_is_within_sight_distance(npc)) {
+    return NPC_ACTION_INTERVAL;
   }
+
+  return NPC_ACTION_INTERVAL * DISTANT_NPC_INTERVAL_MULTIPLIER;
 }
 
 /******************************************************************************
-   Function: fill_ellipse
+   Function: run_npc_ai
 
-Description: Draws a filled ellipse according to given specifications.
+Description: Lets a given NPC act: attacking or casting a spell at the player,
+             or moving toward (or away from) the player, unless the NPC is
+             stunned or slowed.
 
-     Inputs: ctx      - Pointer to the relevant graphics context.
-             center   - Central coordinates of the ellipse (with respect to the
-                        graphics frame).
-             h_radius - Horizontal radius.
-             v_radius - Vertical radius.
-             color    - Desired color ("GColorBlack" or "GColorWhite").
+     Inputs: npc - Index of the NPC of interest.
 
     Outputs: None.
 ******************************************************************************/
-void fill_ellipse(GContext *ctx,
-                  const GPoint center,
-                  const uint8_t h_radius,
-                  const uint8_t v_radius,
-                  const GColor color) {
-  int16_t theta;
-  uint8_t x_offset, y_offset;
+void run_npc_ai(const int8_t npc) {
+  int8_t diff_x, diff_y;
+  int16_t damage;
 
-  graphics_context_set_stroke_color(ctx, color);
-  for (theta = 0; theta < NINETY_DEGREES; theta += DEFAULT_ROTATION_RATE) {
-    x_offset = cos_lookup(theta) * h_radius / TRIG_MAX_RATIO;
-    y_offset = sin_lookup(theta) * v_radius / TRIG_MAX_RATIO;
-    graphics_draw_line(ctx,
-                       GPoint(center.x - x_offset, center.y - y_offset),
-                       GPoint(center.x + x_offset, center.y - y_offset));
-    graphics_draw_line(ctx,
-                       GPoint(center.x - x_offset, center.y + y_offset),
-                       GPoint(center.x + x_offset, center.y + y_offset));
+  if (!(g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(STUN)) &&
+      get_status_effect(npc, SLOW) % 2 == 0) {
+    damage = rand() % g_npcs->power[npc] -
+               get_status_effect(npc, WEAKNESS) / 2;
+    diff_x = g_npcs->positions[npc].x - g_player->position.x;
+    diff_y = g_npcs->positions[npc].y - g_player->position.y;
+    if (g_npcs->status_effects[npc] & STATUS_EFFECT_BIT(INTIMIDATION)) {
+      move_npc(npc, get_flow_field_direction(g_npcs->positions[npc], true));
+    } else if (g_npc_archetypes[g_npcs->types[npc]].ai_profile ==
+                 SPELLCASTER_AI &&
+               in_line_of_sight(g_npcs->positions[npc], g_player->position)) {
+      g_enemy_spell_caster = npc;
+      g_enemy_current_spell_animation = NUM_SPELL_ANIMATIONS;
+      g_enemy_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
+                                              enemy_spell_timer_callback,
+                                              NULL);
+      if (g_player->int8_stats[SHADOW_FORM] &&
+          (rand() % g_player->int8_stats[INTELLECT] +
+             g_player->int8_stats[SHADOW_FORM] > damage)) {
+        adjust_player_current_health(damage / 2 + 1);
+        adjust_player_current_energy(damage / 2 + 1);
+      } else {
+        damage_player(damage - rand() % g_player->int8_stats[MAGICAL_DEFENSE]);
+      }
+    } else if ((diff_x == 0 && abs(diff_y) == 1) ||
+               (diff_y == 0 && abs(diff_x) == 1)) {
+      damage_player(damage - rand() % g_player->int8_stats[PHYSICAL_DEFENSE]);
+      if (g_player->int8_stats[BACKLASH_DAMAGE]) {
+        damage_npc(npc,
+                   damage / (rand() % g_npcs->magical_defenses[npc] + 1) +
+                     g_player->int8_stats[BACKLASH_DAMAGE]);
+      }
+    } else {
+      move_npc(npc, get_flow_field_direction(g_npcs->positions[npc], false));
+    }
   }
 }
 
 /******************************************************************************
-   Function: player_spell_timer_callback
+   Function: start_simulation
 
-Description: Called when the player's spell timer reaches zero.
+Description: Starts (or restarts) the fixed-timestep simulation loop along
+             with the NPC generation timer.
 
-     Inputs: data - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void player_spell_timer_callback(void *data) {
-  if (--g_player_current_spell_animation > 0) {
-    g_player_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
-                                              player_spell_timer_callback,
-                                              NULL);
-  }
-  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+void start_simulation(void) {
+  stop_simulation();
+  arm_spawn_timer();
+  wake_simulation();
 }
 
 /******************************************************************************
-   Function: enemy_spell_timer_callback
+   Function: wake_simulation
 
-Description: Called when the enemy's spell timer reaches zero.
+Description: Restarts the fixed-timestep simulation loop if it has gone idle.
+             Time that passed while the simulation was idle is not simulated.
 
-     Inputs: data - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void enemy_spell_timer_callback(void *data) {
-  if (--g_enemy_current_spell_animation > 0) {
-    g_enemy_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
-                                             enemy_spell_timer_callback,
-                                             NULL);
+void wake_simulation(void) {
+  if (g_simulation_timer == NULL && g_current_window == GRAPHICS_WINDOW) {
+    g_last_simulation_time = get_current_time_ms();
+    g_simulation_time_accumulator = 0;
+    g_simulation_timer = app_timer_register(SIMULATION_STEP_DURATION,
+                                            simulation_timer_callback,
+                                            NULL);
   }
-  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
 }
 
 /******************************************************************************
-   Function: attack_timer_callback
+   Function: stop_simulation
 
-Description: Called when the attack timer reaches zero.
+Description: Stops the fixed-timestep simulation loop and the NPC generation
+             timer, if they're running.
 
-     Inputs: data - Pointer to additional data (not used).
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void attack_timer_callback(void *data) {
-  g_player_is_attacking = false;
-  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+void stop_simulation(void) {
+  if (g_simulation_timer) {
+    app_timer_cancel(g_simulation_timer);
+    g_simulation_timer = NULL;
+  }
+  if (g_spawn_timer) {
+    app_timer_cancel(g_spawn_timer);
+    g_spawn_timer = NULL;
+  }
+  if (g_npc_movement_timer) {
+    app_timer_cancel(g_npc_movement_timer);
+    g_npc_movement_timer = NULL;
+  }
 }
 
 /******************************************************************************
-   Function: graphics_window_appear
+   Function: simulation_can_idle
 
-Description: Called when the graphics window appears.
+Description: Determines whether the game state is quiescent, i.e., whether no
+             NPCs are active, no map chunks are waiting to be streamed in, and
+             the player's health and energy are full (or can't recover), so
+             simulation steps would change nothing.
 
-     Inputs: window - Pointer to the graphics window.
+     Inputs: None.
 
-    Outputs: None.
+    Outputs: "True" if the simulation loop may be suspended.
 ******************************************************************************/
-static void graphics_window_appear(Window *window) {
-  g_player_current_spell_animation = g_enemy_current_spell_animation = 0;
-  g_player_is_attacking = false;
-  g_current_window = GRAPHICS_WINDOW;
+bool simulation_can_idle(void) {
+  return g_npcs->num_active_npcs == 0 &&
+         g_map_window_is_resident &&
+         !player_is_recovering();
 }
 
 /******************************************************************************
-   Function: main_menu_appear
+   Function: player_is_recovering
 
-Description: Called when the main menu appears.
+Description: Determines whether stat recovery would change the player's current
+             health or energy.
 
-     Inputs: window - Pointer to the main menu window.
+     Inputs: None.
 
-    Outputs: None.
+    Outputs: "True" if the player's health or energy can still regenerate.
 ******************************************************************************/
-static void main_menu_appear(Window *window) {
-  g_current_window = MAIN_MENU;
+bool player_is_recovering(void) {
+  return (g_player->int16_stats[CURRENT_HEALTH] <
+            g_player->int16_stats[MAX_HEALTH] &&
+          g_player->int8_stats[HEALTH_REGEN] > 0) ||
+         (g_player->int16_stats[CURRENT_ENERGY] <
+            g_player->int16_stats[MAX_ENERGY] &&
+          g_player->int8_stats[ENERGY_REGEN] > 0);
 }
 
 /******************************************************************************
-   Function: graphics_up_single_repeating_click
+   Function: schedule_task
 
-Description: The graphics window's single repeating click handler for the "up"
-             button. Moves the player one cell forward.
+Description: Marks a given background task as pending and, if need be, arms
+             the task timer to run it (see "task_timer_callback").
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: task - The task to be run (e.g., NEXT_LEVEL_TASK).
 
     Outputs: None.
 ******************************************************************************/
-void graphics_up_single_repeating_click(ClickRecognizerRef recognizer,
-                                        void *context) {
-  if (g_current_window == GRAPHICS_WINDOW) {
-    move_player(g_player->direction);
+void schedule_task(const int8_t task) {
+  g_task_is_pending[task] = true;
+  if (g_task_timer == NULL) {
+    g_task_timer = app_timer_register(TASK_INTERVAL,
+                                      task_timer_callback,
+                                      NULL);
   }
 }
 
 /******************************************************************************
-   Function: graphics_up_multi_click
+   Function: task_timer_callback
 
-Description: The graphics window's multi-click handler for the "up" button.
-             Turns the player to the left.
+Description: Runs pending background tasks, a slice at a time, in order of
+             priority until TASK_TIME_BUDGET milliseconds have elapsed (at
+             least one slice is run), then re-arms the task timer if any
+             remain. Running between the app's other events keeps button
+             presses and drawing responsive.
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: data - Pointer to additional data (not used).
 
     Outputs: None.
 ******************************************************************************/
-void graphics_up_multi_click(ClickRecognizerRef recognizer, void *context) {
-  if (g_current_window == GRAPHICS_WINDOW) {
-    set_player_direction(get_direction_to_the_left(g_player->direction));
+static void task_timer_callback(void *data) {
+  int8_t i;
+  const uint32_t start_time = get_current_time_ms();
+
+  g_task_timer = NULL;
+  for (i = 0; i < NUM_TASKS; ++i) {
+    while (g_task_is_pending[i]) {
+      g_task_is_pending[i] = !run_task(i);
+      if (get_current_time_ms() - start_time >= TASK_TIME_BUDGET) {
+        break;
+      }
+    }
+    if (g_task_is_pending[i]) {
+      schedule_task(i);
+      break;
+    }
   }
 }
 
 /******************************************************************************
-   Function: graphics_down_single_repeating_click
+   Function: run_task
 
-Description: The graphics window's single repeating click handler for the
-             "down" button. Moves the player one cell backward.
+Description: Runs one slice of a given background task.
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: task - The task to be run.
 
-    Outputs: None.
+    Outputs: "True" if the task is complete.
 ******************************************************************************/
-void graphics_down_single_repeating_click(ClickRecognizerRef recognizer,
-                                          void *context) {
-  if (g_current_window == GRAPHICS_WINDOW) {
-    move_player(get_opposite_direction(g_player->direction));
+bool run_task(const int8_t task) {
+  switch (task) {
+    case CARVE_CHUNKS_TASK:
+      if (!run_level_generator(&g_chunk_generator)) {
+        return false;
+      }
+      finish_generated_chunks();
+      return true;
+    case NEXT_LEVEL_TASK:
+      return run_level_generator(&g_next_level);
+    default:  // case SAVE_GAME_TASK:
+      save_game();
+      return true;
   }
 }
 
 /******************************************************************************
-   Function: graphics_down_multi_click
+   Function: finish_task
 
-Description: The graphics window's multi-click handler for the "down" button.
-             Turns the player to the right.
+Description: Runs a given background task to completion, if it's pending.
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: task - The task to be finished.
 
     Outputs: None.
 ******************************************************************************/
-void graphics_down_multi_click(ClickRecognizerRef recognizer, void *context) {
-  if (g_current_window == GRAPHICS_WINDOW) {
-    set_player_direction(get_direction_to_the_right(g_player->direction));
+void finish_task(const int8_t task) {
+  while (g_task_is_pending[task]) {
+    g_task_is_pending[task] = !run_task(task);
   }
 }
 
 /******************************************************************************
-   Function: graphics_select_single_repeating_click
+   Function: spawn_timer_callback
 
-Description: The graphics window's single repeating click handler for the
-             "select" button button. Activate's the player's current attack or
-             spell.
+Description: Attempts to generate a new NPC near the player (which does nothing
+             if the NPC array is full), waking the simulation if successful,
+             then arms the timer for the next attempt.
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: data - Pointer to additional data (not used).
 
     Outputs: None.
 ******************************************************************************/
-void graphics_select_single_repeating_click(ClickRecognizerRef recognizer,
-                                            void *context) {
-  int8_t damage;
+static void spawn_timer_callback(void *data) {
+  int8_t i, direction = rand() % NUM_DIRECTIONS;
   GPoint cell;
-  npc_t *npc = NULL;
-  heavy_item_t *weapon = get_heavy_item_equipped_at(RIGHT_HAND);
 
-  if (g_current_window == GRAPHICS_WINDOW &&
-      g_player->int16_stats[CURRENT_ENERGY] >=
-        g_player->int8_stats[FATIGUE_RATE]) {
-    adjust_player_current_energy(g_player->int8_stats[FATIGUE_RATE] * -1);
+  g_spawn_timer = NULL;
 
-    // Check for a targeted NPC:
-    cell = get_cell_farther_away(g_player->position, g_player->direction, 1);
-    while (get_cell_type(cell) >= EMPTY) {
-      npc = get_npc_at(cell);
-
-      // If we've found an NPC or the attack isn't ranged, we're done:
-      if (npc || g_player->equipped_pebble == NONE) {
-        break;
-      }
-      cell = get_cell_farther_away(cell, g_player->direction, 1);
+  // Attempt to find a viable spawn point:
+  for (i = 0; i < NUM_DIRECTIONS; ++i) {
+    cell = get_cell_farther_away(g_player->position,
+                                 direction,
+                                 MAX_VISIBILITY_DEPTH - 1);
+    if (occupiable(cell)) {
+      break;
     }
-
-    // If a Pebble is equipped, cast a spell:
-    if (g_player->equipped_pebble > NONE) {
-      g_player_current_spell_animation = NUM_SPELL_ANIMATIONS;
-      g_player_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
-                                                player_spell_timer_callback,
-                                                NULL);
-      cast_spell_on_npc(npc,
-                        g_player->equipped_pebble,
-                        g_player->int8_stats[MAGICAL_POWER]);
-
-    // Otherwise, the player is attacking with a physical weapon:
-    } else {
-      if (npc) {
-        damage = damage_npc(npc,
-                            rand() % g_player->int8_stats[PHYSICAL_POWER] -
-                              rand() % npc->physical_defense);
-      }
-
-      if (weapon) {
-        // Check for wound/stun effect from sharp/blunt weapons:
-        if (npc &&
-            rand() % g_player->int8_stats[PHYSICAL_POWER] >
-              rand() % npc->physical_defense) {
-          npc->status_effects[weapon->type % 2 ? DAMAGE_OVER_TIME : STUN] +=
-            damage;
-        }
-
-        // Check for an infused Pebble:
-        if (weapon->infused_pebble > NONE) {
-          cast_spell_on_npc(npc,
-                            weapon->infused_pebble,
-                            g_player->int8_stats[MAGICAL_POWER] / 2);
-        }
-      }
-
-      // Set up the "attack slash" graphic:
-      g_player_is_attacking = true;
-      g_attack_slash_x1 = rand() % (GRAPHICS_FRAME_WIDTH / 3) +
-                            GRAPHICS_FRAME_WIDTH / 3;
-      g_attack_slash_x2 = rand() % (GRAPHICS_FRAME_WIDTH / 3) +
-                            GRAPHICS_FRAME_WIDTH / 3;
-      g_attack_slash_y1 = rand() % (GRAPHICS_FRAME_HEIGHT / 3) +
-                            STATUS_BAR_HEIGHT;
-      g_attack_slash_y2 = GRAPHICS_FRAME_HEIGHT - STATUS_BAR_HEIGHT -
-                            rand() % (GRAPHICS_FRAME_HEIGHT / 3);
-      g_attack_timer = app_timer_register(DEFAULT_TIMER_DURATION,
-                                          attack_timer_callback,
-                                          NULL);
+    if (++direction == NUM_DIRECTIONS) {
+      direction = 0;
     }
+  }
 
-    layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+  // Add any NPC type other than MAGE:
+  if (add_new_npc(rand() % (NUM_NPC_TYPES - 1), cell)) {
+    post_event(SCENE_CHANGED_EVENT, 0);
+    dispatch_events();
+    wake_simulation();
   }
+  arm_spawn_timer();
 }
 
 /******************************************************************************
-   Function: graphics_click_config_provider
+   Function: arm_spawn_timer
 
-Description: Button-click configuration provider for the graphics window.
+Description: Schedules the next NPC generation attempt (unless one is already
+             scheduled). The delay is drawn as though a 1-in-NPC_SPAWN_ODDS
+             roll were made every NPC_SPAWN_INTERVAL steps.
 
-     Inputs: context - Pointer to the associated context.
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void graphics_click_config_provider(void *context) {
-  // "Up" button:
-  window_single_repeating_click_subscribe(BUTTON_ID_UP,
-                                          PLAYER_ACTION_REPEAT_INTERVAL,
-                                          graphics_up_single_repeating_click);
-  window_multi_click_subscribe(BUTTON_ID_UP,
-                               MULTI_CLICK_MIN,
-                               MULTI_CLICK_MAX,
-                               MULTI_CLICK_TIMEOUT,
-                               LAST_CLICK_ONLY,
-                               graphics_up_multi_click);
-
-  // "Down" button:
-  window_single_repeating_click_subscribe(BUTTON_ID_DOWN,
-                                         PLAYER_ACTION_REPEAT_INTERVAL,
-                                         graphics_down_single_repeating_click);
-  window_multi_click_subscribe(BUTTON_ID_DOWN,
-                               MULTI_CLICK_MIN,
-                               MULTI_CLICK_MAX,
-                               MULTI_CLICK_TIMEOUT,
-                               LAST_CLICK_ONLY,
-                               graphics_down_multi_click);
+void arm_spawn_timer(void) {
+  uint32_t num_intervals = 1;
 
-  // "Select" button:
-  window_single_repeating_click_subscribe(BUTTON_ID_SELECT,
-                                       PLAYER_ACTION_REPEAT_INTERVAL,
-                                       graphics_select_single_repeating_click);
+  if (g_spawn_timer == NULL) {
+    while (rand() % NPC_SPAWN_ODDS) {
+      num_intervals++;
+    }
+    g_spawn_timer = app_timer_register(num_intervals * NPC_SPAWN_INTERVAL *
+                                         SIMULATION_STEP_DURATION,
+                                       spawn_timer_callback,
+                                       NULL);
+  }
 }
 
 /******************************************************************************
-   Function: narration_single_click
+   Function: register_player_input
 
-Description: The narration window's single-click handler for all buttons. Shows
-             the next narration, if any, or hides the narration window.
+Description: Called whenever the player acts in the graphics window. Keeps the
+             backlight on and wakes the simulation if it has gone idle.
 
-     Inputs: recognizer - The click recognizer.
-             context    - Pointer to the associated context.
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void narration_single_click(ClickRecognizerRef recognizer, void *context) {
-  if (g_current_narration < INTRO_NARRATION_4) {
-    show_narration(++g_current_narration);
-  } else {
-    window_stack_pop(NOT_ANIMATED);
-  }
+void register_player_input(void) {
+  light_enable_interaction();
+  wake_simulation();
 }
 
 /******************************************************************************
-   Function: narration_click_config_provider
+   Function: get_step_interpolation
 
-Description: Button-click configurations for the narration window.
+Description: Returns the fraction of a simulation step that has elapsed since
+             the most recent step, allowing the renderer to interpolate between
+             the previous and current simulation states (see
+             "interpolate_npc_movement"). Integer math only: the watch has no
+             FPU.
 
-     Inputs: context - Pointer to the associated context.
+     Inputs: None.
 
-    Outputs: None.
+    Outputs: A value from 0 (a step just ran) up to STEP_INTERPOLATION_SCALE
+             (a step is due, or the simulation is idle).
 ******************************************************************************/
-void narration_click_config_provider(void *context) {
-  window_single_click_subscribe(BUTTON_ID_SELECT, narration_single_click);
-  window_single_click_subscribe(BUTTON_ID_UP, narration_single_click);
-  window_single_click_subscribe(BUTTON_ID_DOWN, narration_single_click);
-  window_single_click_subscribe(BUTTON_ID_BACK, narration_single_click);
+uint16_t get_step_interpolation(void) {
+  uint32_t elapsed_time;
+
+  if (g_simulation_timer == NULL) {
+    return STEP_INTERPOLATION_SCALE;
+  }
+  elapsed_time = g_simulation_time_accumulator +
+                   (get_current_time_ms() - g_last_simulation_time);
+  if (elapsed_time >= SIMULATION_STEP_DURATION) {
+    return STEP_INTERPOLATION_SCALE;
+  }
+
+  return elapsed_time * STEP_INTERPOLATION_SCALE / SIMULATION_STEP_DURATION;
 }
 
 /******************************************************************************
-   Function: tick_handler
+   Function: start_npc_movement_animation
 
-Description: Handles changes to the game world every second while in active
-             gameplay.
+Description: If any active NPC moved during the latest simulation step, starts
+             redrawing the scene every MOVEMENT_FRAME_DURATION milliseconds
+             until the step's interpolation is complete, so those NPCs glide
+             into their new cells.
 
-     Inputs: tick_time     - Pointer to the relevant time struct.
-             units_changed - Indicates which time unit changed.
+     Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-static void tick_handler(struct tm *tick_time, TimeUnits units_changed) {
-  int8_t i,
-         j,
-         diff_x,
-         diff_y,
-         horizontal_direction,
-         vertical_direction,
-         direction = rand() % NUM_DIRECTIONS;
-  int16_t damage;
-  npc_t *npc;
-  GPoint cell;
-  bool player_is_visible_to_npc = false;
+void start_npc_movement_animation(void) {
+  int8_t i;
 
-  if (g_current_window == GRAPHICS_WINDOW) {
-    // Handle NPC behavior:
-    for (i = 0; i < MAX_NPCS_AT_ONE_TIME; ++i) {
-      npc = &g_location->npcs[i];
-      if (npc->type > NONE) {
-        if (npc->status_effects[STUN] == 0 &&
-            npc->status_effects[SLOW] % 2 == 0) {
-          damage = rand() % npc->power - npc->status_effects[WEAKNESS] / 2;
-          diff_x = npc->position.x - g_player->position.x;
-          diff_y = npc->position.y - g_player->position.y;
-
-          // Determine whether the NPC can "see" the player:
-          if (diff_x == 0 || diff_y == 0) {
-            j = 0;
-            cell = npc->position;
-            horizontal_direction = diff_x > 0 ? WEST : EAST;
-            vertical_direction = diff_y > 0 ? NORTH : SOUTH;
-            do {
-              cell = get_cell_farther_away(cell,
-                                           diff_x == 0 ? vertical_direction :
-                                                         horizontal_direction,
-                                           1);
-              if (gpoint_equal(&g_player->position, &cell)) {
-                player_is_visible_to_npc = true;
-                break;
-              }
-            }while (occupiable(cell) && ++j < (MAX_VISIBILITY_DEPTH - 2));
-          }
+  if (g_npc_movement_timer || g_current_window != GRAPHICS_WINDOW) {
+    return;
+  }
+  for (i = 0; i < g_npcs->num_active_npcs; ++i) {
+    if (g_npcs->arrival_directions[g_npcs->live_npcs[i]] != NONE) {
+      g_npc_movement_timer = app_timer_register(MOVEMENT_FRAME_DURATION,
+                                                npc_movement_timer_callback,
+                                                NULL);
+      return;
+    }
+  }
+}
 
-          if (npc->status_effects[INTIMIDATION]) {
-            move_npc(npc,
-                    get_opposite_direction(get_pursuit_direction(npc->position,
-                                                         g_player->position)));
-          } else if (npc->type == MAGE && player_is_visible_to_npc) {
-            g_enemy_current_spell_animation = NUM_SPELL_ANIMATIONS;
-            g_enemy_spell_timer = app_timer_register(DEFAULT_TIMER_DURATION,
-                                                    enemy_spell_timer_callback,
-                                                    NULL);
-            if (g_player->int8_stats[SHADOW_FORM] &&
-                (rand() % g_player->int8_stats[INTELLECT] +
-                   g_player->int8_stats[SHADOW_FORM] > damage)) {
-              adjust_player_current_health(damage / 2 + 1);
-              adjust_player_current_energy(damage / 2 + 1);
-            } else {
-              damage_player(damage -
-                              rand() % g_player->int8_stats[MAGICAL_DEFENSE]);
-            }
-          } else if ((diff_x == 0 && abs(diff_y) == 1) ||
-                     (diff_y == 0 && abs(diff_x) == 1)) {
-            damage_player(damage -
-                            rand() % g_player->int8_stats[PHYSICAL_DEFENSE]);
-            if (g_player->int8_stats[BACKLASH_DAMAGE]) {
-              damage_npc(npc,
-                         damage / (rand() % npc->magical_defense + 1) +
-                           g_player->int8_stats[BACKLASH_DAMAGE]);
-            }
-          } else {
-            move_npc(npc,
-                     get_pursuit_direction(npc->position, g_player->position));
-          }
-        }
+/******************************************************************************
+   Function: npc_movement_timer_callback
 
-        // Check for player death:
-        if (g_player->int16_stats[CURRENT_HEALTH] <= 0) {
-          show_window(MAIN_MENU, NOT_ANIMATED);
-          show_window(STATS_MENU, NOT_ANIMATED);
-          show_narration(DEATH_NARRATION);
-          return;
-        }
+Description: Called at each frame of NPC movement (see
+             "start_npc_movement_animation"). Redraws the scene and re-arms
+             itself until the current simulation step is fully interpolated.
 
-        // Apply wounding/burning damage:
-        if (npc->status_effects[DAMAGE_OVER_TIME]) {
-          damage_npc(npc, npc->status_effects[DAMAGE_OVER_TIME] / 2);
-        }
+     Inputs: data - Pointer to additional data (not used).
 
-        // Reduce all status effects:
-        for (j = 0; j < NUM_STATUS_EFFECTS; ++j) {
-          if (npc->status_effects[j] > 0) {
-            npc->status_effects[j]--;
-          }
-        }
-      }
-    }
+    Outputs: None.
+******************************************************************************/
+static void npc_movement_timer_callback(void *data) {
+  g_npc_movement_timer = NULL;
+  if (g_current_window != GRAPHICS_WINDOW) {
+    return;
+  }
+  layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
+  if (get_step_interpolation() < STEP_INTERPOLATION_SCALE) {
+    g_npc_movement_timer = app_timer_register(MOVEMENT_FRAME_DURATION,
+                                              npc_movement_timer_callback,
+                                              NULL);
+  }
+}
 
-    // Generate new NPCs periodically (does nothing if the NPC array is full):
-    if (rand() % 9 == 0) {
-      // Attempt to find a viable spawn point:
-      for (i = 0; i < NUM_DIRECTIONS; ++i) {
-        cell = get_cell_farther_away(g_player->position,
-                                     direction,
-                                     MAX_VISIBILITY_DEPTH - 1);
-        if (occupiable(cell)) {
-          break;
-        }
-        if (++direction == NUM_DIRECTIONS) {
-          direction = 0;
-        }
-      }
+/******************************************************************************
+   Function: get_current_time_ms
 
-      // Add any NPC type other than MAGE:
-      add_new_npc(rand() % (NUM_NPC_TYPES - 1), cell);
-    }
+Description: Returns the current time in milliseconds. (Only useful for
+             measuring intervals, since the value wraps around.)
 
-    // Handle player stat recovery:
-    adjust_player_current_health(g_player->int8_stats[HEALTH_REGEN]);
-    adjust_player_current_energy(g_player->int8_stats[ENERGY_REGEN]);
+     Inputs: None.
 
-    layer_mark_dirty(window_get_root_layer(g_windows[GRAPHICS_WINDOW]));
-  }
+    Outputs: Current time in milliseconds.
+******************************************************************************/
+uint32_t get_current_time_ms(void) {
+  time_t seconds;
+  uint16_t milliseconds;
+
+  time_ms(&seconds, &milliseconds);
+
+  return (uint32_t) seconds * 1000 + milliseconds;
 }
 
 /******************************************************************************
@@ -2626,6 +5901,8 @@ Description: Equips a given heavy item to its appropriate equip target,
     Outputs: None.
 ******************************************************************************/
 void equip_heavy_item(heavy_item_t *const heavy_item) {
+  uint8_t changed_inputs = EQUIPMENT_INPUT(heavy_item->equip_target);
+
   if (heavy_item->equipped) {
     unequip_heavy_item(heavy_item);
   } else {
@@ -2634,8 +5911,10 @@ void equip_heavy_item(heavy_item_t *const heavy_item) {
     if (heavy_item->equip_target < RIGHT_HAND &&
         heavy_item->infused_pebble > NONE) {
       g_player->int8_stats[heavy_item->infused_pebble + FIRST_MAJOR_STAT]++;
+      changed_inputs |= STAT_INPUT(heavy_item->infused_pebble +
+                                     FIRST_MAJOR_STAT);
     }
-    set_player_minor_stats();
+    update_player_stats(changed_inputs);
   }
 }
 
@@ -2650,12 +5929,16 @@ Description: Unequips a given heavy item, then adjusts constant status effects
     Outputs: None.
 ******************************************************************************/
 void unequip_heavy_item(heavy_item_t *const heavy_item) {
+  uint8_t changed_inputs = EQUIPMENT_INPUT(heavy_item->equip_target);
+
   heavy_item->equipped = false;
   if (heavy_item->equip_target < RIGHT_HAND &&
       heavy_item->infused_pebble > NONE) {
     g_player->int8_stats[heavy_item->infused_pebble + FIRST_MAJOR_STAT]--;
+    changed_inputs |= STAT_INPUT(heavy_item->infused_pebble +
+                                   FIRST_MAJOR_STAT);
   }
-  set_player_minor_stats();
+  update_player_stats(changed_inputs);
 }
 
 /******************************************************************************
@@ -2681,81 +5964,134 @@ void unequip_item_at(const int8_t equip_target) {
 }
 
 /******************************************************************************
-   Function: set_player_minor_stats
+   Function: update_player_stats
 
-Description: Assigns values to the player's minor stats according to major stat
-             values (AGILITY, STRENGTH, and INTELLECT) then adjusts them
-             according to equipped items and status effects.
+Description: Recomputes only those derived stats (PHYSICAL_POWER, MAX_ENERGY,
+             etc.) that depend on at least one of a given set of changed
+             inputs, first refreshing the cached bonuses of any equip targets
+             among those inputs.
 
-     Inputs: None.
+     Inputs: changed_inputs - Bit field of changed inputs (see "STAT_INPUT"
+                              and "EQUIPMENT_INPUT").
 
     Outputs: None.
 ******************************************************************************/
-void set_player_minor_stats(void) {
+void update_player_stats(const uint8_t changed_inputs) {
   int8_t i;
-  heavy_item_t *heavy_item;
 
-  g_player->int8_stats[PHYSICAL_POWER] = g_player->int8_stats[STRENGTH] +
-                                           g_player->int8_stats[AGILITY] / 2 +
-                                           g_player->int8_stats[INTELLECT] / 5;
-  g_player->int8_stats[PHYSICAL_DEFENSE] = g_player->int8_stats[STRENGTH] / 2 +
-                                             g_player->int8_stats[AGILITY] +
-                                             g_player->int8_stats[INTELLECT] /
-                                             5;
-  g_player->int8_stats[MAGICAL_POWER] = g_player->int8_stats[STRENGTH] / 2 +
-                                          g_player->int8_stats[AGILITY] / 5 +
-                                          g_player->int8_stats[INTELLECT];
-  g_player->int8_stats[MAGICAL_DEFENSE] = g_player->int8_stats[STRENGTH] / 5 +
-                                          g_player->int8_stats[AGILITY] / 2 +
-                                          g_player->int8_stats[INTELLECT];
-  g_player->int16_stats[MAX_HEALTH] = DEFAULT_MAX_HEALTH +
-                                        g_player->int8_stats[STRENGTH] * 4 +
-                                        g_player->int8_stats[LEVEL];
-  g_player->int16_stats[MAX_ENERGY] = DEFAULT_MAX_ENERGY +
-                                        g_player->int8_stats[INTELLECT] * 2 +
-                                        g_player->int8_stats[AGILITY] * 2 +
-                                        g_player->int8_stats[STRENGTH];
-  g_player->int8_stats[FATIGUE_RATE] = MIN_FATIGUE_RATE;
-
-  // Weapon:
-  heavy_item = get_heavy_item_equipped_at(RIGHT_HAND);
-  if (heavy_item) {
-    for (i = DAGGER; i <= heavy_item->type; i += 2) {
-      g_player->int8_stats[PHYSICAL_POWER] += DEFAULT_ITEM_BONUS;
-      g_player->int8_stats[FATIGUE_RATE]++;
+  for (i = 0; i < NUM_EQUIP_TARGETS; ++i) {
+    if (changed_inputs & EQUIPMENT_INPUT(i)) {
+      cache_equipment_bonuses(i);
     }
-    if (heavy_item->infused_pebble > NONE) {
-      g_player->int8_stats[FATIGUE_RATE]++;
+  }
+  for (i = 0; i < NUM_DERIVED_STATS; ++i) {
+    if (changed_inputs & g_derived_stat_inputs[i]) {
+      set_derived_stat(i);
     }
   }
+}
 
-  // Armor/Robe:
-  heavy_item = get_heavy_item_equipped_at(BODY);
-  if (heavy_item) {
-    for (i = LIGHT_ARMOR; i <= heavy_item->type; ++i) {
-      g_player->int8_stats[PHYSICAL_DEFENSE] += DEFAULT_ITEM_BONUS;
-      g_player->int8_stats[MAGICAL_POWER]--;
-      g_player->int8_stats[FATIGUE_RATE]++;
-    }
-    if (heavy_item->infused_pebble == PEBBLE_OF_SHADOW) {
-      g_player->int8_stats[PHYSICAL_DEFENSE]++;
-    }
+/******************************************************************************
+   Function: cache_equipment_bonuses
+
+Description: Determines the bonuses (and penalties) to derived stats granted by
+             whatever heavy item is equipped at a given equip target, storing
+             them in "g_equipment_bonuses".
+
+     Inputs: equip_target - Integer representing the equip target of interest.
+
+    Outputs: None.
+******************************************************************************/
+void cache_equipment_bonuses(const int8_t equip_target) {
+  int8_t i, num_bonuses,
+         *const bonuses = g_equipment_bonuses[equip_target];
+  heavy_item_t *heavy_item = get_heavy_item_equipped_at(equip_target);
+
+  for (i = 0; i < NUM_DERIVED_STATS; ++i) {
+    bonuses[i] = 0;
+  }
+  if (heavy_item == NULL) {
+    return;
   }
 
-  // Shield:
-  heavy_item = get_heavy_item_equipped_at(LEFT_HAND);
-  if (heavy_item) {
-    g_player->int8_stats[PHYSICAL_DEFENSE] += DEFAULT_ITEM_BONUS;
-    g_player->int8_stats[MAGICAL_POWER]--;
-    g_player->int8_stats[FATIGUE_RATE]++;
-    if (heavy_item->infused_pebble == PEBBLE_OF_SHADOW) {
-      g_player->int8_stats[PHYSICAL_DEFENSE]++;
+  // Weapon (one bonus per pair of weapon types, starting with DAGGER):
+  if (equip_target == RIGHT_HAND) {
+    num_bonuses = (heavy_item->type - DAGGER) / 2 + 1;
+    bonuses[DERIVED_PHYSICAL_POWER] = num_bonuses * DEFAULT_ITEM_BONUS;
+    bonuses[DERIVED_FATIGUE_RATE] = num_bonuses +
+                                      (heavy_item->infused_pebble > NONE);
+
+  // Armor/Robe (one bonus per armor type, starting with LIGHT_ARMOR) or shield:
+  } else {
+    if (equip_target == LEFT_HAND) {
+      num_bonuses = 1;
+    } else {
+      num_bonuses = heavy_item->type < LIGHT_ARMOR ? 0 :
+                      heavy_item->type - LIGHT_ARMOR + 1;
     }
+    bonuses[DERIVED_PHYSICAL_DEFENSE] = num_bonuses * DEFAULT_ITEM_BONUS +
+      (heavy_item->infused_pebble == PEBBLE_OF_SHADOW);
+    bonuses[DERIVED_MAGICAL_POWER] = -num_bonuses;
+    bonuses[DERIVED_FATIGUE_RATE] = num_bonuses;
+  }
+}
+
+/******************************************************************************
+   Function: set_derived_stat
+
+Description: Assigns a value to one of the player's derived stats according to
+             major stat values (AGILITY, STRENGTH, and INTELLECT), level, and
+             cached equipment bonuses.
+
+     Inputs: derived_stat - Integer representing the derived stat.
+
+    Outputs: None.
+******************************************************************************/
+void set_derived_stat(const int8_t derived_stat) {
+  int8_t i,
+         agility = g_player->int8_stats[AGILITY],
+         strength = g_player->int8_stats[STRENGTH],
+         intellect = g_player->int8_stats[INTELLECT];
+  int16_t value;
+
+  switch (derived_stat) {
+    case DERIVED_PHYSICAL_POWER:
+      value = strength + agility / 2 + intellect / 5;
+      break;
+    case DERIVED_PHYSICAL_DEFENSE:
+      value = strength / 2 + agility + intellect / 5;
+      break;
+    case DERIVED_MAGICAL_POWER:
+      value = strength / 2 + agility / 5 + intellect;
+      break;
+    case DERIVED_MAGICAL_DEFENSE:
+      value = strength / 5 + agility / 2 + intellect;
+      break;
+    case DERIVED_FATIGUE_RATE:
+      value = MIN_FATIGUE_RATE;
+      break;
+    case DERIVED_MAX_HEALTH:
+      value = DEFAULT_MAX_HEALTH + strength * 4 + g_player->int8_stats[LEVEL];
+      break;
+    default:  // case DERIVED_MAX_ENERGY:
+      value = DEFAULT_MAX_ENERGY + intellect * 2 + agility * 2 + strength;
+      break;
+  }
+  for (i = 0; i < NUM_EQUIP_TARGETS; ++i) {
+    value += g_equipment_bonuses[i][derived_stat];
   }
 
   // Ensure magical power doesn't fall too low:
-  if (g_player->int8_stats[MAGICAL_POWER] < DEFAULT_MAJOR_STAT_VALUE) {
-    g_player->int8_stats[MAGICAL_POWER] = DEFAULT_MAJOR_STAT_VALUE;
+  if (derived_stat == DERIVED_MAGICAL_POWER &&
+      value < DEFAULT_MAJOR_STAT_VALUE) {
+    value = DEFAULT_MAJOR_STAT_VALUE;
+  }
+
+  if (derived_stat < DERIVED_MAX_HEALTH) {
+    g_player->int8_stats[derived_stat + PHYSICAL_POWER] = value;
+  } else {
+    g_player->int16_stats[derived_stat - DERIVED_MAX_HEALTH + MAX_HEALTH] =
+      value;
   }
 }
 
@@ -2782,7 +6118,14 @@ void init_player(void) {
   g_player->exp_points =  // 58806 to reach max. level!
     g_player->int8_stats[DEPTH] =
     g_player->int8_stats[BACKLASH_DAMAGE] =
-    g_player->int8_stats[SHADOW_FORM] = 0;
+    g_player->int8_stats[SHADOW_FORM] =
+    g_player->num_keys = 0;
+  g_player->run_seed = (uint32_t) rand() << 16 ^ rand();
+
+  // Forget the previous run's locations:
+  memset(&g_level_cache, 0, offsetof(level_cache_t, map_changes));
+  g_level_cache_is_dirty = true;
+  g_level_window.depth = 0;
 
   // Assign starting inventory:
   for (i = 0; i < NUM_PEBBLE_TYPES; ++i) {
@@ -2794,8 +6137,9 @@ void init_player(void) {
   }
   init_heavy_item(&g_player->heavy_items[0], ROBE);
 
-  // Equip the robe, causing all minor stats to be set:
+  // Equip the robe, then set all derived stats:
   equip_heavy_item(&g_player->heavy_items[0]);
+  update_player_stats(ALL_STAT_INPUTS);
 
   // Finally, ensure health and energy are at 100%:
   g_player->int16_stats[CURRENT_HEALTH] = g_player->int16_stats[MAX_HEALTH];
@@ -2805,59 +6149,59 @@ void init_player(void) {
 /******************************************************************************
    Function: init_npc
 
-Description: Initializes a given non-player character (NPC) struct according to
-             a given NPC type and starting position.
+Description: Initializes a given non-player character (NPC) according to a
+             given NPC type and starting position.
 
-     Inputs: npc      - Pointer to the NPC struct to be initialized.
+     Inputs: npc      - Index of the NPC to be initialized.
              type     - Integer indicating the desired NPC type.
              position - The NPC's starting position.
 
     Outputs: None.
 ******************************************************************************/
-void init_npc(npc_t *const npc, const int8_t type, const GPoint position) {
-  int8_t i;
-
-  npc->type = type;
-  npc->position = position;
-  npc->item = NONE;
-  for (i = 0; i < NUM_STATUS_EFFECTS; ++i) {
-    npc->status_effects[i] = 0;
+void init_npc(const int8_t npc, const int8_t type, const GPoint position) {
+  const npc_archetype_t *const archetype = &g_npc_archetypes[type];
+
+  clear_status_effects(npc);
+  g_npcs->types[npc] = type;
+  set_npc_position(npc, position);
+  g_npcs->health[npc] = BASE_NPC_STAT_VALUE;
+  set_npc_stats(npc);
+
+  // Determine loot (mages are the only source of Pebbles):
+  g_npcs->items[npc] = NONE;
+  if (archetype->loot_policy == RANDOM_LOOT) {
+    g_npcs->items[npc] = rand() % 2 ? NONE : RANDOM_ITEM;  // Excl. Pebbles.
+  } else if (archetype->loot_policy == PEBBLE_LOOT) {
+    g_npcs->items[npc] = rand() % NUM_PEBBLE_TYPES;
   }
+}
 
-  // Set stats according to current dungeon depth:
-  npc->health = npc->power = npc->physical_defense = npc->magical_defense =
-    1 + g_player->int8_stats[DEPTH] - g_player->int8_stats[DEPTH] / 2;
+/******************************************************************************
+   Function: set_npc_stats
 
-  // Check for increased power:
-  if (type <= WHITE_MONSTER_MEDIUM ||
-      type == WARRIOR_MEDIUM ||
-      type == WARRIOR_LARGE ||
-      (type >= DARK_OGRE && type <= PALE_TROLL)) {
-    npc->power++;
-  }
-  if (type <= WHITE_MONSTER_LARGE ||
-      type == WARRIOR_LARGE ||
-      type == DARK_OGRE ||
-      type == PALE_OGRE) {
-    npc->power++;
-  }
+Description: Sets a given NPC's power and defenses according to its archetype
+             and the current dungeon depth.
 
-  // Check for increased/decreased defenses:
-  if (type == MAGE || (type < WARRIOR_LARGE && type % 2)) {
-    npc->magical_defense++;
-    npc->physical_defense--;
-  } else if (type >= WARRIOR_LARGE) {
-    npc->physical_defense++;
-  }
+     Inputs: npc - Index of the NPC of interest.
 
-  // Some NPCs may carry a random item:
-  if (type > WHITE_MONSTER_SMALL) {
-    npc->item = rand() % 2 ? NONE : RANDOM_ITEM;  // Excludes Pebbles.
+    Outputs: None.
+******************************************************************************/
+void set_npc_stats(const int8_t npc) {
+  const npc_archetype_t *const archetype =
+    &g_npc_archetypes[g_npcs->types[npc]];
+
+  g_npcs->power[npc] = BASE_NPC_STAT_VALUE + archetype->power_bonus;
+  g_npcs->physical_defenses[npc] = BASE_NPC_STAT_VALUE +
+                                     archetype->physical_defense_bonus;
+  g_npcs->magical_defenses[npc] = BASE_NPC_STAT_VALUE +
+                                    archetype->magical_defense_bonus;
+
+  // Defenses are used as divisors, so they must remain positive:
+  if (g_npcs->physical_defenses[npc] < 1) {
+    g_npcs->physical_defenses[npc] = 1;
   }
-
-  // Mages are the only source of Pebbles:
-  if (type == MAGE) {
-    npc->item = rand() % NUM_PEBBLE_TYPES;
+  if (g_npcs->magical_defenses[npc] < 1) {
+    g_npcs->magical_defenses[npc] = 1;
   }
 }
 
@@ -2944,111 +6288,449 @@ void init_wall_coords(void) {
 }
 
 /******************************************************************************
-   Function: init_location
+   Function: init_views
+
+Description: Initializes the global "g_views" array: the view at rest (the
+             back wall coordinates as they are), then, for each intermediate
+             frame of an animated movement, a view partway through a step and
+             another partway through a turn. Stepping, the viewer is that
+             fraction of a cell ahead of where the view is drawn from, so each
+             back wall is that fraction of the way to the one in front of it
+             (or, at depth 0, to the screen's edges, one screen width per
+             position). Turning, everything shifts left by that fraction of
+             the screen's width (a quarter turn spans the field of view).
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void init_views(void) {
+  int8_t i, j, k, corner;
+  GPoint near, far;
+  view_t *view;
+
+  view = &g_views[REST_VIEW];
+  view->wall_coords = g_back_wall_coords;
+  view->floor_rows = g_floor_rows;
+  view->shift = 0;
+  init_floor_rows(view, g_floor_rows);
+  for (k = 1; k <= MOVEMENT_ANIMATION_FRAMES; ++k) {
+    view = &g_views[STEP_VIEW(k)];
+    for (i = 0; i < MAX_VISIBILITY_DEPTH - 1; ++i) {
+      for (j = 0; j < (STRAIGHT_AHEAD * 2) + 1; ++j) {
+        for (corner = TOP_LEFT; corner <= BOTTOM_RIGHT; ++corner) {
+          far = g_back_wall_coords[i][j][corner];
+          if (i > 0) {
+            near = g_back_wall_coords[i - 1][j][corner];
+          } else {
+            near = GPoint((j - STRAIGHT_AHEAD + corner) * GRAPHICS_FRAME_WIDTH,
+                          corner * GRAPHICS_FRAME_HEIGHT);
+          }
+          g_step_wall_coords[k - 1][i][j][corner] =
+            GPoint(far.x + (near.x - far.x) * k /
+                     (MOVEMENT_ANIMATION_FRAMES + 1),
+                   far.y + (near.y - far.y) * k /
+                     (MOVEMENT_ANIMATION_FRAMES + 1));
+        }
+      }
+    }
+    view->wall_coords = g_step_wall_coords[k - 1];
+    view->floor_rows = g_step_floor_rows[k - 1];
+    view->shift = 0;
+    init_floor_rows(view, g_step_floor_rows[k - 1]);
+
+    view = &g_views[TURN_VIEW(k)];
+    view->wall_coords = g_back_wall_coords;  // Shifted as they're drawn...
+    view->floor_rows = g_floor_rows;  // ...as are the floor rows.
+    view->shift = -k * GRAPHICS_FRAME_WIDTH / (MOVEMENT_ANIMATION_FRAMES + 1);
+  }
+}
+
+/******************************************************************************
+   Function: init_floor_rows
+
+Description: Initializes an array of floor rows from a view's back wall
+             coordinates: for each row of floor (and ceiling), the depth of
+             the cell it crosses, the spacing of its dots, and where its tile
+             boundaries lie. Each cell's width at a given row shrinks in
+             proportion to the row's height above the horizon, reaching the
+             width of the cell's back wall at its far edge, so tile seams run
+             toward the vanishing point and meet the walls' corners.
+
+     Inputs: view - Pointer to the view of interest.
+             rows - Array of MAX_FLOOR_ROWS floor rows to initialize.
+
+    Outputs: None.
+******************************************************************************/
+void init_floor_rows(const view_t *view, floor_row_t *rows) {
+  uint8_t y, distance = 0;
+  int16_t wall_width, wall_half_height;
+  int32_t offset;
+  floor_row_t *row;
+  const int32_t center = GRAPHICS_FRAME_WIDTH / 2 * FLOOR_SUBPIXELS;
+
+  for (y = 0; y < MAX_FLOOR_ROWS; ++y) {
+    row = &rows[y];
+
+    // Rows beyond each depth's back wall belong to the next cell out:
+    while (distance < MAX_VISIBILITY_DEPTH - 2 &&
+           y >= view->wall_coords[distance][0][TOP_LEFT].y) {
+      distance++;
+    }
+    row->distance = distance;
+
+    // Determine horizontal distance between points:
+    row->step = 1 + y / MAX_VISIBILITY_DEPTH;
+    if (y % MAX_VISIBILITY_DEPTH >= MAX_VISIBILITY_DEPTH / 2 +
+                                    MAX_VISIBILITY_DEPTH % 2) {
+      row->step++;
+    }
+
+    // Determine the tile width and the tile (and next boundary) at x = 0,
+    // with tile 0 centered straight ahead:
+    wall_width = view->wall_coords[distance][STRAIGHT_AHEAD][BOTTOM_RIGHT].x -
+                 view->wall_coords[distance][STRAIGHT_AHEAD][TOP_LEFT].x;
+    wall_half_height = GRAPHICS_FRAME_HEIGHT / 2 -
+                       view->wall_coords[distance][STRAIGHT_AHEAD][TOP_LEFT].y;
+    row->tile_width = (int32_t) (GRAPHICS_FRAME_HEIGHT / 2 - y) * wall_width *
+                      FLOOR_SUBPIXELS / wall_half_height;
+    offset = row->tile_width / 2 - center;  // Rounded down to a whole tile:
+    row->first_tile = offset >= 0 ? offset / row->tile_width :
+                        -((row->tile_width - 1 - offset) / row->tile_width);
+    row->first_boundary = center + row->first_tile * row->tile_width +
+                          row->tile_width / 2;
+  }
+}
+
+/******************************************************************************
+   Function: init_wall_textures
 
-Description: Initializes the global location struct, setting up a new location
-             with an entrance, an exit, and a single NPC of type "MAGE". Also
-             saves data to persistent storage as a precaution.
+Description: Loads the wall textures from their resources and initializes the
+             table that maps them onto walls with integer steps: the texture
+             distance covered by each pixel along a wall of a given width or
+             height (see "TEXTURE_STEP"), which serves every view's walls.
+             (A texture that fails to load leaves its schemes dithered.)
 
      Inputs: None.
 
     Outputs: None.
 ******************************************************************************/
-void init_location(void) {
-  int8_t i, j, builder_direction;
-  GPoint builder_position;
+void init_wall_textures(void) {
+  int8_t i;
+  uint8_t span;
+  const uint16_t texture_span = WALL_TEXTURE_SIZE << WALL_TEXTURE_SHIFT;
+
+  for (i = 0; i < NUM_WALL_TEXTURES; ++i) {
+    g_wall_texture_is_loaded[i] =
+      resource_load(resource_get_handle(g_wall_texture_resources[i]),
+                    g_wall_textures[i],
+                    WALL_TEXTURE_SIZE * WALL_TEXTURE_SIZE) ==
+        WALL_TEXTURE_SIZE * WALL_TEXTURE_SIZE;
+  }
+  g_texture_steps[0] = texture_span;
+  for (span = 1; span <= GRAPHICS_FRAME_WIDTH; ++span) {
+    g_texture_steps[span] = texture_span / span;
+  }
+}
 
-  // Set color scheme:
-  g_location->floor_color_scheme = rand() % NUM_BACKGROUND_COLOR_SCHEMES;
-  g_location->wall_color_scheme = rand() % NUM_BACKGROUND_COLOR_SCHEMES;
+/******************************************************************************
+   Function: init_location
 
-  // Remove any preexisting NPCs:
-  for (i = 0; i < MAX_NPCS_AT_ONE_TIME; ++i) {
-    g_location->npcs[i].type = NONE;
+Description: Initializes the global location struct, setting up the location
+             at a given depth with an entrance, an exit, and (on a first visit
+             from above) a single NPC of type "MAGE". The map itself is never
+             saved: it's regenerated from the player's run seed and depth,
+             chunk by chunk, whenever it's needed, with the map changes and
+             NPCs of a recently left location restored from the level cache.
+             (If the player's surroundings were kept on leaving, or generated
+             ahead of time, by the background worker or near the previous
+             exit, they're simply swapped in, and the worker is asked to get
+             the next level ready.) Also schedules a save to persistent
+             storage as a precaution.
+
+     Inputs: depth - Depth of the new location (if it's above the player's
+                     current depth, the player arrives by the stairs up, beside
+                     the new location's exit).
+
+    Outputs: None.
+******************************************************************************/
+void init_location(const int8_t depth) {
+  int8_t direction = NONE;
+  bool revisiting;
+  const bool ascending = depth < g_player->int8_stats[DEPTH];
+
+  // Remove any preexisting NPCs (and their status effects), drop any chunks
+  // still being carved, and stop any step or turn being animated (it was
+  // through the old location), then restore the new location's map changes
+  // if it was left recently:
+  clear_npc_pool();
+  g_task_is_pending[CARVE_CHUNKS_TASK] = false;
+  stop_movement_animation();
+  g_location->endless = false;
+  g_player->int8_stats[DEPTH] = depth;
+  revisiting = uncache_level();
+
+  // Use the window kept on leaving the location, if any, or else the location
+  // pregenerated by the background worker, if any:
+  if (load_level_window()) {
+    direction = g_player->direction;  // (See "uncache_level".)
+  } else if (!ascending) {
+    direction = load_pregenerated_level();
   }
 
-  // Now set each cell to solid:
-  for (i = 0; i < MAP_WIDTH; ++i) {
-    for (j = 0; j < MAP_HEIGHT; ++j) {
-      g_location->map[i][j] = SOLID;
+  // Otherwise, use the location pregenerated near the previous exit, if any
+  // (finishing it first if need be), or else lay out the new location (with
+  // no chunks waiting, nothing is carved yet):
+  if (direction == NONE) {
+    if (!ascending &&
+        g_next_level.depth == depth &&
+        g_next_level.seed == get_level_seed(g_player->run_seed, depth)) {
+      finish_task(NEXT_LEVEL_TASK);
+      direction = use_level_layout(&g_next_level);
+      memcpy(g_resident_chunks,
+             g_next_level_chunks,
+             sizeof(g_resident_chunks));
+    } else {
+      unload_map_chunks();
+      direction = generate_level(get_level_seed(g_player->run_seed, depth));
     }
   }
 
-  // Next, set entrance and exit points:
-  switch (builder_direction = rand() % NUM_DIRECTIONS) {
-    case NORTH:
-      builder_position = RANDOM_POINT_SOUTH;
-      set_cell_type(RANDOM_POINT_NORTH, EXIT);
-      break;
-    case SOUTH:
-      builder_position = RANDOM_POINT_NORTH;
-      set_cell_type(RANDOM_POINT_SOUTH, EXIT);
-      break;
-    case EAST:
-      builder_position = RANDOM_POINT_WEST;
-      set_cell_type(RANDOM_POINT_EAST, EXIT);
-      break;
-    default:  // case WEST:
-      builder_position = RANDOM_POINT_EAST;
-      set_cell_type(RANDOM_POINT_WEST, EXIT);
-      break;
+  // Unless the player is back where they left the location, start at the
+  // entrance (or, coming up the stairs, beside the exit, facing away from it),
+  // then load the player's surroundings:
+  if (revisiting) {
+    direction = g_player->direction;
+  } else if (ascending) {
+    direction = get_opposite_direction(direction);
+    g_player->position = get_cell_farther_away(g_location->exit, direction, 1);
+  } else {
+    g_player->position = g_location->entrance;
+  }
+  set_player_direction(direction);
+  recenter_map_window();
+  finish_generated_chunks();
+  g_map_window_is_resident = stream_map_chunks();
+  finish_task(CARVE_CHUNKS_TASK);  // The player's surroundings are needed now.
+  request_pregenerated_levels();
+
+  // Generate a mage at the exit:
+  if (!revisiting && !ascending) {
+    spawn_npc(MAGE, g_location->exit);
+  }
+#ifdef FLOW_FIELD_BENCHMARK
+  benchmark_flow_field();
+#endif
+#ifdef MAP_STREAMING_STATS
+  report_map_memory();
+#endif
+
+  // Save data to persistent storage as a precaution (once the new location
+  // has been drawn):
+  schedule_task(SAVE_GAME_TASK);
+}
+
+/******************************************************************************
+   Function: init_endless_location
+
+Description: Sets up an endless location at the player's current depth, whose
+             chunks are generated from the level seed as the player explores.
+             (Its exits lead on to ordinary locations.) Also schedules a save
+             to persistent storage as a precaution.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void init_endless_location(void) {
+  uint32_t state;
+
+  clear_npc_pool();
+  if (g_player->int8_stats[DEPTH] == 0) {
+    g_player->int8_stats[DEPTH] = 1;
   }
-  g_player->position = GPoint(builder_position.x, builder_position.y);
-  g_location->entrance = GPoint(builder_position.x, builder_position.y);
-  set_player_direction(builder_direction);
+  state = get_level_seed(g_player->run_seed, g_player->int8_stats[DEPTH]);
+  g_location->floor_color_scheme = get_seeded_random(&state) %
+                                     NUM_BACKGROUND_COLOR_SCHEMES;
+  g_location->wall_color_scheme = get_seeded_random(&state) %
+                                    NUM_BACKGROUND_COLOR_SCHEMES;
+  g_location->entrance = g_location->exit = NO_ENTRANCE;
+  g_location->endless = true;
+  g_location->chunk_offset = GPoint(0, 0);
+  g_location->num_map_changes = 0;
+  request_pregenerated_levels();  // (Exits lead one level down.)
+
+  // Start at the north door of the starting chunk, facing into it:
+  g_player->position =
+    GPoint(ENDLESS_START_CHUNK.x * CHUNK_SIZE +
+             get_endless_door(ENDLESS_START_CHUNK, NORTH),
+           ENDLESS_START_CHUNK.y * CHUNK_SIZE);
+  set_player_direction(SOUTH);
+  load_map_window();
+#ifdef MAP_STREAMING_STATS
+  report_map_memory();
+#endif
+  schedule_task(SAVE_GAME_TASK);
+}
+
+/******************************************************************************
+   Function: save_game
+
+Description: Saves the player, the current location (with only its recorded
+             map changes, since its map can be regenerated), the level cache,
+             and the location's NPCs (in compact form, with status effects) to
+             persistent storage.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void save_game(void) {
+  int8_t i, num_saved_npcs;
+  int16_t num_map_changes;
+  saved_npc_t saved_npcs[MAX_NPCS_AT_ONE_TIME];
 
-  // Now carve a path between the entrance and exit points:
-  while (get_cell_type(builder_position) != EXIT) {
-    // Add random loot or simply make the cell EMPTY:
-    if (rand() % 25 == 0 &&
-        !gpoint_equal(&builder_position, &g_location->entrance)) {
-      set_cell_type(builder_position, RANDOM_ITEM);  // Excludes Pebbles.
+  persist_write_data(PLAYER_STORAGE_KEY, g_player, sizeof(player_t));
+  persist_write_data(LOCATION_STORAGE_KEY,
+                     g_location,
+                     offsetof(location_t, map_changes));
+  for (i = 0; i < NUM_MAP_CHANGE_KEYS; ++i) {
+    num_map_changes = g_location->num_map_changes - i * MAP_CHANGES_PER_KEY;
+    if (num_map_changes > 0) {
+      persist_write_data(MAP_CHANGE_STORAGE_KEY + i,
+                         &g_location->map_changes[i * MAP_CHANGES_PER_KEY],
+                         (num_map_changes < MAP_CHANGES_PER_KEY ?
+                            num_map_changes : MAP_CHANGES_PER_KEY) *
+                           sizeof(map_change_t));
     } else {
-      set_cell_type(builder_position, EMPTY);
+      persist_delete(MAP_CHANGE_STORAGE_KEY + i);
     }
+  }
 
-    // Move the builder:
-    switch (builder_direction) {
-      case NORTH:
-        if (builder_position.y > 0) {
-          builder_position.y--;
-        }
-        break;
-      case SOUTH:
-        if (builder_position.y < MAP_HEIGHT - 1) {
-          builder_position.y++;
-        }
-        break;
-      case EAST:
-        if (builder_position.x < MAP_WIDTH - 1) {
-          builder_position.x++;
-        }
-        break;
-      default:  // case WEST:
-        if (builder_position.x > 0) {
-          builder_position.x--;
-        }
-        break;
+  // The level cache is only saved when it's changed (on entering a new
+  // location, mostly):
+  if (g_level_cache_is_dirty) {
+    persist_write_data(LEVEL_CACHE_STORAGE_KEY,
+                       &g_level_cache,
+                       offsetof(level_cache_t, map_changes));
+    for (i = 0; i < NUM_LEVEL_CACHE_CHANGE_KEYS; ++i) {
+      num_map_changes = g_level_cache.num_map_changes -
+                        i * MAP_CHANGES_PER_KEY;
+      if (num_map_changes > 0) {
+        persist_write_data(LEVEL_CACHE_CHANGE_STORAGE_KEY + i,
+                           &g_level_cache.map_changes[i * MAP_CHANGES_PER_KEY],
+                           (num_map_changes < MAP_CHANGES_PER_KEY ?
+                              num_map_changes : MAP_CHANGES_PER_KEY) *
+                             sizeof(map_change_t));
+      } else {
+        persist_delete(LEVEL_CACHE_CHANGE_STORAGE_KEY + i);
+      }
+    }
+    if (g_level_cache.num_npcs > 0) {
+      persist_write_data(LEVEL_CACHE_NPC_STORAGE_KEY,
+                         g_level_cache.npcs,
+                         g_level_cache.num_npcs * sizeof(saved_npc_t));
+    } else {
+      persist_delete(LEVEL_CACHE_NPC_STORAGE_KEY);
     }
+    g_level_cache_is_dirty = false;
+  }
 
-    // Ensure a mage will be generated next to the exit:
-    init_npc(&g_location->npcs[0], MAGE, builder_position);
+  // Only living NPCs are saved:
+  num_saved_npcs = get_saved_npcs(saved_npcs);
+  if (num_saved_npcs > 0) {
+    persist_write_data(NPC_STORAGE_KEY,
+                       saved_npcs,
+                       num_saved_npcs * sizeof(saved_npc_t));
+  } else {
+    persist_delete(NPC_STORAGE_KEY);
+  }
+  persist_write_data(STATUS_EFFECT_STORAGE_KEY,
+                     &g_npcs->status_wheel,
+                     sizeof(status_wheel_t));
+  persist_write_int(STORAGE_VERSION_KEY, STORAGE_VERSION);
+}
 
-    // 50% chance of turning:
-    if (rand() % 2) {
-      builder_direction = rand() % NUM_DIRECTIONS;
-    }
+/******************************************************************************
+   Function: load_location
+
+Description: Loads the current location (and its recorded map changes) from
+             persistent storage. (Its map is regenerated as it's loaded.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void load_location(void) {
+  int8_t i;
+
+  persist_read_data(LOCATION_STORAGE_KEY,
+                    g_location,
+                    offsetof(location_t, map_changes));
+  for (i = 0; i * MAP_CHANGES_PER_KEY < g_location->num_map_changes; ++i) {
+    persist_read_data(MAP_CHANGE_STORAGE_KEY + i,
+                      &g_location->map_changes[i * MAP_CHANGES_PER_KEY],
+                      MAP_CHANGES_PER_KEY * sizeof(map_change_t));
   }
+}
+
+/******************************************************************************
+   Function: load_level_cache
 
-  // Increment the player's depth, then remove the exit if at maximum depth:
-  g_player->int8_stats[DEPTH]++;
-  if (g_player->int8_stats[DEPTH] == MAX_DEPTH) {
-    set_cell_type(builder_position, EMPTY);
+Description: Loads the level cache (see "cache_level") from persistent
+             storage. (The resident window of the last location left isn't
+             saved, so returning there means regenerating it.)
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void load_level_cache(void) {
+  int8_t i;
+
+  if (persist_read_data(LEVEL_CACHE_STORAGE_KEY,
+                        &g_level_cache,
+                        offsetof(level_cache_t, map_changes)) !=
+        offsetof(level_cache_t, map_changes) ||
+      g_level_cache.num_levels > LEVEL_CACHE_SIZE ||
+      g_level_cache.num_map_changes > LEVEL_CACHE_CHANGES ||
+      g_level_cache.num_npcs > LEVEL_CACHE_NPCS) {
+    memset(&g_level_cache, 0, offsetof(level_cache_t, map_changes));
+  }
+  for (i = 0; i * MAP_CHANGES_PER_KEY < g_level_cache.num_map_changes; ++i) {
+    persist_read_data(LEVEL_CACHE_CHANGE_STORAGE_KEY + i,
+                      &g_level_cache.map_changes[i * MAP_CHANGES_PER_KEY],
+                      MAP_CHANGES_PER_KEY * sizeof(map_change_t));
   }
+  persist_read_data(LEVEL_CACHE_NPC_STORAGE_KEY,
+                    g_level_cache.npcs,
+                    sizeof(g_level_cache.npcs));
+}
 
-  // Save data to persistent storage as a precaution:
-  persist_write_data(PLAYER_STORAGE_KEY, g_player, sizeof(player_t));
-  persist_write_data(LOCATION_STORAGE_KEY, g_location, sizeof(location_t));
+/******************************************************************************
+   Function: load_npcs
+
+Description: Loads the current location's NPCs (and their status effects) from
+             persistent storage, recomputing their power and defenses.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void load_npcs(void) {
+  int8_t num_saved_npcs = 0;
+  saved_npc_t saved_npcs[MAX_NPCS_AT_ONE_TIME];
+
+  if (persist_exists(NPC_STORAGE_KEY)) {
+    num_saved_npcs = persist_read_data(NPC_STORAGE_KEY,
+                                       saved_npcs,
+                                       sizeof(saved_npcs)) /
+                       sizeof(saved_npc_t);
+  }
+  restore_npcs(saved_npcs, num_saved_npcs);
+  persist_read_data(STATUS_EFFECT_STORAGE_KEY,
+                    &g_npcs->status_wheel,
+                    sizeof(status_wheel_t));
 }
 
 /******************************************************************************
@@ -3177,6 +6859,7 @@ void init_window(const int8_t window_index) {
     window_set_background_color(g_windows[window_index], GColorBlack);
     window_set_window_handlers(g_windows[window_index], (WindowHandlers) {
       .appear = graphics_window_appear,
+      .disappear = graphics_window_disappear,
     });
     window_set_click_config_provider(g_windows[window_index],
                                      (ClickConfigProvider)
@@ -3341,6 +7024,9 @@ void init(void) {
   // Set up graphics window and graphics-related variables:
   init_window(GRAPHICS_WINDOW);
   init_wall_coords();
+  init_views();
+  init_wall_textures();
+  g_movement_animation = NONE;
   g_player_is_attacking = false;
   g_compass_path = gpath_create(&COMPASS_PATH_INFO);
   gpath_move_to(g_compass_path, GPoint(SCREEN_CENTER_POINT_X,
@@ -3351,14 +7037,37 @@ void init(void) {
   // Load saved data or initialize a brand new player struct:
   g_player = malloc(sizeof(player_t));
   g_location = malloc(sizeof(location_t));
+  g_npcs = malloc(sizeof(npc_pool_t));
+  clear_npc_pool();
+  unload_map_chunks();
+  g_flow_field_is_stale = true;
   if (persist_exists(PLAYER_STORAGE_KEY)) {
     persist_read_data(PLAYER_STORAGE_KEY, g_player, sizeof(player_t));
-    persist_read_data(LOCATION_STORAGE_KEY, g_location, sizeof(location_t));
-    set_player_direction(g_player->direction);  // To update compass.
+    update_player_stats(ALL_STAT_INPUTS);  // Rebuilds equipment bonus cache.
+
+    // A location saved in an older format is replaced at the same depth:
+    if (persist_read_int(STORAGE_VERSION_KEY) == STORAGE_VERSION) {
+      load_location();
+      load_level_cache();
+      load_npcs();
+      load_map_window();
+      set_player_direction(g_player->direction);  // To update compass.
+    } else {
+      for (i = 0; i < NUM_MAP_CHUNKS; ++i) {
+        persist_delete(OLD_CHUNK_STORAGE_KEY + i);
+      }
+      g_player->run_seed = (uint32_t) rand() << 16 ^ rand();
+      g_player->num_keys = 0;
+      init_location(g_player->int8_stats[DEPTH]);
+    }
   } else {
     init_player();
   }
 
+  // Start the background worker if there are levels to pregenerate:
+  app_worker_message_subscribe(worker_message_handler);
+  request_pregenerated_levels();
+
   // Initialize all other windows and display the main menu:
   for (i = 0; i < GRAPHICS_WINDOW; ++i) {
     init_window(i);
@@ -3367,7 +7076,6 @@ void init(void) {
 
   // Subscribe to relevant services:
   app_focus_service_subscribe(app_focus_handler);
-  tick_timer_service_subscribe(SECOND_UNIT, tick_handler);
 }
 
 /******************************************************************************
@@ -3382,12 +7090,19 @@ Description: Deinitializes the PebbleQuest app.
 void deinit(void) {
   int8_t i;
 
-  persist_write_data(PLAYER_STORAGE_KEY, g_player, sizeof(player_t));
-  persist_write_data(LOCATION_STORAGE_KEY, g_location, sizeof(location_t));
-  tick_timer_service_unsubscribe();
+  save_game();
+  stop_simulation();
+  stop_movement_animation();
+  if (g_task_timer) {
+    app_timer_cancel(g_task_timer);
+    g_task_timer = NULL;
+  }
   app_focus_service_unsubscribe();
+  app_worker_message_unsubscribe();
+  app_worker_kill();  // (A level it leaves unfinished has no header.)
   free(g_player);
   free(g_location);
+  free(g_npcs);
   for (i = 0; i < NUM_WINDOWS; ++i) {
     deinit_window(i);
   }
@@ -12,6 +12,7 @@ Description: Header file for PebbleQuest, a first-person 3D fantasy RPG
 #define PEBBLE_QUEST_H_
 
 #include <pebble.h>
+#include "level_generation.h"
 
 /******************************************************************************
   Enumerations
@@ -44,36 +45,6 @@ enum {
   NUM_NARRATION_TYPES
 };
 
-// Item types:
-enum {
-  NONE = -1,
-  PEBBLE_OF_THUNDER,
-  PEBBLE_OF_FIRE,
-  PEBBLE_OF_ICE,
-  PEBBLE_OF_LIFE,
-  PEBBLE_OF_LIGHT,
-  PEBBLE_OF_SHADOW,
-  PEBBLE_OF_DEATH,
-  DAGGER,
-  STAFF,
-  SWORD,
-  MACE,
-  AXE,
-  FLAIL,
-  SHIELD,
-  ROBE,
-  LIGHT_ARMOR,
-  HEAVY_ARMOR,
-  NUM_ITEM_TYPES
-};
-
-// Cell types (for loot, an item type value is used):
-enum {
-  SOLID = -3,
-  EMPTY,
-  EXIT
-};
-
 // Equip targets (i.e., places where an item may be equipped):
 enum {
   BODY,
@@ -103,6 +74,34 @@ enum {
   NUM_NPC_TYPES
 };
 
+// NPC size classes (each adds to an NPC's power and drawing size):
+enum {
+  SMALL_NPC,
+  MEDIUM_NPC,
+  LARGE_NPC
+};
+
+// NPC body types (determines how an NPC is drawn):
+enum {
+  FLOATING_MONSTER_BODY,
+  HUMANOID_MONSTER_BODY,
+  WARRIOR_BODY,
+  MAGE_BODY
+};
+
+// NPC loot policies:
+enum {
+  NO_LOOT,
+  RANDOM_LOOT,    // 50% chance of a random item (excluding Pebbles).
+  PEBBLE_LOOT     // Always a Pebble, dropped even onto loot or an exit.
+};
+
+// NPC AI profiles:
+enum {
+  MELEE_AI,       // Pursues the player and attacks when adjacent.
+  SPELLCASTER_AI  // Also casts spells at the player when in line of sight.
+};
+
 // 8-bit character stats (2-8 correspond to robe/armor/shield Pebble effects):
 enum {
   HEALTH = -3,
@@ -134,6 +133,18 @@ enum {
   NUM_INT16_STATS
 };
 
+// Derived character stats (in the same order as their 8- and 16-bit stats):
+enum {
+  DERIVED_PHYSICAL_POWER,
+  DERIVED_PHYSICAL_DEFENSE,
+  DERIVED_MAGICAL_POWER,
+  DERIVED_MAGICAL_DEFENSE,
+  DERIVED_FATIGUE_RATE,
+  DERIVED_MAX_HEALTH,
+  DERIVED_MAX_ENERGY,
+  NUM_DERIVED_STATS
+};
+
 // Temporary status effects (via spells and infused weapons):
 enum {
   WEAKNESS,
@@ -146,13 +157,54 @@ enum {
   NUM_STATUS_EFFECTS
 };
 
-// Directions:
+// Gameplay events (queued by the game core, then dispatched together):
+enum {
+  SCENE_CHANGED_EVENT,
+  PLAYER_DAMAGED_EVENT,
+  NPC_DAMAGED_EVENT,
+  NPC_DIED_EVENT,
+  LEVEL_UP_EVENT,
+  LOOT_FOUND_EVENT,
+  PLAYER_DIED_EVENT,
+  GAME_COMPLETED_EVENT,
+  NUM_EVENT_TYPES
+};
+
+// Background tasks (run a slice at a time while the app is otherwise idle):
 enum {
-  NORTH,
-  SOUTH,
-  EAST,
-  WEST,
-  NUM_DIRECTIONS
+  CARVE_CHUNKS_TASK,  // Replays the level generator for streamed-in chunks.
+  NEXT_LEVEL_TASK,
+  SAVE_GAME_TASK,
+  NUM_TASKS
+};
+
+// Cell attribute flags (see "g_cell_attributes"):
+enum {
+  BLOCKS_MOVEMENT = 0x01,
+  BLOCKS_SIGHT    = 0x02,  // Also marks the cell in the window's bitsets.
+  DRAWN           = 0x04,  // Has contents to be drawn (see "draw_cell_contents").
+  INTERACTIVE     = 0x08,  // Stepping into the cell uses it (see "use_cell").
+  NPC_PASSABLE    = 0x10,
+  PICKED_UP       = 0x20,  // Using the cell takes its contents (keys and loot).
+  LOOT            = 0x40,  // Holds an item (the cell's type).
+  FLOOR_ELLIPSE   = 0x80,  // Drawn over a dark ellipse (an exit's hole, or loot's shadow).
+};
+
+// Animated movements (see "start_movement_animation"):
+enum {
+  STEP_FORWARD_ANIMATION,
+  STEP_BACKWARD_ANIMATION,
+  TURN_LEFT_ANIMATION,
+  TURN_RIGHT_ANIMATION,
+  NUM_MOVEMENT_ANIMATIONS
+};
+
+// Wall textures (see "g_scheme_wall_textures"):
+enum {
+  BRICK_WALL_TEXTURE,
+  STONE_WALL_TEXTURE,
+  WOOD_WALL_TEXTURE,
+  NUM_WALL_TEXTURES
 };
 
 /******************************************************************************
@@ -168,18 +220,49 @@ enum {
 #define DEFAULT_MAX_ENERGY               10
 #define MIN_DAMAGE_TO_NPC                1
 #define MIN_FATIGUE_RATE                 2
+#define STAT_INPUT(stat)                 ((stat) <= INTELLECT ? 1 << ((stat) - LEVEL) : 0)
+#define EQUIPMENT_INPUT(equip_target)    (1 << (INTELLECT - LEVEL + 1 + (equip_target)))
+#define MAJOR_STAT_INPUTS                (STAT_INPUT(AGILITY) | STAT_INPUT(STRENGTH) | STAT_INPUT(INTELLECT))
+#define EQUIPMENT_INPUTS                 (EQUIPMENT_INPUT(BODY) | EQUIPMENT_INPUT(LEFT_HAND) | EQUIPMENT_INPUT(RIGHT_HAND))
+#define ALL_STAT_INPUTS                  (STAT_INPUT(LEVEL) | MAJOR_STAT_INPUTS | EQUIPMENT_INPUTS)
 #define DEFAULT_ITEM_BONUS               3
-#define MAX_NPCS_AT_ONE_TIME             2
-#define MAP_WIDTH                        10
-#define MAP_HEIGHT                       MAP_WIDTH
-#define RANDOM_POINT_NORTH               GPoint(rand() % MAP_WIDTH, 0)
-#define RANDOM_POINT_SOUTH               GPoint(rand() % MAP_WIDTH, MAP_HEIGHT - 1)
-#define RANDOM_POINT_EAST                GPoint(MAP_WIDTH - 1, rand() % MAP_HEIGHT)
-#define RANDOM_POINT_WEST                GPoint(0, rand() % MAP_HEIGHT)
+#define MAX_NPCS_AT_ONE_TIME             32
+#define BASE_NPC_STAT_VALUE              (1 + g_player->int8_stats[DEPTH] - g_player->int8_stats[DEPTH] / 2)
+#define TRAP_DAMAGE                      (BASE_NPC_STAT_VALUE * 2)
+#define CELL_ATTRIBUTES(type)            g_cell_attributes[((type) < 0 ? (type) : 0) - FIRST_CELL_TYPE]  // All loot shares the last entry.
+#define NEXT_LEVEL_LOOKAHEAD             CHUNK_SIZE  // The next level is generated once the player is this near the exit.
+#define TASK_TIME_BUDGET                 10  // milliseconds per slice
+#define TASK_INTERVAL                    20  // milliseconds between slices (leaving time for input and drawing)
+#define MAP_CELL_INDEX(cell)             ((uint16_t) ((cell).y * MAP_WIDTH + (cell).x))
+#define MAX_MAP_CHANGES                  256  // Looted cells and dropped loot saved per location.
+#define MAP_CHANGES_PER_KEY              (PERSIST_DATA_MAX_LENGTH / (int) sizeof(map_change_t))
+#define NUM_MAP_CHANGE_KEYS              (MAX_MAP_CHANGES / MAP_CHANGES_PER_KEY)
+#define LEVEL_CACHE_SIZE                 4  // Recently left levels whose map changes are kept...
+#define LEVEL_CACHE_CHANGES              MAX_MAP_CHANGES  // ...sharing this many changes (so any one level fits)...
+#define NUM_LEVEL_CACHE_CHANGE_KEYS      (LEVEL_CACHE_CHANGES / MAP_CHANGES_PER_KEY)
+#define LEVEL_CACHE_NPCS                 MAX_NPCS_AT_ONE_TIME  // ...and this many NPCs (saved under a single key).
+#define LEVEL_WAS_EVICTED(depth)         (g_level_cache.evicted_depths[(depth) / 8] >> (depth) % 8 & 1)  // Dropped from the cache (its loot's gone).
+#define WINDOW_SIZE                      (RESIDENT_CHUNKS_WIDE * CHUNK_SIZE)  // At most 62 (64 bits per "window_row_t", with borders).
+#define WINDOW_X(cell)                   ((cell).x - g_window_chunk.x * CHUNK_SIZE)
+#define WINDOW_Y(cell)                   ((cell).y - g_window_chunk.y * CHUNK_SIZE)
+#define SOLID_WINDOW_ROW                 ((window_row_t) ~0)
+#define WINDOW_CELL_IS_SOLID(cell)       (g_window_solid_rows[WINDOW_Y(cell) + 1] >> (WINDOW_X(cell) + 1) & 1)  // Blocks sight? (No bounds check: the cell must be in the window or its border.)
+#define CHUNK_STREAMING_BUDGET           10  // milliseconds per step
+#define NO_ENTRANCE                      GPoint(INT16_MIN, INT16_MIN)
+#define ENDLESS_MIN_CHUNK                1  // Endless mode keeps the player's chunk coordinates within...
+#define ENDLESS_MAX_CHUNK                (ENDLESS_MIN_CHUNK + RESIDENT_CHUNKS_WIDE)  // ...this range.
+#define ENDLESS_START_CHUNK              GPoint(ENDLESS_MIN_CHUNK, ENDLESS_MIN_CHUNK)
+#define ENDLESS_DOOR_MARGIN              2  // Doors lie at least this far from chunk corners.
+#define ENDLESS_ROOM_ODDS                3  // 1-in-N chance of a room per chunk.
+#define ENDLESS_LOOT_ODDS                6  // 1-in-N chance of loot per chunk.
+#define ENDLESS_EXIT_ODDS                16  // 1-in-N chance of an exit per chunk.
+#define MAX_ENDLESS_ROOM_RADIUS          3
+#define NEIGHBORHOOD_CENTER              GPoint(1, 1)  // Center of a "get_solid_neighborhood" mask.
+#define FLOW_FIELD_UNREACHABLE           INT16_MAX
+#define MAX_FLOW_FIELD_OFFSET            (INT16_MAX - WINDOW_SIZE * WINDOW_SIZE)  // Beyond this, the field is rebuilt.
+#define FLOW_FIELD_CELL_INDEX(cell)      (WINDOW_X(cell) * WINDOW_SIZE + WINDOW_Y(cell))
+#define FLOW_FIELD_BENCHMARK_RUNS        100
 #define NARRATION_FONT                   fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD)
-#define NUM_PEBBLE_TYPES                 (PEBBLE_OF_DEATH + 1)
-#define NUM_HEAVY_ITEM_TYPES             (NUM_ITEM_TYPES - NUM_PEBBLE_TYPES)
-#define FIRST_HEAVY_ITEM                 DAGGER
 #define MAX_HEAVY_ITEMS                  5
 #define RANDOM_ITEM                      (rand() % (NUM_ITEM_TYPES - NUM_PEBBLE_TYPES) + NUM_PEBBLE_TYPES)
 #define SCREEN_WIDTH                     144
@@ -203,7 +286,31 @@ enum {
 #define GRAPHICS_FRAME_WIDTH             SCREEN_WIDTH
 #define GRAPHICS_FRAME_HEIGHT            (SCREEN_HEIGHT - 2 * STATUS_BAR_HEIGHT)
 #define MAX_VISIBILITY_DEPTH             6  // Helps determine no. of cells visible in a given line of sight.
+#define MAX_SIGHT_DISTANCE               (MAX_VISIBILITY_DEPTH - 2)  // Max. distance at which NPCs can see the player.
 #define STRAIGHT_AHEAD                   (MAX_VISIBILITY_DEPTH - 1)  // Index value for "g_back_wall_coords".
+#define MAX_LIGHT_DISTANCE               (2 * STRAIGHT_AHEAD)  // Of any cell drawn (depth plus sideways offset).
+#define DARK_LEVEL_INTERVAL              3  // Every Nth level is dark...
+#define DARK_LEVEL_LIGHT_RADIUS          1  // ...and lit only this many cells around the player...
+#define PEBBLE_OF_LIGHT_RADIUS_BONUS     2  // ...plus this with the Pebble of Light equipped...
+#define INFUSED_LIGHT_RADIUS_BONUS       1  // ...plus this per equipped item infused with it.
+#define DARKNESS_DEPTH_INTERVAL          20  // Shading falls off one step faster every N levels.
+#define LEVEL_IS_DARK(depth)             ((depth) % DARK_LEVEL_INTERVAL == 0)
+#define FRAME_PROFILER_FRAMES            50  // Frames per log entry (see "-DFRAME_PROFILER").
+#define MAX_FLOOR_ROWS                   (GRAPHICS_FRAME_HEIGHT / 2)  // Rows of floor (and of ceiling) above/below the horizon.
+#define FLOOR_SUBPIXELS                  16  // Floor tile boundaries are tracked in 1/N pixels.
+#define FLOOR_TILE_SHADE_STEP            2  // Alternate floor/ceiling tiles are this many shades darker.
+#define WALL_TEXTURE_SIZE                16  // Texels per side (a power of two) of each wall texture resource.
+#define WALL_TEXTURE_SHIFT               8  // Fractional bits of texture coordinates.
+#define WALL_TEXTURE_SHADE_STEP          2  // Shades darker per unit of a texel's shade offset.
+#define WALL_TEXTURE_FRAME_BUDGET        60  // Max. ms spent drawing textured walls per frame.
+#define WALL_TEXTURE_OVERRUN_FRAMES      3  // Consecutive frames over budget before falling back to dithered walls.
+#define TEXTURE_STEP(span)               g_texture_steps[(span) < 1 ? 1 : (span) > GRAPHICS_FRAME_WIDTH ? GRAPHICS_FRAME_WIDTH : (span)]
+#define MOVEMENT_ANIMATION_FRAMES        3  // Intermediate frames drawn per step or turn.
+#define MOVEMENT_FRAME_DURATION          40  // milliseconds per intermediate frame
+#define REST_VIEW                        0  // Index value for "g_views".
+#define STEP_VIEW(phase)                 (phase)  // Phases 1 to MOVEMENT_ANIMATION_FRAMES.
+#define TURN_VIEW(phase)                 (MOVEMENT_ANIMATION_FRAMES + (phase))
+#define NUM_VIEWS                        (1 + 2 * MOVEMENT_ANIMATION_FRAMES)
 #define TOP_LEFT                         0  // Index value for "g_back_wall_coords".
 #define BOTTOM_RIGHT                     1  // Index value for "g_back_wall_coords".
 #define COMPASS_RADIUS                   5
@@ -218,7 +325,7 @@ enum {
 #define STAT_TITLE_STR_LEN               19
 #define STATS_MENU_NUM_ROWS              (NUM_INT8_STATS + NUM_NEGATIVE_STAT_CONSTANTS)
 #define LEVEL_UP_MENU_NUM_ROWS           NUM_MAJOR_STATS  // 3
-#define MAIN_MENU_NUM_ROWS               3
+#define MAIN_MENU_NUM_ROWS               4
 #define PEBBLE_OPTIONS_MENU_NUM_ROWS     2
 #define LOOT_MENU_NUM_ROWS               1
 #define EQUIPPED_STR                     "Equipped"
@@ -228,16 +335,42 @@ enum {
 #define MULTI_CLICK_TIMEOUT              0  // milliseconds
 #define PLAYER_ACTION_REPEAT_INTERVAL    250  // milliseconds
 #define DEFAULT_TIMER_DURATION           20  // milliseconds
+#define EVENT_QUEUE_CAPACITY             NUM_EVENT_TYPES  // At most one queued event per type (see "post_event").
+#define SIMULATION_STEP_DURATION         250  // milliseconds
+#define STEPS_PER_SECOND                 (1000 / SIMULATION_STEP_DURATION)
+#define MAX_CATCH_UP_STEPS               STEPS_PER_SECOND  // Beyond this, missed steps are dropped.
+#define STEP_INTERPOLATION_SCALE         256  // "get_step_interpolation" returns 0 (a step just ran) up to this.
+#define NPC_ACTION_INTERVAL              STEPS_PER_SECOND  // Steps between NPC actions.
+#define NPC_FIRST_THINK_STEP(npc)        (g_simulation_step + 1 + (npc) % NPC_ACTION_INTERVAL)  // Staggers NPCs.
+#define DISTANT_NPC_INTERVAL_MULTIPLIER  2  // NPCs out of sight range act this much less often.
+#define NPC_ACTIVITY_RADIUS              (MAX_SIGHT_DISTANCE * 2)  // NPCs farther from the player go dormant.
+#define AI_TIME_BUDGET                   20  // milliseconds per step
+#define STATUS_EFFECT_INTERVAL           STEPS_PER_SECOND  // Steps per unit of status effect duration.
+#define STAT_RECOVERY_INTERVAL           STEPS_PER_SECOND  // Steps between health/energy regen.
+#define STATUS_WHEEL_SIZE                8  // Status effect intervals per wheel revolution.
+#define MAX_STATUS_TIMERS                MAX_NPCS_AT_ONE_TIME
+#define MAX_STATUS_EFFECT_DURATION       255  // Status effect intervals.
+#define STATUS_EFFECT_BIT(effect)        (1 << (effect))
+#define NPC_SPAWN_INTERVAL               STEPS_PER_SECOND  // Steps between NPC generation attempts.
+#define NPC_SPAWN_ODDS                   9  // 1-in-N chance per attempt.
+#define ANIMATION_FRAME                  ((g_simulation_step / STEPS_PER_SECOND) % 2)
 #define DEFAULT_MAX_SMALL_INT_VALUE      100
 #define MAX_SMALL_INT_DIGITS             3
 #define MAX_LARGE_INT_DIGITS             5
-#define MAX_DEPTH                        DEFAULT_MAX_SMALL_INT_VALUE
 #define MAX_LEVEL                        DEFAULT_MAX_SMALL_INT_VALUE
 #define PLAYER_STORAGE_KEY               841
 #define LOCATION_STORAGE_KEY             (PLAYER_STORAGE_KEY + 1)
+#define STORAGE_VERSION_KEY              (PLAYER_STORAGE_KEY + 2)
+#define NPC_STORAGE_KEY                  (PLAYER_STORAGE_KEY + 3)
+#define STATUS_EFFECT_STORAGE_KEY        (PLAYER_STORAGE_KEY + 4)
+#define MAP_CHANGE_STORAGE_KEY           (PLAYER_STORAGE_KEY + 5)  // Up to NUM_MAP_CHANGE_KEYS keys.
+#define LEVEL_CACHE_STORAGE_KEY          (MAP_CHANGE_STORAGE_KEY + NUM_MAP_CHANGE_KEYS)
+#define LEVEL_CACHE_CHANGE_STORAGE_KEY   (LEVEL_CACHE_STORAGE_KEY + 1)  // Up to NUM_LEVEL_CACHE_CHANGE_KEYS keys.
+#define LEVEL_CACHE_NPC_STORAGE_KEY      (LEVEL_CACHE_CHANGE_STORAGE_KEY + NUM_LEVEL_CACHE_CHANGE_KEYS)
+#define OLD_CHUNK_STORAGE_KEY            (PLAYER_STORAGE_KEY + 5)  // Map chunks (storage version 6).
+#define STORAGE_VERSION                  9  // Increment when a saved layout changes.
 #define ANIMATED                         true
 #define NOT_ANIMATED                     false
-#define NUM_BACKGROUND_COLOR_SCHEMES     8
 #define NUM_BACKGROUND_COLORS_PER_SCHEME 10
 #define RANDOM_COLOR                     GColorFromRGB(rand() % 256, rand() % 256, rand() % 256)
 #define RANDOM_DARK_COLOR                GColorFromRGB(rand() % 128, rand() % 128, rand() % 128)
@@ -266,9 +399,11 @@ static const char *const g_main_menu_strings[] = {
   "Play",
   "Inventory",
   "Character Stats",
+  "Endless Mode",
   "Dungeon-crawl, baby!",
   "Equip/infuse items.",
   "Health, Energy...",
+  "Roam forever.",
 };
 
 static const char *const g_pebble_options_menu_strings[] = {
@@ -318,6 +453,52 @@ static const char *const g_item_names[] = {
   "H. Armor",
 };
 
+// Inputs (major stats, level, and equipment) of each derived stat:
+static const uint8_t g_derived_stat_inputs[] = {
+  MAJOR_STAT_INPUTS | EQUIPMENT_INPUT(RIGHT_HAND),    // PHYSICAL_POWER
+  MAJOR_STAT_INPUTS | EQUIPMENT_INPUT(BODY) |
+    EQUIPMENT_INPUT(LEFT_HAND),                       // PHYSICAL_DEFENSE
+  MAJOR_STAT_INPUTS | EQUIPMENT_INPUT(BODY) |
+    EQUIPMENT_INPUT(LEFT_HAND),                       // MAGICAL_POWER
+  MAJOR_STAT_INPUTS,                                  // MAGICAL_DEFENSE
+  EQUIPMENT_INPUTS,                                   // FATIGUE_RATE
+  STAT_INPUT(STRENGTH) | STAT_INPUT(LEVEL),           // MAX_HEALTH
+  MAJOR_STAT_INPUTS,                                  // MAX_ENERGY
+};
+
+// Attributes of each cell type (see "CELL_ATTRIBUTES"):
+static const uint8_t g_cell_attributes[] = {
+  DRAWN | INTERACTIVE | PICKED_UP,                  // KEY
+  BLOCKS_MOVEMENT | DRAWN | INTERACTIVE,            // LOCKED_GATE
+  BLOCKS_MOVEMENT | BLOCKS_SIGHT | INTERACTIVE,     // DOOR
+  NPC_PASSABLE,                                     // OPEN_DOOR
+  DRAWN | INTERACTIVE,                              // TRAP
+  BLOCKS_MOVEMENT | BLOCKS_SIGHT,                   // SOLID
+  NPC_PASSABLE,                                     // EMPTY
+  DRAWN | INTERACTIVE | FLOOR_ELLIPSE,              // EXIT
+  DRAWN | INTERACTIVE | NPC_PASSABLE | PICKED_UP | LOOT |
+    FLOOR_ELLIPSE,                                  // Loot (any item type)
+};
+
+// Raw resource holding each wall texture (one shade offset, 0-3, per texel):
+static const uint32_t g_wall_texture_resources[] = {
+  RESOURCE_ID_WALL_TEXTURE_BRICK,  // BRICK_WALL_TEXTURE
+  RESOURCE_ID_WALL_TEXTURE_STONE,  // STONE_WALL_TEXTURE
+  RESOURCE_ID_WALL_TEXTURE_WOOD,   // WOOD_WALL_TEXTURE
+};
+
+// Wall texture of each background color scheme (NONE for dithered walls):
+static const int8_t g_scheme_wall_textures[] = {
+  STONE_WALL_TEXTURE,  // Celeste to very light blue
+  WOOD_WALL_TEXTURE,   // Icterine to Bulgarian rose
+  STONE_WALL_TEXTURE,  // Medium aquamarine to midnight green
+  BRICK_WALL_TEXTURE,  // Melon to dark candy apple red
+  NONE,                // Mint green to Islamic green
+  NONE,                // Baby blue eyes to imperial purple
+  WOOD_WALL_TEXTURE,   // Yellow to army green
+  BRICK_WALL_TEXTURE,  // Rich brilliant lavender to jazzberry jam
+};
+
 static const char *const g_magic_type_names[] = {
   "",
   " of Thunder",
@@ -349,27 +530,193 @@ typedef struct PlayerCharacter {
   int16_t int16_stats[NUM_INT16_STATS];
   uint16_t exp_points;
   heavy_item_t heavy_items[MAX_HEAVY_ITEMS];  // Clothing, armor, and weapons.
+  uint32_t run_seed;  // Each location is generated from this and its depth.
+  int8_t num_keys;  // For locked gates (see "use_cell").
 } __attribute__((__packed__)) player_t;
 
-typedef struct NonPlayerCharacter {
-  GPoint position;
-  int8_t type,
+typedef struct StatusTimer {
+  int8_t npc,     // Index of the affected NPC (NONE if the timer is free).
+         effect,
+         next;    // Next timer in the same wheel slot (or NONE).
+  uint8_t slot,
+          rounds; // Full wheel revolutions remaining before expiry.
+} __attribute__((__packed__)) status_timer_t;
+
+typedef struct StatusWheel {
+  status_timer_t timers[MAX_STATUS_TIMERS];
+  int8_t slots[STATUS_WHEEL_SIZE];  // First timer in each slot.
+  uint8_t position;
+} __attribute__((__packed__)) status_wheel_t;
+
+// Non-player characters, stored as parallel arrays indexed by NPC:
+typedef struct NpcPool {
+  GPoint positions[MAX_NPCS_AT_ONE_TIME];
+  int8_t types[MAX_NPCS_AT_ONE_TIME],  // NONE for unused entries.
+         items[MAX_NPCS_AT_ONE_TIME],
+         health[MAX_NPCS_AT_ONE_TIME],
+         power[MAX_NPCS_AT_ONE_TIME],
+         physical_defenses[MAX_NPCS_AT_ONE_TIME],
+         magical_defenses[MAX_NPCS_AT_ONE_TIME];
+  uint8_t status_effects[MAX_NPCS_AT_ONE_TIME];  // One bit per effect.
+  int8_t live_npcs[MAX_NPCS_AT_ONE_TIME],     // Dense list of living NPCs.
+         live_npc_slots[MAX_NPCS_AT_ONE_TIME],  // Each NPC's "live_npcs" slot.
+         free_npcs[MAX_NPCS_AT_ONE_TIME];     // Stack of unused NPCs.
+  uint32_t next_think_steps[MAX_NPCS_AT_ONE_TIME],  // When each NPC acts.
+           dormant_since_steps[MAX_NPCS_AT_ONE_TIME];
+  uint8_t dormant_damage_over_time[MAX_NPCS_AT_ONE_TIME];  // When it slept.
+  int8_t pending_damage[MAX_NPCS_AT_ONE_TIME];  // Owed from dormancy.
+  int8_t arrival_directions[MAX_NPCS_AT_ONE_TIME];  // Toward the cell each NPC left this step (or NONE).
+  uint8_t num_live_npcs,
+          num_active_npcs,  // Active NPCs come first in "live_npcs".
+          num_free_npcs,
+          ai_cursor;  // Next "live_npcs" slot for the AI scheduler to visit.
+  status_wheel_t status_wheel;
+} npc_pool_t;
+
+// Compact form in which each living NPC is saved (power and defenses are
+// recomputed from its archetype and the current depth):
+typedef struct SavedNpc {
+  int8_t npc,
+         x,
+         y,
+         type,
          item,
-         health,
-         power,
-         physical_defense,
-         magical_defense;
-  uint8_t status_effects[NUM_STATUS_EFFECTS];
-} __attribute__((__packed__)) npc_t;
+         health;
+  uint8_t status_effects;
+} __attribute__((__packed__)) saved_npc_t;
+
+typedef struct GameEvent {
+  int8_t type,
+         value;
+} game_event_t;
 
+// One row (or column) of the resident window's solidity bitset (bit "x + 1" is
+// set if cell "x" is solid; bits 0 and "WINDOW_SIZE + 1" form a solid border):
+typedef uint64_t window_row_t;
+
+// A cell whose type has changed since its location was generated:
+typedef struct MapChange {
+  uint16_t cell;  // See "MAP_CELL_INDEX".
+  int8_t type,
+         generated_type;
+} __attribute__((__packed__)) map_change_t;
+
+// Everything else about a location's map can be regenerated from the player's
+// run seed and depth (its map changes are saved under their own keys, only as
+// many as are in use):
 typedef struct Location {
-  int8_t map[MAP_WIDTH][MAP_HEIGHT],
-         floor_color_scheme,
+  int8_t floor_color_scheme,
          wall_color_scheme;
-  GPoint entrance;
-  npc_t npcs[MAX_NPCS_AT_ONE_TIME];
+  GPoint entrance,  // NO_ENTRANCE in endless mode.
+         exit;
+  bool endless;  // Chunks come from "generate_endless_chunk" (and changes to
+                 // them aren't saved).
+  GPoint chunk_offset;  // Endless world coordinates of chunk (0, 0).
+  uint16_t num_map_changes;
+  map_change_t map_changes[MAX_MAP_CHANGES];
 } __attribute__((__packed__)) location_t;
 
+// A recently left location, which can be restored exactly from its seed, map
+// changes, and NPCs (see "cache_level"):
+typedef struct CachedLevel {
+  uint32_t seed;  // See "get_level_seed".
+  int8_t depth,
+         direction;  // The player's, on leaving.
+  GPoint position;  // Likewise.
+  uint16_t num_map_changes;
+  uint8_t num_npcs;
+} __attribute__((__packed__)) cached_level_t;
+
+// Recently left locations, most recently left first, with their map changes
+// and NPCs stored one location after another in the same order:
+typedef struct LevelCache {
+  uint8_t num_levels;
+  uint16_t num_map_changes;  // In total.
+  uint8_t num_npcs,  // Likewise.
+          evicted_depths[MAX_DEPTH / 8 + 1];  // See "LEVEL_WAS_EVICTED".
+  cached_level_t levels[LEVEL_CACHE_SIZE];
+  map_change_t map_changes[LEVEL_CACHE_CHANGES];
+  saved_npc_t npcs[LEVEL_CACHE_NPCS];  // Without their status effects.
+} __attribute__((__packed__)) level_cache_t;
+
+// The resident window of the location the player just left (with its map
+// changes applied), kept so that going straight back needs no generation:
+typedef struct LevelWindow {
+  uint32_t seed;
+  int8_t depth,  // Zero if no window is kept.
+         floor_color_scheme,
+         wall_color_scheme;
+  GPoint entrance,
+         exit;
+  resident_chunk_t chunks[RESIDENT_CHUNKS_WIDE][RESIDENT_CHUNKS_WIDE];
+} __attribute__((__packed__)) level_window_t;
+
+// One row of the floor (and the mirrored row of the ceiling) in a given view,
+// precomputed by "init_floor_rows":
+typedef struct FloorRow {
+  uint8_t distance,  // Depth of the cell whose floor the row crosses.
+          step;  // Horizontal distance between dots.
+  int8_t first_tile;  // Sideways index (0 straight ahead) of the tile at x = 0.
+  int16_t first_boundary,  // Where the next tile begins (x * FLOOR_SUBPIXELS).
+          tile_width;  // Width of one cell at this row (x FLOOR_SUBPIXELS).
+} __attribute__((__packed__)) floor_row_t;
+
+// A precomputed projection of the 3D environment: at rest, or at one phase of
+// a step or turn (see "init_views"):
+typedef struct View {
+  GPoint const (*wall_coords)[(STRAIGHT_AHEAD * 2) + 1]
+                             [2];  // As in "g_back_wall_coords" (unshifted).
+  const floor_row_t *floor_rows;  // MAX_FLOOR_ROWS of them.
+  int16_t shift;  // Horizontal offset of the whole view (for turns).
+} view_t;
+
+typedef struct NpcArchetype {
+  int8_t size,
+         power_bonus,
+         physical_defense_bonus,
+         magical_defense_bonus,
+         loot_policy,
+         body,
+         ai_profile,
+         color_variant;  // 0 for "black"/"dark" NPCs, 1 for "white"/"pale".
+} npc_archetype_t;
+
+// NPC archetypes, indexed by NPC type:
+static const npc_archetype_t g_npc_archetypes[] = {
+  // BLACK_MONSTER_LARGE:
+  {LARGE_NPC, 2, 0, 0, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 0},
+  // WHITE_MONSTER_LARGE:
+  {LARGE_NPC, 2, -1, 1, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 1},
+  // BLACK_MONSTER_MEDIUM:
+  {MEDIUM_NPC, 1, 0, 0, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 0},
+  // WHITE_MONSTER_MEDIUM:
+  {MEDIUM_NPC, 1, -1, 1, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 1},
+  // BLACK_MONSTER_SMALL:
+  {SMALL_NPC, 0, 0, 0, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 0},
+  // WHITE_MONSTER_SMALL:
+  {SMALL_NPC, 0, -1, 1, NO_LOOT, FLOATING_MONSTER_BODY, MELEE_AI, 1},
+  // DARK_OGRE:
+  {LARGE_NPC, 2, 0, 0, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 0},
+  // PALE_OGRE:
+  {LARGE_NPC, 2, -1, 1, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 1},
+  // DARK_TROLL:
+  {MEDIUM_NPC, 1, 0, 0, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 0},
+  // PALE_TROLL:
+  {MEDIUM_NPC, 1, -1, 1, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 1},
+  // DARK_GOBLIN:
+  {SMALL_NPC, 0, 0, 0, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 0},
+  // PALE_GOBLIN:
+  {SMALL_NPC, 0, -1, 1, RANDOM_LOOT, HUMANOID_MONSTER_BODY, MELEE_AI, 1},
+  // WARRIOR_LARGE:
+  {LARGE_NPC, 2, 1, 0, RANDOM_LOOT, WARRIOR_BODY, MELEE_AI, 0},
+  // WARRIOR_MEDIUM:
+  {MEDIUM_NPC, 1, 1, 0, RANDOM_LOOT, WARRIOR_BODY, MELEE_AI, 0},
+  // WARRIOR_SMALL:
+  {SMALL_NPC, 0, 1, 0, RANDOM_LOOT, WARRIOR_BODY, MELEE_AI, 0},
+  // MAGE:
+  {SMALL_NPC, 0, -1, 1, PEBBLE_LOOT, MAGE_BODY, SPELLCASTER_AI, 0},
+};
+
 /******************************************************************************
   Global Variables
 ******************************************************************************/
@@ -380,16 +727,76 @@ TextLayer *g_narration_text_layer;
 StatusBarLayer *g_status_bars[NUM_WINDOWS];
 AppTimer *g_attack_timer,
          *g_player_spell_timer,
-         *g_enemy_spell_timer;
+         *g_enemy_spell_timer,
+         *g_simulation_timer,
+         *g_spawn_timer,
+         *g_task_timer;
 GPoint g_back_wall_coords[MAX_VISIBILITY_DEPTH - 1]
                          [(STRAIGHT_AHEAD * 2) + 1]
                          [2];
 GPath *g_compass_path;
 GColor g_magic_type_colors[NUM_PEBBLE_TYPES][2],
        g_background_colors[NUM_BACKGROUND_COLOR_SCHEMES]
-                          [NUM_BACKGROUND_COLORS_PER_SCHEME];
+                          [NUM_BACKGROUND_COLORS_PER_SCHEME],
+       g_floor_shades[MAX_LIGHT_DISTANCE + 1]
+                     [NUM_BACKGROUND_COLORS_PER_SCHEME],  // See "update_shading".
+       g_wall_shades[MAX_LIGHT_DISTANCE + 1]
+                    [NUM_BACKGROUND_COLORS_PER_SCHEME];
+uint32_t g_shading_key;  // Depth, light radius, and color schemes shaded for.
+GPoint g_step_wall_coords[MOVEMENT_ANIMATION_FRAMES]
+                         [MAX_VISIBILITY_DEPTH - 1]
+                         [(STRAIGHT_AHEAD * 2) + 1]
+                         [2];  // Partway through a step (turns just shift).
+floor_row_t g_floor_rows[MAX_FLOOR_ROWS],  // At rest (and while turning).
+            g_step_floor_rows[MOVEMENT_ANIMATION_FRAMES][MAX_FLOOR_ROWS];
+view_t g_views[NUM_VIEWS];
+const view_t *g_view;  // The view being drawn (see "select_view")...
+GPoint g_view_position;  // ...from this cell...
+int8_t g_view_direction;  // ...facing this way.
+int8_t g_movement_animation;  // The step or turn being animated (or NONE).
+uint32_t g_movement_start_time;
+AppTimer *g_movement_timer,
+         *g_npc_movement_timer;  // Redraws while NPCs glide between cells.
+GColor g_floor_row_colors[MAX_FLOOR_ROWS][2];  // By tile index parity.
+uint32_t g_floor_phase;  // Shading key and tile parity the colors are for...
+const floor_row_t *g_floor_phase_rows;  // ...and the view's floor rows.
+int8_t g_light_radius;  // Cells farther away than this aren't drawn.
+uint8_t g_wall_textures[NUM_WALL_TEXTURES]
+                       [WALL_TEXTURE_SIZE * WALL_TEXTURE_SIZE];
+bool g_wall_texture_is_loaded[NUM_WALL_TEXTURES];
+uint16_t g_texture_steps[GRAPHICS_FRAME_WIDTH + 1];  // Per pixel, by wall width or height.
+bool g_wall_textures_enabled;  // Cleared when textured walls keep running over budget.
+uint8_t g_wall_texture_overruns;  // Consecutive frames whose walls ran over budget.
+#ifdef FRAME_PROFILER
+uint32_t g_profiled_frame_ms;
+uint16_t g_profiled_frames;
+#endif
 player_t *g_player;
 location_t *g_location;
+npc_pool_t *g_npcs;
+resident_chunk_t g_resident_chunks[RESIDENT_CHUNKS_WIDE]
+                                  [RESIDENT_CHUNKS_WIDE];  // By chunk y, x.
+GPoint g_window_chunk;  // Northwest chunk of the resident window.
+level_generator_t g_next_level,  // Generated near the exit, ahead of time.
+                  g_chunk_generator;  // Carves chunks as they're streamed in.
+resident_chunk_t g_next_level_chunks[RESIDENT_CHUNKS_WIDE]
+                                    [RESIDENT_CHUNKS_WIDE];  // Around its entrance.
+level_cache_t g_level_cache;
+level_window_t g_level_window;
+bool g_level_cache_is_dirty;  // Not saved since it last changed.
+bool g_task_is_pending[NUM_TASKS];
+bool g_map_window_is_resident;  // No chunks are waiting to be streamed in.
+window_row_t g_window_solid_rows[WINDOW_SIZE + 2],  // Include solid borders.
+             g_window_solid_columns[WINDOW_SIZE + 2],
+             g_window_blocked_rows[WINDOW_SIZE],  // Bit "x": blocks movement.
+             g_window_passable_rows[WINDOW_SIZE];  // Bit "x": NPC_PASSABLE.
+int8_t g_npc_grid[WINDOW_SIZE][WINDOW_SIZE];  // NPC in each window cell.
+int16_t g_flow_field[WINDOW_SIZE][WINDOW_SIZE],  // Walking distance to player,
+        g_flow_field_offset;  // which is each entry plus this offset.
+uint16_t g_flow_field_queue[WINDOW_SIZE * WINDOW_SIZE];
+GPoint g_flow_field_origin;  // Player position when the field was updated.
+GPoint g_activity_origin;  // Player position when NPC activity was updated.
+bool g_flow_field_is_stale;
 uint8_t g_current_window,
         g_current_narration,
         g_current_selection,
@@ -398,8 +805,18 @@ uint8_t g_current_window,
         g_attack_slash_y1,
         g_attack_slash_y2;
 int8_t g_player_current_spell_animation,
-       g_enemy_current_spell_animation;
+       g_enemy_current_spell_animation,
+       g_enemy_spell_caster;  // Index of the NPC casting the current spell.
 bool g_player_is_attacking;
+game_event_t g_event_queue[EVENT_QUEUE_CAPACITY];
+uint8_t g_event_queue_head,
+        g_num_queued_events;
+int8_t g_equipment_bonuses[NUM_EQUIP_TARGETS][NUM_DERIVED_STATS];
+uint32_t g_simulation_step,
+         g_last_simulation_time,
+         g_simulation_time_accumulator,
+         g_ai_max_lag;  // Steps the most overdue NPC waited (last step).
+uint8_t g_ai_npcs_processed;  // NPCs that acted during the last step.
 
 /******************************************************************************
   Function Declarations
@@ -407,33 +824,113 @@ bool g_player_is_attacking;
 
 int8_t set_player_direction(const int8_t new_direction);
 bool move_player(const int8_t direction);
-void move_npc(npc_t *const npc, const int8_t direction);
+void step_player(const GPoint destination);
+void start_movement_animation(const int8_t animation);
+void stop_movement_animation(void);
+bool use_cell(const GPoint cell, const int8_t type);
+void move_npc(const int8_t npc, const int8_t direction);
 int8_t damage_player(int8_t damage);
-int8_t damage_npc(npc_t *const npc, int8_t damage);
-int8_t cast_spell_on_npc(npc_t *const npc,
+int8_t damage_npc(const int8_t npc, int8_t damage);
+int8_t cast_spell_on_npc(const int8_t npc,
                          const int8_t magic_type,
                          const int8_t max_potency);
+uint8_t get_status_effect(const int8_t npc, const int8_t effect);
+void add_status_effect(const int8_t npc,
+                       const int8_t effect,
+                       const int16_t amount);
+void clear_status_effects(const int8_t npc);
+void advance_status_wheel(void);
+void schedule_status_timer(const int8_t timer_index, const int16_t duration);
+void unschedule_status_timer(const int8_t timer_index);
+int8_t get_status_timer(const int8_t npc_index, const int8_t effect);
+int8_t evict_status_timer(void);
+int16_t get_status_timer_duration(const status_timer_t *const timer);
 int8_t adjust_player_current_health(const int8_t amount);
 int8_t adjust_player_current_energy(const int8_t amount);
 bool add_new_npc(const int8_t npc_type, const GPoint position);
-GPoint get_cell_farther_away(const GPoint reference_point,
-                             const int8_t direction,
-                             const int8_t distance);
-int8_t get_pursuit_direction(const GPoint pursuer, const GPoint pursuee);
+int8_t spawn_npc(const int8_t npc_type, const GPoint position);
+int8_t get_flow_field_direction(const GPoint position, const bool fleeing);
+bool flow_field_is_current(void);
+void update_flow_field(void);
+void rebuild_flow_field(void);
+void open_flow_field_cell(const GPoint cell);
+void propagate_flow_field(int16_t queue_length);
+#ifdef FLOW_FIELD_BENCHMARK
+void benchmark_flow_field(void);
+#endif
 int8_t get_direction_to_the_left(const int8_t reference_direction);
 int8_t get_direction_to_the_right(const int8_t reference_direction);
-int8_t get_opposite_direction(const int8_t direction);
 int8_t get_nth_item_type(const int8_t n);
 int8_t get_num_pebble_types_owned(void);
 int8_t get_inventory_row_for_pebble(const int8_t pebble_type);
 heavy_item_t *get_heavy_item_equipped_at(const int8_t equip_target);
 int8_t get_cell_type(const GPoint cell);
+uint16_t get_solid_neighborhood(const GPoint cell);
+uint16_t get_neighborhood_bit(const int8_t direction,
+                              const int8_t direction_2);
+bool cell_is_in_window(const GPoint cell);
 void set_cell_type(GPoint cell, const int8_t type);
-npc_t *get_npc_at(const GPoint cell);
+bool in_line_of_sight(const GPoint cell_1, const GPoint cell_2);
+int8_t get_chunk_cell_type(const map_chunk_t *const chunk, const GPoint cell);
+resident_chunk_t *get_resident_chunk(const GPoint chunk_position);
+void load_map_chunk(resident_chunk_t *const resident_chunk,
+                    const GPoint chunk_position);
+void record_map_change(const GPoint cell,
+                       const int8_t old_type,
+                       const int8_t new_type);
+bool map_change_is_recordable(const GPoint cell);
+void apply_map_changes(resident_chunk_t *const resident_chunk);
+void recenter_map_window(void);
+bool stream_map_chunks(void);
+void load_map_window(void);
+void carve_streamed_chunks(void);
+void unload_map_chunks(void);
+void finish_generated_chunks(void);
+void update_window_bitsets(const GPoint chunk_position);
+void rebase_endless_map(const GPoint shift);
+int8_t generate_level(const uint32_t seed);
+int8_t use_level_layout(const level_generator_t *const generator);
+void pregenerate_next_level(void);
+bool levels_need_pregenerating(void);
+void request_pregenerated_levels(void);
+static void worker_message_handler(uint16_t type, AppWorkerMessage *message);
+int8_t load_pregenerated_level(void);
+void cache_level(void);
+bool uncache_level(void);
+bool load_level_window(void);
+void generate_endless_chunk(map_chunk_t *const chunk,
+                            const GPoint chunk_position);
+void carve_endless_corridor(map_chunk_t *const chunk,
+                            GPoint from,
+                            const GPoint to,
+                            const bool vertical_first);
+int8_t get_endless_door(const GPoint world_chunk, const int8_t direction);
+uint32_t get_endless_hash(const GPoint world_chunk, const uint8_t salt);
+#ifdef MAP_STREAMING_STATS
+void report_map_memory(void);
+#endif
+int8_t get_npc_at(const GPoint cell);
+void set_npc_position(const int8_t npc, const GPoint position);
+void remove_npc(const int8_t npc);
+void swap_live_npcs(const int8_t slot_1, const int8_t slot_2);
+bool npc_is_near_player(const int8_t npc);
+bool npc_is_within_sight_distance(const int8_t npc);
+void put_npc_to_sleep(const int8_t npc);
+void wake_npc(const int8_t npc);
+void update_npc_activity(void);
+void init_npc_pool(void);
+void init_npc_grid(void);
+void clear_npc_pool(void);
+int8_t get_saved_npcs(saved_npc_t *const saved_npcs);
+void restore_npcs(const saved_npc_t *const saved_npcs,
+                  const int8_t num_saved_npcs);
 char *get_stat_title_str(const int8_t stat_index);
 bool occupiable(const GPoint cell);
+bool traversable(const GPoint cell);
 int8_t show_narration(const int8_t narration);
 int8_t show_window(const int8_t window_index, const bool animated);
+void post_event(const int8_t type, const int8_t value);
+void dispatch_events(void);
 static void main_menu_draw_header_callback(GContext *ctx,
                                            const Layer *cell_layer,
                                            uint16_t section_index,
@@ -500,6 +997,10 @@ static uint16_t menu_get_num_rows_callback(MenuLayer *menu_layer,
                                            uint16_t section_index,
                                            void *data);
 void draw_scene(Layer *layer, GContext *ctx);
+void select_view(void);
+int8_t get_light_radius(void);
+void update_shading(void);
+void update_floor_colors(void);
 void draw_floor_and_ceiling(GContext *ctx);
 void draw_cell_walls(GContext *ctx,
                      const GPoint cell,
@@ -509,12 +1010,22 @@ void draw_cell_contents(GContext *ctx,
                         const GPoint cell,
                         const int8_t depth,
                         const int8_t position);
+uint8_t get_drawing_unit(const int8_t depth, const int8_t position);
+GPoint get_floor_center_point(const int8_t depth, const int8_t position);
+void interpolate_npc_movement(const int8_t npc,
+                              const int8_t depth,
+                              const int8_t position,
+                              GPoint *const floor_center_point,
+                              uint8_t *const drawing_unit);
 void draw_shaded_quad(GContext *ctx,
                       const GPoint upper_left,
                       const GPoint lower_left,
                       const GPoint upper_right,
                       const GPoint lower_right,
-                      const GPoint shading_ref);
+                      const GPoint shading_ref,
+                      const GColor *const colors,
+                      const uint8_t *const texture,
+                      const uint16_t column_step);
 void draw_status_meter(GContext *ctx,
                        GPoint origin,
                        const float ratio);
@@ -526,7 +1037,9 @@ void fill_ellipse(GContext *ctx,
 static void player_spell_timer_callback(void *data);
 static void enemy_spell_timer_callback(void *data);
 static void attack_timer_callback(void *data);
+static void movement_timer_callback(void *data);
 static void graphics_window_appear(Window *window);
+static void graphics_window_disappear(Window *window);
 void graphics_up_single_repeating_click(ClickRecognizerRef recognizer,
                                         void *context);
 void graphics_up_multi_click(ClickRecognizerRef recognizer, void *context);
@@ -538,16 +1051,49 @@ void graphics_select_single_repeating_click(ClickRecognizerRef recognizer,
 void graphics_click_config_provider(void *context);
 void narration_single_click(ClickRecognizerRef recognizer, void *context);
 void narration_click_config_provider(void *context);
+static void simulation_timer_callback(void *data);
+void simulation_step(void);
+bool run_ai_scheduler(void);
+bool run_npc_turn(const int8_t npc, const uint32_t start_time);
+uint8_t get_npc_think_interval(const int8_t npc);
+void run_npc_ai(const int8_t npc);
+void start_simulation(void);
+void wake_simulation(void);
+void stop_simulation(void);
+bool simulation_can_idle(void);
+bool player_is_recovering(void);
+void schedule_task(const int8_t task);
+static void task_timer_callback(void *data);
+bool run_task(const int8_t task);
+void finish_task(const int8_t task);
+static void spawn_timer_callback(void *data);
+void arm_spawn_timer(void);
+void register_player_input(void);
+uint16_t get_step_interpolation(void);
+void start_npc_movement_animation(void);
+static void npc_movement_timer_callback(void *data);
+uint32_t get_current_time_ms(void);
 void app_focus_handler(const bool in_focus);
 void equip_heavy_item(heavy_item_t *const item);
 void unequip_heavy_item(heavy_item_t *const heavy_item);
 void unequip_item_at(const int8_t equip_target);
-void set_player_minor_stats(void);
+void update_player_stats(const uint8_t changed_inputs);
+void cache_equipment_bonuses(const int8_t equip_target);
+void set_derived_stat(const int8_t derived_stat);
 void init_player(void);
-void init_npc(npc_t *const npc, const int8_t type, const GPoint position);
+void init_npc(const int8_t npc, const int8_t type, const GPoint position);
+void set_npc_stats(const int8_t npc);
 void init_heavy_item(heavy_item_t *const item, const int8_t n);
 void init_wall_coords(void);
-void init_location(void);
+void init_views(void);
+void init_floor_rows(const view_t *view, floor_row_t *rows);
+void init_wall_textures(void);
+void init_location(const int8_t depth);
+void init_endless_location(void);
+void save_game(void);
+void load_location(void);
+void load_level_cache(void);
+void load_npcs(void);
 void init_window(const int8_t window_index);
 void deinit_window(const int8_t window_index);
 void init(void);
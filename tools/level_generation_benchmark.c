@@ -0,0 +1,218 @@
+/******************************************************************************
+   Filename: level_generation_benchmark.c
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: A host program (not part of the app) that generates a corpus of
+             levels with "level_generation.c", the way the worker does, checks
+             each one, and reports the worst-case and average time taken. A
+             level passes if its border is solid, its exit is open, every open
+             cell can be reached from its entrance, and its carved chunks match
+             its open cells. Build and run from the repository's root:
+
+               gcc -O2 -Wall -Itools -Isrc -o level_generation_benchmark \
+                 tools/level_generation_benchmark.c src/level_generation.c
+               ./level_generation_benchmark [num_levels] [first_seed]
+
+             (Add "-DMAP_CHUNKS_WIDE=3" to test maps no bigger than the
+             resident window. Timings on the watch itself are logged by the
+             worker when built with "-DLEVEL_GENERATION_BENCHMARK".)
+******************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include <pebble_worker.h>
+#include "level_generation.h"
+
+#if MAP_WIDTH > 64
+#error "The benchmark's bitsets hold at most 64 cells per map row."
+#endif
+
+#define DEFAULT_NUM_LEVELS 3000
+
+level_generator_t g_level_generator;
+resident_chunk_t g_level_chunks[RESIDENT_CHUNKS_WIDE]
+                               [RESIDENT_CHUNKS_WIDE];  // By chunk y, x.
+uint64_t g_open_rows[MAP_HEIGHT],  // Bit "x" is set if cell "x" is open.
+         g_reachable_rows[MAP_HEIGHT];  // Likewise, if reachable.
+
+/******************************************************************************
+   Function: generate_level
+
+Description: Generates a level from scratch into "g_level_chunks" and
+             "g_open_rows" (as "pregenerate_level" does in the worker).
+
+     Inputs: seed  - The level's seed.
+             depth - The level's depth.
+
+    Outputs: Time taken, in nanoseconds.
+******************************************************************************/
+uint64_t generate_level(const uint32_t seed, const int8_t depth) {
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  init_level_generator(&g_level_generator, seed, depth, g_level_chunks);
+  memset(g_open_rows, 0, sizeof(g_open_rows));
+  g_level_generator.open_rows = g_open_rows;
+  claim_level_chunks(&g_level_generator);
+  while (!run_level_generator(&g_level_generator)) {
+    // (Each call carves another room, corridor, etc.)
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000 +
+         end.tv_nsec - start.tv_nsec;
+}
+
+/******************************************************************************
+   Function: flood_from_entrance
+
+Description: Marks every open cell that can be reached from the entrance of
+             the level just generated in "g_reachable_rows", a row at a time
+             (as "level_is_connected" does in the worker).
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void flood_from_entrance(void) {
+  int8_t y;
+  bool changed = true;
+  uint64_t reachable;
+  const GPoint entrance = g_level_generator.entrance;
+
+  memset(g_reachable_rows, 0, sizeof(g_reachable_rows));
+  g_reachable_rows[entrance.y] = ((uint64_t) 1 << entrance.x) &
+                                 g_open_rows[entrance.y];
+  while (changed) {
+    changed = false;
+    for (y = 0; y < MAP_HEIGHT; ++y) {
+      reachable = g_reachable_rows[y] |
+                  g_reachable_rows[y] << 1 |
+                  g_reachable_rows[y] >> 1;
+      if (y > 0) {
+        reachable |= g_reachable_rows[y - 1];
+      }
+      if (y < MAP_HEIGHT - 1) {
+        reachable |= g_reachable_rows[y + 1];
+      }
+      reachable &= g_open_rows[y];
+      if (reachable != g_reachable_rows[y]) {
+        g_reachable_rows[y] = reachable;
+        changed = true;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+   Function: check_level
+
+Description: Checks the level just generated, describing the first problem
+             found (if any).
+
+     Inputs: None.
+
+    Outputs: NULL if the level is valid, otherwise a description of what's
+             wrong with it.
+******************************************************************************/
+const char *check_level(void) {
+  int8_t i, x, y;
+  bool open;
+  const uint64_t border = (uint64_t) 1 | (uint64_t) 1 << (MAP_WIDTH - 1);
+  const GPoint exit = g_level_generator.exit;
+  const resident_chunk_t *resident_chunk;
+
+  if (g_open_rows[0] || g_open_rows[MAP_HEIGHT - 1]) {
+    return "open cell in the top or bottom row";
+  }
+  for (y = 0; y < MAP_HEIGHT; ++y) {
+    if (g_open_rows[y] & border) {
+      return "open cell in the left or right column";
+    }
+  }
+  if (!(g_open_rows[exit.y] >> exit.x & 1)) {
+    return "exit not open";
+  }
+  flood_from_entrance();
+  for (y = 0; y < MAP_HEIGHT; ++y) {
+    if (g_reachable_rows[y] != g_open_rows[y]) {
+      return "open cell unreachable from the entrance";
+    }
+  }
+
+  // Each carved chunk should be solid exactly where the map isn't open:
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE * RESIDENT_CHUNKS_WIDE; ++i) {
+    resident_chunk = &g_level_chunks[i / RESIDENT_CHUNKS_WIDE]
+                                    [i % RESIDENT_CHUNKS_WIDE];
+    if (!resident_chunk->generating) {
+      continue;
+    }
+    for (y = 0; y < CHUNK_SIZE; ++y) {
+      for (x = 0; x < CHUNK_SIZE; ++x) {
+        open = g_open_rows[resident_chunk->position.y * CHUNK_SIZE + y] >>
+                 (resident_chunk->position.x * CHUNK_SIZE + x) & 1;
+        if (open == (resident_chunk->chunk.solid_rows[y] >> x & 1)) {
+          return "carved chunk disagrees with the map";
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+   Function: main
+
+Description: Generates and checks "num_levels" levels (DEFAULT_NUM_LEVELS by
+             default), one per run seed from "first_seed" (zero by default),
+             cycling through the depths, then reports the timings.
+
+     Inputs: argc - Number of command-line arguments.
+             argv - Optional level count and first seed.
+
+    Outputs: Zero if every level passes, one otherwise.
+******************************************************************************/
+int main(int argc, char *argv[]) {
+  int32_t i, num_levels = DEFAULT_NUM_LEVELS, num_failures = 0;
+  uint32_t first_seed = 0, run_seed;
+  int8_t depth;
+  uint64_t duration_ns, worst_ns = 0, total_ns = 0;
+  const char *problem;
+
+  if (argc > 1) {
+    num_levels = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    first_seed = strtoul(argv[2], NULL, 0);
+  }
+  for (i = 0; i < num_levels; ++i) {
+    run_seed = get_hash(first_seed + i);
+    depth = 1 + i % MAX_DEPTH;
+    duration_ns = generate_level(get_level_seed(run_seed, depth), depth);
+    total_ns += duration_ns;
+    if (duration_ns > worst_ns) {
+      worst_ns = duration_ns;
+    }
+    problem = check_level();
+    if (problem) {
+      printf("Run seed %u (index %u), depth %d: %s\n",
+             (unsigned) run_seed,
+             (unsigned) (first_seed + i),
+             depth,
+             problem);
+      num_failures++;
+    }
+  }
+  printf("%d levels (%dx%d chunks): %d failed, worst %.1f us, "
+         "average %.1f us\n",
+         (int) num_levels,
+         MAP_CHUNKS_WIDE,
+         MAP_CHUNKS_WIDE,
+         (int) num_failures,
+         worst_ns / 1000.0,
+         num_levels > 0 ? total_ns / 1000.0 / num_levels : 0.0);
+
+  return num_failures > 0;
+}
@@ -0,0 +1,33 @@
+/******************************************************************************
+   Filename: pebble_worker.h
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: The little of <pebble_worker.h> that the level generator uses,
+             so "level_generation.c" can be built on the host for testing (see
+             "level_generation_benchmark.c"). Not part of the app or worker.
+******************************************************************************/
+
+#ifndef HOST_PEBBLE_WORKER_H_
+#define HOST_PEBBLE_WORKER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct GPoint {
+  int16_t x;
+  int16_t y;
+} GPoint;
+
+#define GPoint(x, y) ((GPoint){(x), (y)})
+
+// There's no persistent storage on the host:
+static inline int persist_read_data(const uint32_t key,
+                                    void *buffer,
+                                    const size_t buffer_size) {
+  return -1;
+}
+
+#endif  // HOST_PEBBLE_WORKER_H_
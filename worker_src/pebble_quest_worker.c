@@ -0,0 +1,233 @@
+/******************************************************************************
+   Filename: pebble_quest_worker.c
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: Function definitions for PebbleQuest's background worker, which
+             keeps the next NUM_PREGENERATED_LEVELS levels generated ahead of
+             time, so that the app does no generation work on taking an exit.
+             (Running in its own process, its CPU cost can be measured apart
+             from the app's.)
+******************************************************************************/
+
+#include "pebble_quest_worker.h"
+
+/******************************************************************************
+   Function: worker_message_handler
+
+Description: Handles messages from the app, which asks for levels to be
+             pregenerated whenever the player enters a new location. (The app
+             is told once they're done, so it can stop the worker.)
+
+     Inputs: type    - The message's type.
+             message - Pointer to the message's data.
+
+    Outputs: None.
+******************************************************************************/
+static void worker_message_handler(uint16_t type, AppWorkerMessage *message) {
+  if (type == PREGENERATE_LEVELS_MESSAGE) {
+    pregenerate_levels((uint32_t) message->data1 << 16 | message->data0,
+                       message->data2);
+    app_worker_send_message(LEVELS_PREGENERATED_MESSAGE, message);
+  }
+}
+
+/******************************************************************************
+   Function: pregenerate_levels
+
+Description: Makes sure the levels just below a given depth have been
+             pregenerated (generating any that haven't).
+
+     Inputs: run_seed - The player's run seed.
+             depth    - The player's current depth.
+
+    Outputs: None.
+******************************************************************************/
+void pregenerate_levels(const uint32_t run_seed, const int8_t depth) {
+  int8_t i;
+
+  for (i = 1; i <= NUM_PREGENERATED_LEVELS && depth + i <= MAX_DEPTH; ++i) {
+    if (!level_is_pregenerated(run_seed, depth + i)) {
+      pregenerate_level(run_seed, depth + i);
+    }
+  }
+}
+
+/******************************************************************************
+   Function: pregenerate_level
+
+Description: Generates the level at a given depth of a given run (the whole
+             map, though only the chunks around the entrance are kept), then
+             saves it if its exit can be reached from its entrance.
+
+     Inputs: run_seed - The player's run seed.
+             depth    - Depth of the level to be generated.
+
+    Outputs: None.
+******************************************************************************/
+void pregenerate_level(const uint32_t run_seed, const int8_t depth) {
+#ifdef LEVEL_GENERATION_BENCHMARK
+  time_t start_s, end_s;
+  uint16_t start_ms, end_ms;
+
+  time_ms(&start_s, &start_ms);
+#endif
+
+  // The old level's header goes first, so the app never reads a level that's
+  // only partly saved:
+  persist_delete(PREGENERATED_LEVEL_KEY(depth));
+  init_level_generator(&g_level_generator,
+                       get_level_seed(run_seed, depth),
+                       depth,
+                       g_level_chunks);
+  memset(g_open_rows, 0, sizeof(g_open_rows));
+  g_level_generator.open_rows = g_open_rows;
+  claim_level_chunks(&g_level_generator);
+  while (!run_level_generator(&g_level_generator)) {
+    // (Each call carves another room, corridor, etc.)
+  }
+  if (level_is_connected()) {
+    save_pregenerated_level();
+  } else {
+    APP_LOG(APP_LOG_LEVEL_WARNING,
+            "Level at depth %d failed validation",
+            depth);
+  }
+#ifdef LEVEL_GENERATION_BENCHMARK
+  time_ms(&end_s, &end_ms);
+  APP_LOG(APP_LOG_LEVEL_DEBUG,
+          "Worker pregenerated depth %d in %d ms",
+          depth,
+          (int) ((end_s - start_s) * 1000 + end_ms - start_ms));
+#endif
+}
+
+/******************************************************************************
+   Function: level_is_connected
+
+Description: Determines whether the exit of the level just generated can be
+             reached from its entrance, flooding outward from the entrance a
+             cell at a time through the level's open cells.
+
+     Inputs: None.
+
+    Outputs: "True" if the exit is reachable.
+******************************************************************************/
+bool level_is_connected(void) {
+  int8_t y;
+  bool changed = true;
+  uint64_t reachable;
+  const GPoint entrance = g_level_generator.entrance,
+               exit = g_level_generator.exit;
+
+  memset(g_reachable_rows, 0, sizeof(g_reachable_rows));
+  g_reachable_rows[entrance.y] = ((uint64_t) 1 << entrance.x) &
+                                 g_open_rows[entrance.y];
+  while (changed) {
+    changed = false;
+    for (y = 0; y < MAP_HEIGHT; ++y) {
+      reachable = g_reachable_rows[y] |
+                  g_reachable_rows[y] << 1 |
+                  g_reachable_rows[y] >> 1;
+      if (y > 0) {
+        reachable |= g_reachable_rows[y - 1];
+      }
+      if (y < MAP_HEIGHT - 1) {
+        reachable |= g_reachable_rows[y + 1];
+      }
+      reachable &= g_open_rows[y];
+      if (reachable != g_reachable_rows[y]) {
+        g_reachable_rows[y] = reachable;
+        changed = true;
+      }
+    }
+  }
+
+  return g_reachable_rows[exit.y] >> exit.x & 1;
+}
+
+/******************************************************************************
+   Function: save_pregenerated_level
+
+Description: Saves the chunks around the entrance of the level just generated
+             to persistent storage, a row of chunks per key, followed by the
+             level's header (see "pregenerated_level_t").
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void save_pregenerated_level(void) {
+  int8_t i, j;
+  map_chunk_t chunks[RESIDENT_CHUNKS_WIDE];
+  pregenerated_level_t level;
+  const uint32_t key = PREGENERATED_LEVEL_KEY(g_level_generator.depth);
+  const GPoint first_chunk =
+    GPoint(CHUNK_COORDINATE(g_level_generator.entrance.x) - 1,
+           CHUNK_COORDINATE(g_level_generator.entrance.y) - 1);
+
+  level.checksum = CHECKSUM_BASIS;
+  for (i = 0; i < RESIDENT_CHUNKS_WIDE; ++i) {
+    for (j = 0; j < RESIDENT_CHUNKS_WIDE; ++j) {
+      chunks[j] = g_level_chunks[RESIDENT_CHUNK_SLOT(first_chunk.y + i)]
+                                [RESIDENT_CHUNK_SLOT(first_chunk.x + j)].chunk;
+    }
+    level.checksum = get_checksum(chunks, sizeof(chunks), level.checksum);
+    persist_write_data(key + 1 + i, chunks, sizeof(chunks));
+  }
+  level.seed = g_level_generator.seed;
+  level.depth = g_level_generator.depth;
+  level.direction = g_level_generator.direction;
+  level.floor_color_scheme = g_level_generator.floor_color_scheme;
+  level.wall_color_scheme = g_level_generator.wall_color_scheme;
+  level.entrance = g_level_generator.entrance;
+  level.exit = g_level_generator.exit;
+  persist_write_data(key, &level, sizeof(level));
+}
+
+/******************************************************************************
+   Function: init
+
+Description: Initializes the worker, letting the app know it's running (so the
+             app can ask for levels to be pregenerated).
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void init(void) {
+  AppWorkerMessage message = {0};
+
+  app_worker_message_subscribe(worker_message_handler);
+  app_worker_send_message(WORKER_STARTED_MESSAGE, &message);
+}
+
+/******************************************************************************
+   Function: deinit
+
+Description: Deinitializes the worker.
+
+     Inputs: None.
+
+    Outputs: None.
+******************************************************************************/
+void deinit(void) {
+  app_worker_message_unsubscribe();
+}
+
+/******************************************************************************
+   Function: main
+
+Description: Main function for PebbleQuest's background worker.
+
+     Inputs: None.
+
+    Outputs: Number of errors encountered.
+******************************************************************************/
+int main(void) {
+  init();
+  worker_event_loop();
+  deinit();
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+   Filename: pebble_quest_worker.h
+
+     Author: David C. Drake (http://davidcdrake.com)
+
+Description: Header file for PebbleQuest's background worker, which generates
+             and validates upcoming levels ahead of time, saving them to
+             persistent storage for the app (see "load_pregenerated_level").
+******************************************************************************/
+
+#ifndef PEBBLE_QUEST_WORKER_H_
+#define PEBBLE_QUEST_WORKER_H_
+
+#include <pebble_worker.h>
+#include "../src/level_generation.h"
+
+#if MAP_WIDTH > 64
+#error "The worker's bitsets hold at most 64 cells per map row."
+#endif
+
+/******************************************************************************
+  Global Variables
+******************************************************************************/
+
+level_generator_t g_level_generator;
+resident_chunk_t g_level_chunks[RESIDENT_CHUNKS_WIDE]
+                               [RESIDENT_CHUNKS_WIDE];  // By chunk y, x.
+uint64_t g_open_rows[MAP_HEIGHT],  // Bit "x" is set if cell "x" is open.
+         g_reachable_rows[MAP_HEIGHT];  // Likewise, if reachable.
+
+/******************************************************************************
+  Function Declarations
+******************************************************************************/
+
+static void worker_message_handler(uint16_t type, AppWorkerMessage *message);
+void pregenerate_levels(const uint32_t run_seed, const int8_t depth);
+void pregenerate_level(const uint32_t run_seed, const int8_t depth);
+bool level_is_connected(void);
+void save_pregenerated_level(void);
+void init(void);
+void deinit(void);
+int main(void);
+
+#endif  // PEBBLE_QUEST_WORKER_H_